@@ -4,41 +4,70 @@
 
 polyphony.Client = function(serverAddress) {
     this.onEvent = null;
-    this._socket = new WebSocket(serverAddress);
-    this._socket.onopen = function() {
-        console.log("WebSocket connection open.");
-    };
+    this._serverAddress = serverAddress;
+    this._closed = false;
 
-    var sendFunc = Runtime.addFunction(function(stringPointer) {
+    this._sendFunc = Runtime.addFunction(function(stringPointer) {
         var string = Module.Pointer_stringify(stringPointer);
         this._socket.send(string);
     }.bind(this));
 
-    var eventFunc = Runtime.addFunction(function(type, nativeOp) {
+    this._eventFunc = Runtime.addFunction(function(type, nativeOp) {
         if (this.onEvent) {
             this.onEvent(type, new polyphony.Op(nativeOp));
         }
     }.bind(this));
 
-    this._socket.onmessage = function(e) {
-        if (!this._otClient) {
-            var obj = JSON.parse(e.data);
+    this._connect();
+};
+
+// Delay in milliseconds before reconnecting after the connection drops.
+polyphony.Client.RECONNECT_DELAY = 1000;
+
+polyphony.Client.prototype = {
+    _connect: function() {
+        // A client that already has a document is reconnecting, so it asks to
+        // be caught up from the last state it saw instead of using the
+        // snapshot in the server's greeting.
+        var resuming = !!this._otClient;
 
-            console.log("[INFO] Creating new client.\n\tClient ID: %d",
-                obj.clientId);
+        this._socket = new WebSocket(this._serverAddress);
+        this._socket.onopen = function() {
+            console.log("WebSocket connection open.");
+        };
 
-            this._otClient = cFuncs.otNewClient(sendFunc, eventFunc);
-            cFuncs.otClientSetId(this._otClient, obj.clientId);
-            if (obj.lastOp) {
-                cFuncs.otClientReceive(this._otClient, obj.lastOp);
+        this._socket.onclose = function() {
+            if (!this._closed) {
+                setTimeout(this._connect.bind(this),
+                    polyphony.Client.RECONNECT_DELAY);
             }
-            return;
-        }
-        cFuncs.otClientReceive(this._otClient, e.data);
-    }.bind(this);
-};
+        }.bind(this);
 
-polyphony.Client.prototype = {
+        this._socket.onmessage = function(e) {
+            if (resuming) {
+                resuming = false;
+                console.log("[INFO] Resuming client.");
+                cFuncs.otClientResume(this._otClient);
+                return;
+            }
+
+            if (!this._otClient) {
+                var obj = JSON.parse(e.data);
+
+                console.log("[INFO] Creating new client.\n\tClient ID: %d",
+                    obj.clientId);
+
+                this._otClient = cFuncs.otNewClient(this._sendFunc,
+                    this._eventFunc);
+                cFuncs.otClientSetId(this._otClient, obj.clientId);
+                if (obj.lastOp) {
+                    cFuncs.otClientReceive(this._otClient, obj.lastOp);
+                }
+                return;
+            }
+            cFuncs.otClientReceive(this._otClient, e.data);
+        }.bind(this);
+    },
     apply: function(op) {
         var ptr = Module._malloc(4);
         Module.setValue(ptr, op.nativeOp, "*");
@@ -49,6 +78,7 @@ polyphony.Client.prototype = {
         return (error === 0);
     },
     close: function() {
+        this._closed = true;
         this._socket.close();
     }
 };
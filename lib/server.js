@@ -1,5 +1,17 @@
 "use strict";
 
+// Returns whether a message is a resume request from a reconnecting client. The
+// message is decoded rather than matched against, since JSON doesn't fix the
+// order of an object's keys.
+function isResumeRequest(message) {
+    try {
+        var obj = JSON.parse(message);
+        return obj !== null && typeof obj.resume === "string";
+    } catch (e) {
+        return false;
+    }
+}
+
 /**
  * Creates an OT server using a given SocketServer.
  * @param {SocketServer} socketServer - The WebSocket to listen on.
@@ -20,6 +32,20 @@ polyphony.Server = function(socketServer) {
     var lastId = 0;
     socketServer.onConnection = function(socket) {
         socket.onMessage = function(message) {
+            // The server broadcasts everything it sends, so a reconnecting
+            // client's catch-up is answered on its own socket instead.
+            if (isResumeRequest(message)) {
+                // The reply is allocated by libot, so it's copied and then
+                // freed here.
+                var catchUpPointer = cFuncs.otServerCatchUp(nativeServer,
+                    message);
+                if (catchUpPointer) {
+                    socket.send(Module.Pointer_stringify(catchUpPointer));
+                    Module._free(catchUpPointer);
+                }
+                return;
+            }
+
             cFuncs.otServerReceive(nativeServer, message);
         };
 
@@ -28,16 +54,11 @@ polyphony.Server = function(socketServer) {
             clientId: lastId
         };
 
-        var nativeDocPtr = cFuncs.otServerGetDoc(nativeServer);
-        if (nativeDocPtr !== 0) {
-            var nativeOpPtr = cFuncs.otDocGetComposed(nativeDocPtr);
-            if (nativeOpPtr !== 0) {
-                var lastOpJSON = cFuncs.otEncode(nativeOpPtr);
-
-                if (lastOpJSON) {
-                    message.lastOp = lastOpJSON;
-                }
-            }
+        // The snapshot is only encoded once per version of the document, no
+        // matter how many clients join.
+        var lastOpJSON = cFuncs.otServerSnapshot(nativeServer, 0);
+        if (lastOpJSON) {
+            message.lastOp = lastOpJSON;
         }
 
         console.log("[INFO] Acknowledging new client.\n\tJSON:", message);
@@ -52,6 +73,14 @@ polyphony.Server.prototype = {
         var nativeDocPtr = cFuncs.otServerGetDoc(this.nativeServer);
         cFuncs.otDocSetMaxSize(nativeDocPtr, max);
     },
+    /**
+     * The number of bytes of native memory held by the document.
+     * @type {number}
+     */
+    get bytes() {
+        var nativeDocPtr = cFuncs.otServerGetDoc(this.nativeServer);
+        return cFuncs.otDocBytes(nativeDocPtr);
+    },
     close: function() {
         this.socketServer.close();
     }
@@ -48,6 +48,10 @@ var polyphony = {};
         cFuncs.otDocGetComposed = Module.cwrap("ot_doc_get_composed", "number", ["number"]);
         cFuncs.otDocSetMaxSize = Module.cwrap("ot_doc_set_max_size", null, ["number","number"]);
         cFuncs.otClientSetId = Module.cwrap("ot_client_set_id", null, ["number", "number"]);
+        cFuncs.otDocBytes = Module.cwrap("ot_doc_bytes", "number", ["number"]);
+        cFuncs.otServerSnapshot = Module.cwrap("ot_server_snapshot", "string", ["number", "number"]);
+        cFuncs.otServerCatchUp = Module.cwrap("ot_server_catch_up", "number", ["number", "string"]);
+        cFuncs.otClientResume = Module.cwrap("ot_client_resume", null, ["number"]);
         polyphony.cFuncs = cFuncs;
 
         /* {{lib}} */
@@ -32,7 +32,13 @@
 #include <ctype.h>
 #include "cJSON.h"
 
+/* libot parses messages for different documents on several threads at once,
+   so the error pointer is kept per thread. */
+#ifdef LIBOT_NO_THREADS
 static const char *ep;
+#else
+static __thread const char *ep;
+#endif
 
 const char *cJSON_GetErrorPtr(void) {return ep;}
 
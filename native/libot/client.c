@@ -2,46 +2,17 @@
 
 static ot_err append_op(ot_client* client, ot_op** op) {
     ot_doc* doc = client->doc;
-    char* op_enc = ot_encode(*op);
-    char* doc_enc = NULL;
-    if (doc->composed == NULL) {
-        fprintf(stderr, "[INFO] Appending operation to empty document.\n"
-                        "\tOperation: %s\n",
-                op_enc);
-    } else {
-        doc_enc = ot_encode(doc->composed);
-        fprintf(stderr, "[INFO] Appending operation to document.\n"
-                        "\tDocument: %s\n"
-                        "\tOperation: %s\n",
-                doc_enc, op_enc);
-    }
+    OT_LOG_OPS(OT_LOG_DEBUG, OT_ERR_NONE, "Appending operation to document.",
+               "Document", doc->composed, "Operation", *op, NULL);
 
     ot_err err = ot_doc_append(doc, op);
     if (err != OT_ERR_NONE) {
-        if (doc->composed == NULL) {
-            fprintf(stderr, "[ERROR %d] Appending operation to empty document "
-                            "failed.\n"
-                            "\tOperation: %s\n",
-                    err, op_enc);
-        } else {
-            fprintf(stderr, "[ERROR %d] Appending operation to document failed."
-                            "\n"
-                            "\tDocument: %s\n"
-                            "\tOperation: %s\n",
-                    err, doc_enc, op_enc);
-            free(doc_enc);
-        }
-
+        OT_LOG_OPS(OT_LOG_ERROR, err, "Appending operation to document failed.",
+                   "Document", doc->composed, "Operation", *op, NULL);
         ot_free_op(*op);
-        free(op_enc);
         return err;
     }
 
-    if (doc_enc != NULL) {
-        free(doc_enc);
-    }
-    free(op_enc);
-
     return OT_ERR_NONE;
 }
 
@@ -51,33 +22,21 @@ static ot_err buffer_op(ot_client* client, ot_op* op) {
         return OT_ERR_NONE;
     }
 
-    char* buffer_enc = ot_encode(client->buffer);
-    char* op_enc = ot_encode(op);
-    fprintf(stderr, "[INFO] Composing buffer with applied operation.\n"
-                    "\tBuffer: %s\n"
-                    "\tApplied Operation: %s\n",
-            buffer_enc, op_enc);
+    OT_LOG_OPS(OT_LOG_DEBUG, OT_ERR_NONE,
+               "Composing buffer with applied operation.", "Buffer",
+               client->buffer, "Applied Operation", op, NULL);
 
     ot_op* composed = ot_compose(client->buffer, op);
     if (composed == NULL) {
-        fprintf(stderr, "[ERROR %d] Composition of buffer with applied "
-                        "operation failed.\n"
-                        "\tBuffer: %s\n"
-                        "\tApplied Operation: %s\n",
-                OT_ERR_COMPOSE_FAILED, buffer_enc, op_enc);
-        free(buffer_enc);
-        free(op_enc);
+        OT_LOG_OPS(OT_LOG_ERROR, OT_ERR_COMPOSE_FAILED,
+                   "Composition of buffer with applied operation failed.",
+                   "Buffer", client->buffer, "Applied Operation", op, NULL);
         return OT_ERR_BUFFER_FAILED;
     }
-    free(buffer_enc);
-    free(op_enc);
 
-    char* composed_enc = ot_encode(composed);
-    fprintf(stderr, "[INFO] Composition of buffer with applied operation "
-                    "succeeded.\n"
-                    "\tComposed Buffer: %s\n",
-            composed_enc);
-    free(composed_enc);
+    OT_LOG_OPS(OT_LOG_DEBUG, OT_ERR_NONE,
+               "Composition of buffer with applied operation succeeded.",
+               "Composed Buffer", composed, NULL);
 
     ot_free_op(client->buffer);
     client->buffer = NULL;
@@ -101,7 +60,7 @@ static void send_buffer(ot_client* client, const char* received_hash) {
 
     char* enc_buf = ot_encode(client->buffer);
     client->send(enc_buf);
-    fprintf(stderr, "[INFO] Sent message.\n\tJSON: %s\n", enc_buf);
+    OT_LOG(OT_LOG_DEBUG, OT_ERR_NONE, "Sent message.\n\tJSON: %s", enc_buf);
     free(enc_buf);
 
     if (client->anticipated != NULL) {
@@ -134,37 +93,26 @@ static ot_err xform_anticipated(ot_client* client, ot_op* received,
         return OT_ERR_NONE;
     }
 
-    char* received_enc = ot_encode(received);
-    char* anticipated_enc = ot_encode(client->anticipated);
-    fprintf(stderr, "[INFO] Transforming received operation against anticipated"
-                    " operation.\n"
-                    "\tReceived Operation: %s\n"
-                    "\tAnticipated Operation: %s\n",
-            received_enc, anticipated_enc);
+    OT_LOG_OPS(OT_LOG_DEBUG, OT_ERR_NONE,
+               "Transforming received operation against anticipated "
+               "operation.",
+               "Received Operation", received, "Anticipated Operation",
+               client->anticipated, NULL);
     ot_xform_pair p = ot_xform(received, client->anticipated);
     if (p.op1_prime == NULL || p.op2_prime == NULL) {
-        fprintf(stderr, "[ERROR %d] Transformation of received operation "
-                        "against anticipated operation failed.\n"
-                        "\tReceived Operation: %s\n"
-                        "\tAnticipated Operation: %s\n",
-                OT_ERR_XFORM_FAILED, received_enc, anticipated_enc);
-
-        free(received_enc);
-        free(anticipated_enc);
+        OT_LOG_OPS(OT_LOG_ERROR, OT_ERR_XFORM_FAILED,
+                   "Transformation of received operation against anticipated "
+                   "operation failed.",
+                   "Received Operation", received, "Anticipated Operation",
+                   client->anticipated, NULL);
         return OT_ERR_XFORM_FAILED;
     }
-    free(received_enc);
-    free(anticipated_enc);
 
-    char* op1_prime_enc = ot_encode(p.op1_prime);
-    char* op2_prime_enc = ot_encode(p.op2_prime);
-    fprintf(stderr, "[INFO] Transformation of received operation against "
-                    "anticipated operation succeeded.\n"
-                    "\tReceived Operation': %s\n"
-                    "\tAnticipated Operation': %s\n",
-            op1_prime_enc, op2_prime_enc);
-    free(op1_prime_enc);
-    free(op2_prime_enc);
+    OT_LOG_OPS(OT_LOG_DEBUG, OT_ERR_NONE,
+               "Transformation of received operation against anticipated "
+               "operation succeeded.",
+               "Received Operation'", p.op1_prime, "Anticipated Operation'",
+               p.op2_prime, NULL);
 
     *inter = p.op1_prime;
 
@@ -184,37 +132,25 @@ static ot_err xform_buffer(ot_client* client, ot_op* inter, ot_op** apply) {
         return OT_ERR_NONE;
     }
 
-    char* buffer_enc = ot_encode(client->buffer);
-    char* inter_enc = ot_encode(inter);
-    fprintf(stderr, "[INFO] Transforming buffer against intermediate operation."
-                    "\n"
-                    "\tBuffer: %s\n"
-                    "\tIntermediate Operation: %s\n",
-            buffer_enc, inter_enc);
+    OT_LOG_OPS(OT_LOG_DEBUG, OT_ERR_NONE,
+               "Transforming buffer against intermediate operation.", "Buffer",
+               client->buffer, "Intermediate Operation", inter, NULL);
 
     ot_xform_pair p = ot_xform(client->buffer, inter);
     if (p.op1_prime == NULL || p.op2_prime == NULL) {
-        fprintf(stderr, "[ERROR %d] Transformation of buffer against "
-                        "intermediate operation failed.\n"
-                        "\tBuffer: %s\n"
-                        "\tIntermediate Operation: %s\n",
-                OT_ERR_XFORM_FAILED, buffer_enc, inter_enc);
-        free(buffer_enc);
-        free(inter_enc);
+        OT_LOG_OPS(OT_LOG_ERROR, OT_ERR_XFORM_FAILED,
+                   "Transformation of buffer against intermediate operation "
+                   "failed.",
+                   "Buffer", client->buffer, "Intermediate Operation", inter,
+                   NULL);
         return OT_ERR_XFORM_FAILED;
     }
-    free(buffer_enc);
-    free(inter_enc);
 
-    char* op1_prime_enc = ot_encode(p.op1_prime);
-    char* op2_prime_enc = ot_encode(p.op2_prime);
-    fprintf(stderr, "[INFO] Transformation of buffer against intermediate "
-                    "operation succeeded.\n"
-                    "\tBuffer': %s\n"
-                    "\tIntermediate Operation': %s\n",
-            op1_prime_enc, op2_prime_enc);
-    free(op1_prime_enc);
-    free(op2_prime_enc);
+    OT_LOG_OPS(OT_LOG_DEBUG, OT_ERR_NONE,
+               "Transformation of buffer against intermediate operation "
+               "succeeded.",
+               "Buffer'", p.op1_prime, "Intermediate Operation'", p.op2_prime,
+               NULL);
 
     *apply = p.op2_prime;
     ot_free_op(client->buffer);
@@ -226,6 +162,32 @@ static ot_err xform_buffer(ot_client* client, ot_op* inter, ot_op** apply) {
     return OT_ERR_NONE;
 }
 
+// Handles the acknowledgement of the op that was last sent to the server,
+// sending anything that was buffered in the meantime.
+static void receive_ack(ot_client* client, const char* hash) {
+    // A server may acknowledge an op again if it receives it twice (e.g., a
+    // message replayed after a reconnect). The repeat arrives once the op has
+    // already been acknowledged, so it's either unexpected or carries the hash
+    // of the last acknowledged op.
+    if (!client->ack_required || memcmp(hash, client->acked_hash, 20) == 0) {
+        OT_LOG(OT_LOG_DEBUG, OT_ERR_NONE,
+               "Ignoring a repeated acknowledgement.");
+        return;
+    }
+
+    if (ot_log_enabled(OT_LOG_INFO)) {
+        char hex[41] = { 0 };
+        atohex(hex, hash, 20);
+        OT_LOG(OT_LOG_INFO, OT_ERR_NONE,
+               "Operation was acknowledged.\n\tHash: %s", hex);
+    }
+
+    client->ack_required = false;
+    memcpy(client->last_hash, hash, 20);
+    memcpy(client->acked_hash, hash, 20);
+    send_buffer(client, hash);
+}
+
 ot_client* ot_new_client(send_func send, ot_event_func event) {
     ot_client* client = malloc(sizeof(ot_client));
     client->buffer = NULL;
@@ -235,6 +197,9 @@ ot_client* ot_new_client(send_func send, ot_event_func event) {
     client->doc = NULL;
     client->client_id = 0;
     client->ack_required = false;
+    memset(client->last_hash, 0, 20);
+    memset(client->acked_hash, 0, 20);
+    client->resuming = false;
 
     return client;
 }
@@ -255,38 +220,19 @@ void ot_free_client(ot_client* client) {
 
 void ot_client_open(ot_client* client, ot_doc* doc) { client->doc = doc; }
 
-void ot_client_receive(ot_client* client, const char* op) {
-    fprintf(stderr, "[INFO] Received message.\n\tJSON: %s\n", op);
-
-    ot_op* dec = ot_new_op();
-    ot_err err = ot_decode(dec, op);
-    if (err != OT_ERR_NONE) {
-        fprintf(stderr, "[ERROR %d] The decoded operation returned an error.\n"
-                        "\tJSON: %s\n",
-                err, op);
-        ot_free_op(dec);
-        fire_op_event(client, OT_ERROR, NULL);
-        return;
-    }
-
+// Handles a decoded op from the server. Takes ownership of dec.
+static void receive_op(ot_client* client, ot_op* dec) {
     if (dec->client_id == client->client_id) {
-        char hex[41] = { 0 };
-        atohex(hex, dec->hash, 20);
-        fprintf(stderr, "[INFO] Operation was acknowledged.\n"
-                        "\tHash: %s\n",
-                hex);
-
-        client->ack_required = false;
-        send_buffer(client, dec->hash);
-
+        receive_ack(client, dec->hash);
         ot_free_op(dec);
         return;
     }
 
+    memcpy(client->last_hash, dec->hash, 20);
     fire_op_event(client, OT_OP_INCOMING, NULL);
 
     ot_op* inter;
-    err = xform_anticipated(client, dec, &inter);
+    ot_err err = xform_anticipated(client, dec, &inter);
     if (err != OT_ERR_NONE) {
         ot_free_op(dec);
         fire_op_event(client, OT_ERROR, NULL);
@@ -302,24 +248,138 @@ void ot_client_receive(ot_client* client, const char* op) {
     }
 
     if (client->doc == NULL) {
-        fputs("[INFO] Creating a new document.\n", stderr);
+        OT_LOG(OT_LOG_INFO, OT_ERR_NONE, "Creating a new document.");
         client->doc = ot_new_doc();
     }
     append_op(client, &apply);
     fire_op_event(client, OT_OP_APPLIED, apply);
 }
 
+// Replaces the client's document with a snapshot from the server. Any ops that
+// weren't acknowledged are based on a state the server no longer has, so they
+// have to be dropped.
+static void receive_snapshot(ot_client* client, ot_catch_up* catch_up) {
+    if (client->anticipated != NULL || client->buffer != NULL) {
+        OT_LOG(OT_LOG_ERROR, OT_ERR_PARENT_MISSING,
+               "Dropping unacknowledged operations that can't be resumed.");
+        fire_op_event(client, OT_ERROR, NULL);
+    }
+    if (client->anticipated != NULL) {
+        ot_free_op(client->anticipated);
+        client->anticipated = NULL;
+    }
+    if (client->buffer != NULL) {
+        ot_free_op(client->buffer);
+        client->buffer = NULL;
+    }
+    client->ack_required = false;
+
+    if (client->doc != NULL) {
+        ot_free_doc(client->doc);
+    }
+    client->doc = ot_new_doc();
+
+    ot_catch_up_msg* msgs = catch_up->msgs.data;
+    if (catch_up->msgs.len > 0 && msgs[0].op != NULL) {
+        ot_op* op = msgs[0].op;
+        msgs[0].op = NULL;
+        if (append_op(client, &op) != OT_ERR_NONE) {
+            fire_op_event(client, OT_ERROR, NULL);
+            return;
+        }
+    }
+
+    fire_op_event(client, OT_CONNECTED, client->doc->composed);
+}
+
+static void receive_catch_up(ot_client* client, ot_catch_up* catch_up) {
+    bool resuming = client->resuming;
+    client->resuming = false;
+
+    if (catch_up->snapshot) {
+        receive_snapshot(client, catch_up);
+        memcpy(client->last_hash, catch_up->head, 20);
+        return;
+    }
+
+    // If the op that was in flight when the connection dropped never reached
+    // the server, the catch-up won't acknowledge it and it has to be sent
+    // again, now based on the server's current state.
+    bool in_flight = resuming && client->ack_required;
+    bool acked = false;
+
+    ot_catch_up_msg* msgs = catch_up->msgs.data;
+    for (size_t i = 0; i < catch_up->msgs.len; ++i) {
+        if (msgs[i].op == NULL) {
+            acked = true;
+            receive_ack(client, msgs[i].ack);
+            continue;
+        }
+
+        receive_op(client, msgs[i].op);
+        msgs[i].op = NULL;
+    }
+    memcpy(client->last_hash, catch_up->head, 20);
+
+    if (in_flight && !acked && client->anticipated != NULL) {
+        memcpy(client->anticipated->parent, catch_up->head, 20);
+        char* enc = ot_encode(client->anticipated);
+        client->send(enc);
+        OT_LOG(OT_LOG_DEBUG, OT_ERR_NONE, "Resent message.\n\tJSON: %s", enc);
+        free(enc);
+    }
+
+    fire_op_event(client, OT_CONNECTED, NULL);
+}
+
+void ot_client_receive(ot_client* client, const char* op) {
+    OT_LOG(OT_LOG_DEBUG, OT_ERR_NONE, "Received message.\n\tJSON: %s", op);
+
+    // A server that knows the recipient of each message acknowledges the
+    // client's own ops with just their hash instead of echoing them back.
+    char acked[20];
+    if (ot_decode_ack(acked, op) == OT_ERR_NONE) {
+        receive_ack(client, acked);
+        return;
+    }
+
+    ot_catch_up catch_up;
+    ot_err err = ot_decode_catch_up(&catch_up, op);
+    if (err == OT_ERR_NONE) {
+        receive_catch_up(client, &catch_up);
+        ot_free_catch_up(&catch_up);
+        return;
+    }
+
+    ot_op* dec = ot_new_op();
+    err = ot_decode(dec, op);
+    if (err != OT_ERR_NONE) {
+        OT_LOG(OT_LOG_ERROR, err,
+               "The decoded operation returned an error.\n\tJSON: %s", op);
+        ot_free_op(dec);
+        fire_op_event(client, OT_ERROR, NULL);
+        return;
+    }
+
+    receive_op(client, dec);
+}
+
+void ot_client_resume(ot_client* client) {
+    char* enc = ot_encode_resume(client->last_hash, client->client_id);
+    client->resuming = true;
+    client->send(enc);
+    OT_LOG(OT_LOG_INFO, OT_ERR_NONE, "Resuming.\n\tJSON: %s", enc);
+    free(enc);
+}
+
 ot_err ot_client_apply(ot_client* client, ot_op** op) {
-    char* op_enc = ot_encode(*op);
-    fprintf(stderr, "[INFO] Editor applying operation.\n"
-                    "\tOperation: %s\n",
-            op_enc);
-    free(op_enc);
+    OT_LOG_OPS(OT_LOG_DEBUG, OT_ERR_NONE, "Editor applying operation.",
+               "Operation", *op, NULL);
 
     (*op)->client_id = client->client_id;
 
     if (client->doc == NULL) {
-        fputs("[INFO] Creating a new document.\n", stderr);
+        OT_LOG(OT_LOG_INFO, OT_ERR_NONE, "Creating a new document.");
         client->doc = ot_new_doc();
     }
 
@@ -9,6 +9,7 @@
 #include "xform.h"
 #include "encode.h"
 #include "decode.h"
+#include "log.h"
 
 typedef struct {
     send_func send;
@@ -18,6 +19,20 @@ typedef struct {
     bool ack_required;
     ot_op* anticipated;
     ot_op* buffer;
+
+    // Hash of the latest server state the client has seen, which is where it
+    // resumes from after reconnecting.
+    char last_hash[20];
+
+    // Hash of the client's last acknowledged op, which is what a repeated
+    // acknowledgement of it carries. The latest state's hash can't be used,
+    // since an op that transforms into a no-op is acknowledged with it.
+    char acked_hash[20];
+
+    // Whether the client asked to be caught up and hasn't been yet. A server
+    // may also catch up a client that fell behind without being asked, in
+    // which case an op in flight is still on its way and mustn't be resent.
+    bool resuming;
 } ot_client;
 
 ot_client* ot_new_client(send_func send, ot_event_func event);
@@ -28,6 +43,17 @@ void ot_client_open(ot_client* client, ot_doc* doc);
 
 void ot_client_receive(ot_client* client, const char* op);
 
+// Asks the server to catch the client up after it reconnects, instead of
+// sending the whole document again. The server replies with the ops the client
+// missed, composed where possible, and acknowledges the op that was in flight
+// if it was received. Otherwise that op is sent again once the client has
+// caught up. If the server no longer has the client's last state, it replies
+// with a snapshot that replaces the client's document, and any unacknowledged
+// ops are dropped. Either way, an OT_CONNECTED event is fired once the client
+// has caught up; its op is the new document if a snapshot was received and NULL
+// otherwise.
+void ot_client_resume(ot_client* client);
+
 ot_err ot_client_apply(ot_client* client, ot_op** op);
 
 #endif
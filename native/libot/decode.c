@@ -1,5 +1,7 @@
 #include "decode.h"
 
+static ot_err decode_cjson_comps(cJSON* components, ot_op* op);
+
 // decode_cjson_op decodes a cJSON item into an op.
 ot_err decode_cjson_op(cJSON* json, ot_op* op) {
     cJSON* error_code = cJSON_GetObjectItem(json, "errorCode");
@@ -32,6 +34,11 @@ ot_err decode_cjson_op(cJSON* json, ot_op* op) {
         return OT_ERR_COMPONENTS_MISSING;
     }
 
+    return decode_cjson_comps(components, op);
+}
+
+// decode_cjson_comps decodes a cJSON array of components, appending them to op.
+static ot_err decode_cjson_comps(cJSON* components, ot_op* op) {
     int size = cJSON_GetArraySize(components);
     for (int i = 0; i < size; ++i) {
         cJSON* item = cJSON_GetArrayItem(components, i);
@@ -85,6 +92,325 @@ ot_err ot_decode(ot_op* op, const char* json) {
     return err;
 }
 
+ot_err ot_decode_tagged(ot_op* op, char** doc_id, const char* const json) {
+    cJSON* root = cJSON_Parse(json);
+    if (root == NULL) {
+        return OT_ERR_INVALID_JSON;
+    }
+
+    cJSON* doc_idf = cJSON_GetObjectItem(root, "docId");
+    if (doc_idf == NULL || doc_idf->type != cJSON_String) {
+        cJSON_Delete(root);
+        return OT_ERR_DOC_ID_MISSING;
+    }
+
+    ot_err err = decode_cjson_op(root, op);
+    if (err == OT_ERR_NONE) {
+        size_t size = strlen(doc_idf->valuestring) + 1;
+        *doc_id = malloc(size);
+        memcpy(*doc_id, doc_idf->valuestring, size);
+    }
+
+    cJSON_Delete(root);
+    return err;
+}
+
+static const char* skip_space(const char* c) {
+    while (*c == ' ' || *c == '\t' || *c == '\n' || *c == '\r') {
+        ++c;
+    }
+
+    return c;
+}
+
+// Returns whether json is an object whose first field is the given one. This
+// tells the small control messages apart from ops without parsing them.
+static bool starts_with_field(const char* json, const char* field) {
+    const char* c = skip_space(json);
+    if (*c != '{') {
+        return false;
+    }
+
+    c = skip_space(c + 1);
+    size_t len = strlen(field);
+    return c[0] == '"' && strncmp(c + 1, field, len) == 0 && c[len + 1] == '"';
+}
+
+// Decodes a hex hash field into hash, which is zeroed if the field is empty.
+static bool decode_hash_field(cJSON* json, const char* field, char* hash) {
+    cJSON* hashf = cJSON_GetObjectItem(json, field);
+    if (hashf == NULL || hashf->type != cJSON_String) {
+        return false;
+    }
+
+    memset(hash, 0, 20);
+    hextoa(hash, 20, hashf->valuestring, strlen(hashf->valuestring));
+    return true;
+}
+
+// Returns the end of the JSON string starting at c, just past its closing
+// quote, or NULL if it isn't terminated. Sets *escaped if it contains escapes.
+static const char* skip_string(const char* c, bool* escaped) {
+    for (++c; *c != '"'; ++c) {
+        if (*c == '\0') {
+            return NULL;
+        }
+        if (*c == '\\') {
+            *escaped = true;
+            if (*++c == '\0') {
+                return NULL;
+            }
+        }
+    }
+
+    return c + 1;
+}
+
+// Returns the end of the JSON value starting at c, or NULL if it isn't
+// terminated. Nested values are only matched up, not validated.
+static const char* skip_value(const char* c) {
+    bool escaped = false;
+    if (*c == '"') {
+        return skip_string(c, &escaped);
+    }
+
+    if (*c != '{' && *c != '[') {
+        while (*c != '\0' && *c != ',' && *c != '}' && *c != ']' &&
+               *c != ' ' && *c != '\t' && *c != '\n' && *c != '\r') {
+            ++c;
+        }
+        return c;
+    }
+
+    size_t depth = 0;
+    do {
+        if (*c == '"') {
+            c = skip_string(c, &escaped);
+            if (c == NULL) {
+                return NULL;
+            }
+            continue;
+        }
+
+        if (*c == '{' || *c == '[') {
+            ++depth;
+        } else if (*c == '}' || *c == ']') {
+            --depth;
+        } else if (*c == '\0') {
+            return NULL;
+        }
+        ++c;
+    } while (depth > 0);
+
+    return c;
+}
+
+static bool is_key(const char* key, size_t len, const char* name) {
+    return strlen(name) == len && memcmp(key, name, len) == 0;
+}
+
+// Decodes a hex string value into hash.
+static bool decode_hash_value(const char* value, const char* end,
+                              char* hash) {
+    if (*value != '"') {
+        return false;
+    }
+
+    memset(hash, 0, 20);
+    hextoa(hash, 20, value + 1, (size_t)(end - value - 2));
+    return true;
+}
+
+ot_err ot_decode_header(ot_header* header, const char* const json) {
+    memset(header, 0, sizeof(ot_header));
+    header->json = json;
+
+    bool has_client_id = false;
+    bool has_parent = false;
+    bool has_hash = false;
+    bool has_error = false;
+    ot_err error = OT_ERR_NONE;
+
+    const char* c = skip_space(json);
+    if (*c != '{') {
+        return OT_ERR_INVALID_JSON;
+    }
+    c = skip_space(c + 1);
+
+    while (*c != '}') {
+        bool escaped = false;
+        if (*c != '"') {
+            return OT_ERR_INVALID_JSON;
+        }
+        const char* key = c + 1;
+        c = skip_string(c, &escaped);
+        if (c == NULL) {
+            return OT_ERR_INVALID_JSON;
+        }
+        size_t key_len = (size_t)(c - key - 1);
+
+        c = skip_space(c);
+        if (*c != ':') {
+            return OT_ERR_INVALID_JSON;
+        }
+        const char* value = skip_space(c + 1);
+        const char* end = skip_value(value);
+        if (end == NULL || end == value) {
+            return OT_ERR_INVALID_JSON;
+        }
+
+        // Only the first of any repeated field is used, like cJSON does.
+        if (is_key(key, key_len, "clientId") && !has_client_id) {
+            header->client_id = (uint32_t)strtol(value, NULL, 10);
+            has_client_id = true;
+        } else if (is_key(key, key_len, "parent") && !has_parent) {
+            has_parent = decode_hash_value(value, end, header->parent);
+        } else if (is_key(key, key_len, "hash") && !has_hash) {
+            has_hash = decode_hash_value(value, end, header->hash);
+        } else if (is_key(key, key_len, "components") &&
+                   header->components == NULL) {
+            header->components = value;
+            header->components_len = (size_t)(end - value);
+        } else if (is_key(key, key_len, "docId") && header->doc_id == NULL &&
+                   *value == '"') {
+            skip_string(value, &header->doc_id_escaped);
+            header->doc_id = value + 1;
+            header->doc_id_len = (size_t)(end - value - 2);
+        } else if (is_key(key, key_len, "errorCode") && !has_error) {
+            error = (ot_err)strtol(value, NULL, 10);
+            has_error = true;
+        }
+
+        c = skip_space(end);
+        if (*c == ',') {
+            c = skip_space(c + 1);
+        } else if (*c != '}') {
+            return OT_ERR_INVALID_JSON;
+        }
+    }
+
+    if (has_error) {
+        return error;
+    } else if (!has_client_id) {
+        return OT_ERR_CLIENT_ID_MISSING;
+    } else if (!has_parent) {
+        return OT_ERR_PARENT_MISSING;
+    } else if (!has_hash) {
+        return OT_ERR_HASH_MISSING;
+    } else if (header->components == NULL) {
+        return OT_ERR_COMPONENTS_MISSING;
+    }
+
+    return OT_ERR_NONE;
+}
+
+ot_err ot_decode_body(ot_op* op, const ot_header* header) {
+    op->client_id = header->client_id;
+    memcpy(op->parent, header->parent, 20);
+    memcpy(op->hash, header->hash, 20);
+
+    cJSON* components = cJSON_ParseWithOpts(header->components, NULL, 0);
+    if (components == NULL) {
+        return OT_ERR_INVALID_JSON;
+    }
+
+    ot_err err = decode_cjson_comps(components, op);
+    cJSON_Delete(components);
+    return err;
+}
+
+ot_err ot_decode_ack(char* hash, const char* const json) {
+    if (!starts_with_field(json, "ack")) {
+        return OT_ERR_HASH_MISSING;
+    }
+
+    cJSON* root = cJSON_Parse(json);
+    if (root == NULL) {
+        return OT_ERR_INVALID_JSON;
+    }
+
+    ot_err err = decode_hash_field(root, "ack", hash) ? OT_ERR_NONE
+                                                      : OT_ERR_HASH_MISSING;
+    cJSON_Delete(root);
+    return err;
+}
+
+ot_err ot_decode_resume(char* hash, uint32_t* client_id,
+                        const char* const json) {
+    if (!starts_with_field(json, "resume")) {
+        return OT_ERR_HASH_MISSING;
+    }
+
+    cJSON* root = cJSON_Parse(json);
+    if (root == NULL) {
+        return OT_ERR_INVALID_JSON;
+    }
+
+    ot_err err = OT_ERR_NONE;
+    cJSON* client_idf = cJSON_GetObjectItem(root, "clientId");
+    if (!decode_hash_field(root, "resume", hash)) {
+        err = OT_ERR_HASH_MISSING;
+    } else if (client_idf == NULL || client_idf->type != cJSON_Number) {
+        err = OT_ERR_CLIENT_ID_MISSING;
+    } else {
+        *client_id = (uint32_t)client_idf->valueint;
+    }
+
+    cJSON_Delete(root);
+    return err;
+}
+
+void ot_free_catch_up(ot_catch_up* catch_up) {
+    ot_catch_up_msg* msgs = catch_up->msgs.data;
+    for (size_t i = 0; i < catch_up->msgs.len; ++i) {
+        if (msgs[i].op != NULL) {
+            ot_free_op(msgs[i].op);
+        }
+    }
+    array_free(&catch_up->msgs);
+}
+
+ot_err ot_decode_catch_up(ot_catch_up* catch_up, const char* const json) {
+    array_init(&catch_up->msgs, sizeof(ot_catch_up_msg));
+    if (!starts_with_field(json, "catchUp")) {
+        return OT_ERR_HASH_MISSING;
+    }
+
+    cJSON* root = cJSON_Parse(json);
+    if (root == NULL) {
+        return OT_ERR_INVALID_JSON;
+    }
+
+    cJSON* msgsf = cJSON_GetObjectItem(root, "catchUp");
+    cJSON* snapshotf = cJSON_GetObjectItem(root, "snapshot");
+    if (msgsf == NULL || msgsf->type != cJSON_Array ||
+        !decode_hash_field(root, "head", catch_up->head)) {
+        cJSON_Delete(root);
+        return OT_ERR_HASH_MISSING;
+    }
+    catch_up->snapshot = snapshotf != NULL && snapshotf->type == cJSON_True;
+
+    ot_err err = OT_ERR_NONE;
+    int size = cJSON_GetArraySize(msgsf);
+    for (int i = 0; i < size && err == OT_ERR_NONE; ++i) {
+        cJSON* item = cJSON_GetArrayItem(msgsf, i);
+        ot_catch_up_msg* msg = array_append(&catch_up->msgs);
+        msg->op = NULL;
+        if (decode_hash_field(item, "ack", msg->ack)) {
+            continue;
+        }
+
+        msg->op = ot_new_op();
+        err = decode_cjson_op(item, msg->op);
+    }
+
+    cJSON_Delete(root);
+    if (err != OT_ERR_NONE) {
+        ot_free_catch_up(catch_up);
+    }
+    return err;
+}
+
 ot_err ot_decode_doc(ot_doc* doc, const char* const json) {
     cJSON* root = cJSON_Parse(json);
     if (root == NULL) {
@@ -112,3 +438,323 @@ ot_err ot_decode_doc(ot_doc* doc, const char* const json) {
     cJSON_Delete(root);
     return OT_ERR_NONE;
 }
+
+// Returns true if keyframes is missing or holds keyframes in increasing order
+// for a history of len ops.
+static bool valid_keyframes(const cJSON* keyframes, size_t len) {
+    if (keyframes == NULL) {
+        return true;
+    }
+    if (keyframes->type != cJSON_Array) {
+        return false;
+    }
+
+    double next = 0;
+    for (cJSON* keyframe = keyframes->child; keyframe != NULL;
+         keyframe = keyframe->next) {
+        cJSON* index = cJSON_GetObjectItem(keyframe, "index");
+        cJSON* text = cJSON_GetObjectItem(keyframe, "text");
+        if (index == NULL || index->type != cJSON_Number ||
+            index->valuedouble < next || index->valuedouble >= (double)len ||
+            text == NULL || text->type != cJSON_String) {
+            return false;
+        }
+        next = index->valuedouble + 1;
+    }
+
+    return true;
+}
+
+ot_err ot_decode_doc_state(ot_doc* doc, const char* const json) {
+    cJSON* root = cJSON_Parse(json);
+    if (root == NULL) {
+        return OT_ERR_INVALID_JSON;
+    }
+
+    // cJSON doesn't check the type of the item it's asked for the size of, so
+    // the history has to be checked before it's counted.
+    cJSON* history = cJSON_GetObjectItem(root, "history");
+    if (history == NULL || history->type != cJSON_Array) {
+        cJSON_Delete(root);
+        return OT_ERR_INVALID_JSON;
+    }
+    cJSON* composed_item = cJSON_GetObjectItem(root, "composed");
+    int len = cJSON_GetArraySize(history);
+    if (len > 0 &&
+        (composed_item == NULL || composed_item->type != cJSON_Object)) {
+        cJSON_Delete(root);
+        return OT_ERR_INVALID_JSON;
+    }
+
+    cJSON* max_size = cJSON_GetObjectItem(root, "maxSize");
+    if (max_size != NULL && max_size->type == cJSON_Number) {
+        doc->max_size = (uint32_t)max_size->valuedouble;
+    }
+    cJSON* interval = cJSON_GetObjectItem(root, "keyframeInterval");
+    if (interval != NULL && interval->type == cJSON_Number) {
+        doc->keyframe_interval = (size_t)interval->valuedouble;
+    }
+    if (len == 0) {
+        cJSON_Delete(root);
+        return OT_ERR_NONE;
+    }
+
+    cJSON* keyframes = cJSON_GetObjectItem(root, "keyframes");
+    if (!valid_keyframes(keyframes, (size_t)len)) {
+        cJSON_Delete(root);
+        return OT_ERR_INVALID_JSON;
+    }
+
+    ot_op** ops = malloc(sizeof(ot_op*) * (size_t)len);
+    ot_op* composed = ot_new_op();
+    ot_err err = decode_cjson_op(composed_item, composed);
+    int decoded = 0;
+    while (err == OT_ERR_NONE && decoded < len) {
+        ops[decoded] = ot_new_op();
+        err = decode_cjson_op(cJSON_GetArrayItem(history, decoded),
+                              ops[decoded]);
+        ++decoded;
+    }
+
+    if (err != OT_ERR_NONE) {
+        for (int i = 0; i < decoded; ++i) {
+            ot_free_op(ops[i]);
+        }
+        free(ops);
+        ot_free_op(composed);
+        cJSON_Delete(root);
+        return err;
+    }
+
+    ot_doc_restore(doc, ops, (size_t)len, composed);
+    free(ops);
+
+    cJSON* keyframe = (keyframes != NULL) ? keyframes->child : NULL;
+    for (; keyframe != NULL; keyframe = keyframe->next) {
+        ot_doc_restore_keyframe(
+            doc, (size_t)cJSON_GetObjectItem(keyframe, "index")->valuedouble,
+            cJSON_GetObjectItem(keyframe, "text")->valuestring);
+    }
+
+    cJSON_Delete(root);
+    return OT_ERR_NONE;
+}
+
+// A decoded op waiting to be handed to the sink. Slots are indexed by the op's
+// position in the array modulo the pipeline's window.
+typedef struct decode_slot {
+    ot_op* op;
+    ot_err err;
+    bool ready;
+} decode_slot;
+
+typedef struct decode_pipeline {
+    cJSON** items;
+    size_t len;
+    decode_slot* slots;
+    size_t window;
+    size_t next;     // Index of the next item to be claimed by a worker.
+    size_t consumed; // Number of items handed to the sink.
+    bool stop;
+    double decode_secs;
+    ot_mutex lock;
+    ot_cond claimable;
+    ot_cond ready;
+} decode_pipeline;
+
+static void* decode_worker(void* arg) {
+    decode_pipeline* p = arg;
+
+    ot_mutex_lock(&p->lock);
+    while (true) {
+        while (!p->stop && p->next < p->len &&
+               p->next >= p->consumed + p->window) {
+            ot_cond_wait(&p->claimable, &p->lock);
+        }
+
+        if (p->stop || p->next >= p->len) {
+            break;
+        }
+
+        size_t i = p->next++;
+        ot_mutex_unlock(&p->lock);
+
+        double start = ot_now();
+        ot_op* op = ot_new_op();
+        ot_err err = decode_cjson_op(p->items[i], op);
+        if (err != OT_ERR_NONE) {
+            ot_free_op(op);
+            op = NULL;
+        }
+        double elapsed = ot_now() - start;
+
+        ot_mutex_lock(&p->lock);
+        decode_slot* slot = p->slots + (i % p->window);
+        slot->op = op;
+        slot->err = err;
+        slot->ready = true;
+        p->decode_secs += elapsed;
+        ot_cond_signal(&p->ready);
+    }
+    ot_mutex_unlock(&p->lock);
+
+    return NULL;
+}
+
+// Waits for the op at index i to be decoded and takes it out of its slot. If
+// there are no workers, then the op is decoded on the calling thread instead.
+static decode_slot take_slot(decode_pipeline* p, size_t i, bool threaded) {
+    decode_slot taken;
+    if (!threaded) {
+        double start = ot_now();
+        taken.op = ot_new_op();
+        taken.err = decode_cjson_op(p->items[i], taken.op);
+        if (taken.err != OT_ERR_NONE) {
+            ot_free_op(taken.op);
+            taken.op = NULL;
+        }
+        p->decode_secs += ot_now() - start;
+        p->consumed = i + 1;
+        return taken;
+    }
+
+    ot_mutex_lock(&p->lock);
+    decode_slot* slot = p->slots + (i % p->window);
+    while (!slot->ready) {
+        ot_cond_wait(&p->ready, &p->lock);
+    }
+    taken = *slot;
+    slot->ready = false;
+    slot->op = NULL;
+    p->consumed = i + 1;
+    ot_cond_broadcast(&p->claimable);
+    ot_mutex_unlock(&p->lock);
+
+    return taken;
+}
+
+static double rate(double amount, double secs) {
+    return (secs > 0) ? amount / secs : 0;
+}
+
+ot_err ot_decode_each(const char* const json, const ot_decode_opts* opts,
+                      ot_decode_stats* stats, ot_decode_sink sink, void* arg) {
+    double start = ot_now();
+    cJSON* root = cJSON_Parse(json);
+    if (root == NULL) {
+        return OT_ERR_INVALID_JSON;
+    }
+    double parse_secs = ot_now() - start;
+
+    size_t threads = (opts != NULL) ? opts->threads : 0;
+    if (threads == 0) {
+        threads = ot_cpu_count();
+    }
+    size_t window = (opts != NULL) ? opts->window : 0;
+    if (window == 0) {
+        window = threads * 16;
+    }
+
+    // cJSON stores arrays as linked lists, so we index the items up front to
+    // give workers constant time access to them.
+    decode_pipeline p;
+    p.len = (size_t)cJSON_GetArraySize(root);
+    p.items = malloc(sizeof(cJSON*) * (p.len + 1));
+    size_t n = 0;
+    for (cJSON* item = root->child; item != NULL; item = item->next) {
+        p.items[n++] = item;
+    }
+    p.window = window;
+    p.slots = calloc(window, sizeof(decode_slot));
+    p.next = 0;
+    p.consumed = 0;
+    p.stop = false;
+    p.decode_secs = 0;
+    ot_mutex_init(&p.lock);
+    ot_cond_init(&p.claimable);
+    ot_cond_init(&p.ready);
+
+    // A single worker would only add hand-off overhead, so it's cheaper to
+    // decode inline. The same happens if no threads could be started at all.
+    ot_thread* workers = malloc(sizeof(ot_thread) * threads);
+    size_t started = 0;
+    if (threads > 1 && p.len > 1) {
+        while (started < threads &&
+               ot_thread_start(workers + started, decode_worker, &p)) {
+            ++started;
+        }
+    }
+
+    ot_err err = OT_ERR_NONE;
+    double consume_secs = 0;
+    size_t consumed = 0;
+    for (size_t i = 0; i < p.len; ++i) {
+        decode_slot slot = take_slot(&p, i, started > 0);
+        if (slot.err != OT_ERR_NONE) {
+            err = slot.err;
+            break;
+        }
+
+        double consume_start = ot_now();
+        err = sink(slot.op, arg);
+        consume_secs += ot_now() - consume_start;
+        if (err != OT_ERR_NONE) {
+            break;
+        }
+        ++consumed;
+    }
+
+    ot_mutex_lock(&p.lock);
+    p.stop = true;
+    ot_cond_broadcast(&p.claimable);
+    ot_mutex_unlock(&p.lock);
+    for (size_t i = 0; i < started; ++i) {
+        ot_thread_join(workers[i]);
+    }
+
+    // Free any ops that were decoded ahead of an error.
+    for (size_t i = 0; i < window; ++i) {
+        if (p.slots[i].ready && p.slots[i].op != NULL) {
+            ot_free_op(p.slots[i].op);
+        }
+    }
+
+    if (stats != NULL) {
+        size_t workers_used = (started > 0) ? started : 1;
+        stats->ops = consumed;
+        stats->bytes = strlen(json);
+        stats->threads = workers_used;
+        stats->parse_secs = parse_secs;
+        stats->decode_secs = p.decode_secs;
+        stats->consume_secs = consume_secs;
+        stats->total_secs = ot_now() - start;
+        stats->parse_bytes_per_sec = rate((double)stats->bytes, parse_secs);
+        stats->decode_ops_per_sec =
+            rate((double)consumed, p.decode_secs / (double)workers_used);
+        stats->consume_ops_per_sec = rate((double)consumed, consume_secs);
+    }
+
+    ot_cond_destroy(&p.ready);
+    ot_cond_destroy(&p.claimable);
+    ot_mutex_destroy(&p.lock);
+    free(workers);
+    free(p.slots);
+    free(p.items);
+    cJSON_Delete(root);
+    return err;
+}
+
+static ot_err append_sink(ot_op* op, void* arg) {
+    ot_err err = ot_doc_append((ot_doc*)arg, &op);
+    if (err != OT_ERR_NONE) {
+        ot_free_op(op);
+    }
+
+    return err;
+}
+
+ot_err ot_decode_doc_parallel(ot_doc* doc, const char* const json,
+                              const ot_decode_opts* opts,
+                              ot_decode_stats* stats) {
+    return ot_decode_each(json, opts, stats, append_sink, doc);
+}
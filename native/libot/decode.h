@@ -9,11 +9,146 @@
 #include "hex.h"
 #include "cjson/cJSON.h"
 #include "doc.h"
+#include "thread.h"
 
 // Decodes an operation from a UTF-8 JSON string.
 ot_err ot_decode(ot_op* op, const char* const json);
 
+// Decodes an operation from a UTF-8 JSON string that's tagged with the ID of
+// the document it belongs to. On success, *doc_id is set to a copy of the ID
+// which must be freed by the caller.
+ot_err ot_decode_tagged(ot_op* op, char** doc_id, const char* const json);
+
+// The fields of an encoded op that are needed to route it or reject it, which
+// point into the JSON they were decoded from.
+typedef struct ot_header {
+    uint32_t client_id;
+    char parent[20];
+    char hash[20];
+
+    // The docId field's contents without quotes, or NULL if there isn't one.
+    // It isn't NUL-terminated, and escape sequences are left as they are, in
+    // which case doc_id_escaped is set.
+    const char* doc_id;
+    size_t doc_id_len;
+    bool doc_id_escaped;
+
+    // The JSON the header was decoded from, and the components field's value
+    // within it.
+    const char* json;
+    const char* components;
+    size_t components_len;
+} ot_header;
+
+// Decodes the header fields of an op in a single scan of its top-level fields,
+// without parsing its components or allocating, so that a message can be
+// routed, deduplicated or rejected for a fraction of the cost of ot_decode. The
+// errors are the same as ot_decode's for missing fields, but the components
+// are only checked by ot_decode_body.
+ot_err ot_decode_header(ot_header* header, const char* const json);
+
+// Decodes the components of an op whose header was decoded with
+// ot_decode_header, along with the header fields. The JSON the header was
+// decoded from must still be valid.
+ot_err ot_decode_body(ot_op* op, const ot_header* header);
+
+// Decodes an acknowledgement created by ot_encode_ack, copying the hash of the
+// acknowledged op into hash. Returns OT_ERR_HASH_MISSING if json isn't an
+// acknowledgement. Other messages are rejected without being fully parsed, so
+// it's cheap to try this before ot_decode.
+ot_err ot_decode_ack(char* hash, const char* const json);
+
+// Decodes a request from a reconnecting client to be caught up from the last
+// server state it saw, created by ot_encode_resume. Returns
+// OT_ERR_HASH_MISSING if json isn't a resume request.
+//
+// Like acknowledgements, resume requests are told apart from ops by their
+// first field, so "resume" coming first (as ot_encode_resume writes it) is
+// part of the message format. A request with its fields in another order is
+// treated as something else.
+ot_err ot_decode_resume(char* hash, uint32_t* client_id,
+                        const char* const json);
+
+// One message in a catch-up: either an op to apply, or, when op is NULL, an
+// acknowledgement of one of the client's own ops with the given hash.
+typedef struct ot_catch_up_msg {
+    ot_op* op;
+    char ack[20];
+} ot_catch_up_msg;
+
+// What a reconnecting client needs to reach the server's current state.
+typedef struct ot_catch_up {
+    // ot_catch_up_msg items, in the order they must be handled.
+    array msgs;
+
+    // Hash of the server's state once every message has been handled.
+    char head[20];
+
+    // Set when the server no longer had the client's last state. The only
+    // message is then the whole document, which replaces the client's.
+    bool snapshot;
+} ot_catch_up;
+
+// Decodes a catch-up created by ot_encode_catch_up. Returns
+// OT_ERR_HASH_MISSING if json isn't a catch-up. On success, it must be freed
+// with ot_free_catch_up.
+ot_err ot_decode_catch_up(ot_catch_up* catch_up, const char* const json);
+
+void ot_free_catch_up(ot_catch_up* catch_up);
+
 // ot_decode_doc decodes a document from a UTF-8 JSON string.
 ot_err ot_decode_doc(ot_doc* doc, const char* const json);
 
+// Decodes a document encoded with ot_encode_doc_state into an empty document.
+// The stored parents, hashes and composed state are trusted instead of being
+// recomputed, so this must only be used for documents that were saved by the
+// server itself.
+ot_err ot_decode_doc_state(ot_doc* doc, const char* const json);
+
+// Options for the pipelined decoders. A zeroed struct selects the defaults.
+typedef struct ot_decode_opts {
+    // Number of worker threads that decode ops. 0 uses one per CPU.
+    size_t threads;
+
+    // Maximum number of decoded ops that may wait to be consumed. Workers stop
+    // claiming new ops once they get this far ahead of the consumer. 0 uses a
+    // default based on the number of threads.
+    size_t window;
+} ot_decode_opts;
+
+// Timings reported by the pipelined decoders. Time spent decoding is summed
+// across all workers, so decode_secs may exceed total_secs.
+typedef struct ot_decode_stats {
+    size_t ops;
+    size_t bytes;
+    size_t threads;
+    double parse_secs;
+    double decode_secs;
+    double consume_secs;
+    double total_secs;
+
+    // Throughput of each stage, computed from the timings above. The decode
+    // rate is for all workers combined.
+    double parse_bytes_per_sec;
+    double decode_ops_per_sec;
+    double consume_ops_per_sec;
+} ot_decode_stats;
+
+// Consumes an op produced by ot_decode_each. The consumer takes ownership of
+// op, even when it returns an error.
+typedef ot_err (*ot_decode_sink)(ot_op* op, void* arg);
+
+// ot_decode_each decodes a JSON array of operations, handing each one to sink
+// in array order. Ops are decoded in parallel by a pool of worker threads while
+// sink is only ever called from the calling thread. Decoding stops at the first
+// error from either a worker or sink. stats may be NULL.
+ot_err ot_decode_each(const char* const json, const ot_decode_opts* opts,
+                      ot_decode_stats* stats, ot_decode_sink sink, void* arg);
+
+// ot_decode_doc_parallel is equivalent to ot_decode_doc, except that ops are
+// decoded by ot_decode_each before being appended in order to doc.
+ot_err ot_decode_doc_parallel(ot_doc* doc, const char* const json,
+                              const ot_decode_opts* opts,
+                              ot_decode_stats* stats);
+
 #endif
@@ -0,0 +1,150 @@
+#include <stdlib.h>
+#include <string.h>
+#include "dedup.h"
+#include "sha1.h"
+
+void ot_dedup_init(ot_dedup* dedup, size_t cap) {
+    size_t buckets_len = 1;
+    while (buckets_len < cap) {
+        buckets_len *= 2;
+    }
+
+    dedup->entries = (cap > 0) ? malloc(sizeof(ot_dedup_entry) * cap) : NULL;
+    dedup->cap = cap;
+    dedup->head = 0;
+    dedup->len = 0;
+    dedup->buckets = (cap > 0) ? calloc(buckets_len, sizeof(uint32_t)) : NULL;
+    dedup->buckets_len = buckets_len;
+}
+
+void ot_dedup_free(ot_dedup* dedup) {
+    free(dedup->entries);
+    free(dedup->buckets);
+}
+
+void ot_dedup_clear(ot_dedup* dedup) {
+    dedup->head = 0;
+    dedup->len = 0;
+    if (dedup->buckets != NULL) {
+        memset(dedup->buckets, 0, sizeof(uint32_t) * dedup->buckets_len);
+    }
+}
+
+// Text is prefixed with its length so that adjacent components can't run
+// together.
+static void process_text(hash_state* md, const char* text) {
+    uint32_t len = (uint32_t)strlen(text);
+    char prefix[4];
+    STORE32H(len, prefix);
+    sha1_process(md, prefix, 4);
+    sha1_process(md, text, len);
+}
+
+static void process_count(hash_state* md, uint32_t count) {
+    char buf[4];
+    STORE32H(count, buf);
+    sha1_process(md, buf, 4);
+}
+
+static void process_fmts(hash_state* md, const array* fmts) {
+    const ot_fmt* data = fmts->data;
+    process_count(md, (uint32_t)fmts->len);
+    for (size_t i = 0; i < fmts->len; ++i) {
+        process_text(md, data[i].name);
+        process_text(md, data[i].value);
+    }
+}
+
+void ot_dedup_key(const ot_op* op, char* key) {
+    hash_state md;
+    sha1_init(&md);
+
+    process_count(&md, op->client_id);
+    sha1_process(&md, op->parent, 20);
+    sha1_process(&md, op->hash, 20);
+
+    const ot_comp* comps = op->comps.data;
+    for (size_t i = 0; i < op->comps.len; ++i) {
+        char type = (char)comps[i].type;
+        sha1_process(&md, &type, 1);
+        switch (comps[i].type) {
+        case OT_SKIP:
+            process_count(&md, comps[i].value.skip.count);
+            break;
+        case OT_INSERT:
+            process_text(&md, comps[i].value.insert.text);
+            break;
+        case OT_DELETE:
+            process_count(&md, comps[i].value.delete.count);
+            break;
+        case OT_OPEN_ELEMENT:
+            process_text(&md, comps[i].value.open_element.elem);
+            break;
+        case OT_CLOSE_ELEMENT:
+            break;
+        case OT_FORMATTING_BOUNDARY:
+            process_fmts(&md, &comps[i].value.fmtbound.start);
+            process_fmts(&md, &comps[i].value.fmtbound.end);
+            break;
+        }
+    }
+
+    sha1_done(&md, key);
+}
+
+static uint32_t* bucket(const ot_dedup* dedup, const char* key) {
+    uint32_t h;
+    memcpy(&h, key, sizeof(uint32_t));
+    return &dedup->buckets[h & (dedup->buckets_len - 1)];
+}
+
+bool ot_dedup_find(const ot_dedup* dedup, const char* key, size_t* index) {
+    if (dedup->cap == 0) {
+        return false;
+    }
+
+    uint32_t i = *bucket(dedup, key);
+    while (i != 0) {
+        const ot_dedup_entry* entry = &dedup->entries[i - 1];
+        if (memcmp(entry->key, key, 20) == 0) {
+            *index = entry->index;
+            return true;
+        }
+        i = entry->next;
+    }
+
+    return false;
+}
+
+// Unlinks the oldest entry from its bucket.
+static void evict(ot_dedup* dedup) {
+    ot_dedup_entry* oldest = &dedup->entries[dedup->head];
+    uint32_t* link = bucket(dedup, oldest->key);
+    while (*link != dedup->head + 1) {
+        link = &dedup->entries[*link - 1].next;
+    }
+    *link = oldest->next;
+
+    dedup->head = (dedup->head + 1) % dedup->cap;
+    --dedup->len;
+}
+
+void ot_dedup_add(ot_dedup* dedup, const char* key, size_t index) {
+    if (dedup->cap == 0) {
+        return;
+    }
+
+    if (dedup->len == dedup->cap) {
+        evict(dedup);
+    }
+
+    size_t slot = (dedup->head + dedup->len) % dedup->cap;
+    ot_dedup_entry* entry = &dedup->entries[slot];
+    memcpy(entry->key, key, 20);
+    entry->index = index;
+
+    uint32_t* head = bucket(dedup, key);
+    entry->next = *head;
+    *head = (uint32_t)slot + 1;
+    ++dedup->len;
+}
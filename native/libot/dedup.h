@@ -0,0 +1,61 @@
+#ifndef LIBOT_DEDUP_H
+#define LIBOT_DEDUP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ot.h"
+
+// Remembers the most recently appended ops so that a client retrying an op
+// (for example, after a timeout) can be acknowledged instead of having the op
+// transformed and appended a second time.
+//
+// Ops are keyed by a digest of the op as the client sent it, so a
+// retransmission has the same key no matter how the op was transformed when
+// it was appended. Clients only send one op per parent, so ops with the same
+// client, parent and contents are the same op. Only the last cap ops are
+// remembered, and lookups are O(1).
+typedef struct ot_dedup_entry {
+    char key[20];
+
+    // Position of the op in the document's history once it was appended. A
+    // position is known as soon as the op is appended, even when its hash is
+    // still being computed.
+    size_t index;
+
+    // Index + 1 of the next entry in the same bucket, or 0.
+    uint32_t next;
+} ot_dedup_entry;
+
+typedef struct ot_dedup {
+    // A ring of the cap most recent entries. The oldest is at head.
+    ot_dedup_entry* entries;
+    size_t cap;
+    size_t head;
+    size_t len;
+
+    // Index + 1 of the first entry in each bucket, or 0. There are a power of
+    // two buckets, at least as many as entries.
+    uint32_t* buckets;
+    size_t buckets_len;
+} ot_dedup;
+
+// Initializes a table that remembers cap ops. A cap of 0 disables the table.
+void ot_dedup_init(ot_dedup* dedup, size_t cap);
+
+void ot_dedup_free(ot_dedup* dedup);
+
+// Forgets every op.
+void ot_dedup_clear(ot_dedup* dedup);
+
+// Computes the key of an op as it was received.
+void ot_dedup_key(const ot_op* op, char* key);
+
+// Looks up the position that the op with the given key was appended at.
+// Returns false if it isn't remembered.
+bool ot_dedup_find(const ot_dedup* dedup, const char* key, size_t* index);
+
+// Remembers an appended op, forgetting the oldest one if the table is full.
+void ot_dedup_add(ot_dedup* dedup, const char* key, size_t index);
+
+#endif
@@ -1,4 +1,5 @@
 #include "doc.h"
+#include "hasher.h"
 
 ot_doc* ot_new_doc(void) {
     ot_doc* doc = malloc(sizeof(ot_doc));
@@ -6,10 +7,73 @@ ot_doc* ot_new_doc(void) {
     doc->composed = NULL;
     doc->size = 0;
     doc->max_size = 0;
+    doc->length = 0;
+    doc->hashed = 0;
+    doc->by_hash.buckets = NULL;
+    doc->by_hash.buckets_len = 0;
+    array_init(&doc->by_hash.next, sizeof(size_t));
+    array_init(&doc->keyframes, sizeof(ot_keyframe));
+    doc->keyframe_interval = 0;
+    doc->base = NULL;
+    doc->base_len = 0;
+    doc->refs = 1;
+    doc->composed_refs = NULL;
+    doc->composed_borrowed = false;
+    doc->bytes = sizeof(ot_doc);
+    doc->composed_bytes = 0;
+    doc->published = NULL;
+    ot_mutex_init(&doc->publish_lock);
     return doc;
 }
 
+// Returns the bytes held by an op that isn't stored in a history array.
+static size_t standalone_op_bytes(const ot_op* op) {
+    return sizeof(ot_op) + ot_op_bytes(op);
+}
+
+// Releases one reference to a shared composed state, freeing it along with its
+// count once there are none left.
+static void release_shared(ot_op* composed, uint32_t* refs) {
+    if (__atomic_sub_fetch(refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(refs);
+        ot_free_op(composed);
+    }
+}
+
+// Releases the document's reference to its composed state. When the document
+// has a single op of its own, the composed state is the first op in its
+// history, which will be freed along with the rest of the history.
+static void release_composed(ot_doc* doc) {
+    if (doc->composed == NULL) {
+        return;
+    }
+
+    if (doc->composed_borrowed) {
+        free(doc->composed);
+    } else if (doc->composed_refs != NULL) {
+        release_shared(doc->composed, doc->composed_refs);
+    } else if (doc->composed != (ot_op*)doc->history.data) {
+        ot_free_op(doc->composed);
+    }
+
+    doc->composed = NULL;
+    doc->composed_refs = NULL;
+    doc->composed_borrowed = false;
+    doc->bytes -= doc->composed_bytes;
+    doc->composed_bytes = 0;
+}
+
 void ot_free_doc(ot_doc* doc) {
+    if (--doc->refs > 0) {
+        return;
+    }
+
+    release_composed(doc);
+    if (doc->published != NULL) {
+        ot_doc_version_release(doc->published);
+    }
+    ot_mutex_destroy(&doc->publish_lock);
+
     // Free the components of every op in the document's history.
     ot_op* ops = doc->history.data;
     for (size_t i = 0; i < doc->history.len; ++i) {
@@ -24,61 +88,235 @@ void ot_free_doc(ot_doc* doc) {
     // Free the history array, which frees the all of ops.
     array_free(&doc->history);
 
-    // When the history length is less than 2, then the composed op is just
-    // pointing to the first op in the history (which has already been freed).
-    if (doc->history.len > 1) {
-        ot_free_op(doc->composed);
+    free(doc->by_hash.buckets);
+    array_free(&doc->by_hash.next);
+
+    ot_keyframe* keyframes = doc->keyframes.data;
+    for (size_t i = 0; i < doc->keyframes.len; ++i) {
+        free(keyframes[i].text);
+    }
+    array_free(&doc->keyframes);
+
+    if (doc->base != NULL) {
+        ot_free_doc(doc->base);
     }
 
     free(doc);
 }
 
-ot_err ot_doc_append(ot_doc* doc, ot_op** op) {
+ot_doc* ot_doc_fork(ot_doc* doc) {
+    ot_doc* fork = ot_new_doc();
+    fork->max_size = doc->max_size;
+    fork->keyframe_interval = doc->keyframe_interval;
+
+    size_t len = ot_doc_len(doc);
+    if (len == 0) {
+        return fork;
+    }
+
+    // A fork that hasn't diverged from its own base can share that base
+    // directly, which keeps chains of forks from growing.
+    ot_doc* base = doc;
+    while (base->history.len == 0 && base->base != NULL) {
+        base = base->base;
+    }
+    base->refs++;
+    fork->base = base;
+    fork->base_len = len;
+    fork->size = doc->size;
+    fork->length = doc->length;
+    fork->hashed = doc->hashed;
+
+    // If the composed state is the first op in a history, then it can't be
+    // shared by pointer since the history may be reallocated. Instead, the
+    // fork gets a shallow copy whose components stay owned by the history,
+    // which the fork keeps alive through its reference to base.
+    if (doc->composed_borrowed || doc->composed == (ot_op*)doc->history.data) {
+        fork->composed = malloc(sizeof(ot_op));
+        memcpy(fork->composed, doc->composed, sizeof(ot_op));
+        fork->composed_borrowed = true;
+        fork->composed_bytes = sizeof(ot_op);
+    } else {
+        if (doc->composed_refs == NULL) {
+            doc->composed_refs = malloc(sizeof(uint32_t));
+            *doc->composed_refs = 1;
+        }
+        __atomic_add_fetch(doc->composed_refs, 1, __ATOMIC_RELAXED);
+        fork->composed = doc->composed;
+        fork->composed_refs = doc->composed_refs;
+        fork->composed_bytes = doc->composed_bytes;
+    }
+    fork->bytes += fork->composed_bytes;
+
+    return fork;
+}
+
+size_t ot_doc_len(const ot_doc* doc) {
+    return doc->base_len + doc->history.len;
+}
+
+ot_op* ot_doc_op(const ot_doc* doc, size_t i) {
+    while (i < doc->base_len) {
+        doc = doc->base;
+    }
+
+    return (ot_op*)doc->history.data + (i - doc->base_len);
+}
+
+static char* copy_text(const char* text) {
+    size_t size = strlen(text) + 1;
+    char* copy = malloc(sizeof(char) * size);
+    memcpy(copy, text, size);
+    return copy;
+}
+
+// Returns true if a keyframe should be stored after the op at index.
+static bool wants_keyframe(const ot_doc* doc, size_t index) {
+    return doc->keyframe_interval > 0 &&
+           (index + 1) % doc->keyframe_interval == 0;
+}
+
+// Adds a keyframe that takes ownership of text.
+static void add_keyframe(ot_doc* doc, size_t index, char* text) {
+    size_t cap = doc->keyframes.cap;
+    ot_keyframe* keyframe = array_append(&doc->keyframes);
+    keyframe->index = index;
+    keyframe->text = text;
+
+    doc->bytes += (doc->keyframes.cap - cap) * sizeof(ot_keyframe);
+    doc->bytes += strlen(text) + 1;
+}
+
+static void store_keyframe(ot_doc* doc) {
+    size_t len = ot_doc_len(doc);
+    if (!wants_keyframe(doc, len - 1)) {
+        return;
+    }
+
+    // ot_snapshot returns NULL for an empty document, but keyframes always
+    // store a string to keep lookups simple.
+    char* text = ot_snapshot(doc->composed);
+    if (text == NULL) {
+        text = copy_text("");
+    }
+
+    add_keyframe(doc, len - 1, text);
+}
+
+// Returns the number of code points in a document's text after op is applied
+// to it.
+static uint32_t length_after(const ot_op* op) {
+    uint32_t length = 0;
+    const ot_comp* comps = op->comps.data;
+    for (size_t i = 0; i < op->comps.len; ++i) {
+        if (comps[i].type == OT_SKIP || comps[i].type == OT_INSERT) {
+            length += ot_comp_size(&comps[i]);
+        }
+    }
+
+    return length;
+}
+
+// Returns the bucket of the hash index that a hash falls in. Hashes are
+// already uniformly distributed, so their first bytes are used as is.
+static size_t* hash_bucket(const ot_hash_index* index, const char* hash) {
+    uint32_t h;
+    memcpy(&h, hash, sizeof(uint32_t));
+    return &index->buckets[h & (index->buckets_len - 1)];
+}
+
+// Doubles the number of buckets in the document's hash index and links every
+// indexed op into them again, oldest first.
+static void grow_hash_index(ot_doc* doc) {
+    ot_hash_index* index = &doc->by_hash;
+    size_t old_len = index->buckets_len;
+    size_t buckets_len = (old_len > 0) ? old_len * 2 : 16;
+    free(index->buckets);
+    index->buckets = calloc(buckets_len, sizeof(size_t));
+    index->buckets_len = buckets_len;
+    doc->bytes += (buckets_len - old_len) * sizeof(size_t);
+
+    const ot_op* ops = doc->history.data;
+    size_t* next = index->next.data;
+    for (size_t i = 0; i < index->next.len; ++i) {
+        size_t* head = hash_bucket(index, ops[i].hash);
+        next[i] = *head;
+        *head = i + 1;
+    }
+}
+
+// Adds the op at index in the document's history to its hash index once the
+// op's hash is known. Ops are indexed in the order they're hashed, which is
+// the order they were appended in.
+static void index_op(ot_doc* doc, size_t index) {
+    ot_hash_index* by_hash = &doc->by_hash;
+    size_t i = index - doc->base_len;
+
+    size_t cap = by_hash->next.cap;
+    size_t* next = array_append(&by_hash->next);
+    doc->bytes += (by_hash->next.cap - cap) * sizeof(size_t);
+    if (by_hash->next.len > by_hash->buckets_len) {
+        grow_hash_index(doc);
+        return;
+    }
+
+    const ot_op* op = (const ot_op*)doc->history.data + i;
+    size_t* head = hash_bucket(by_hash, op->hash);
+    *next = *head;
+    *head = i + 1;
+}
+
+// Appends op to the document. If hash is false, the op's hash is left zeroed
+// for the caller to set with ot_doc_set_hash.
+static ot_err append(ot_doc* doc, ot_op** op, bool hash) {
     if (doc->max_size > 0 && ot_size(*op) + doc->size > doc->max_size) {
         return OT_ERR_MAX_SIZE;
     }
 
     // Move the op into the document's history array.
+    size_t len = ot_doc_len(doc);
+    size_t cap = doc->history.cap;
     ot_op* head = array_append(&doc->history);
     memcpy(head, *op, sizeof(ot_op));
 
-    size_t len = doc->history.len;
-    if (len > 1) {
-        ot_op* history = (ot_op*)doc->history.data;
-        ot_op* prev = &history[len - 2];
+    // The history array keeps its capacity even if the append fails.
+    doc->bytes += (doc->history.cap - cap) * sizeof(ot_op);
+
+    if (len > 0) {
+        ot_op* prev = ot_doc_op(doc, len - 1);
         memcpy(head->parent, prev->hash, 20);
     } else {
         char zero[20] = { 0 };
         memcpy(head->parent, zero, 20);
     }
 
-    // If we're appending the first op, then the composed state will simply be
-    // the first op in the history. If we're appending the second op, then we
-    // must ensure that the composed op still points to the first op in the
-    // history in case its location changed after calling array_append (which
-    // may have reallocated the array to a different location in memory).
-    if (doc->history.len <= 2) {
-        doc->composed = (ot_op*)doc->history.data;
-    }
+    if (len == 0) {
+        // If we're appending the first op, then the composed state will simply
+        // be the first op in the history.
+        doc->composed = head;
+    } else {
+        // If we're appending the second op, then we must ensure that the
+        // composed op still points to the first op in the history in case its
+        // location changed after calling array_append (which may have
+        // reallocated the array to a different location in memory).
+        if (len == 1 && doc->base == NULL) {
+            doc->composed = (ot_op*)doc->history.data;
+        }
 
-    // If we're appending any op after the first, then we must compose the new
-    // op with the currently composed state to get the new composed state.
-    if (doc->history.len > 1) {
+        // Any op after the first must be composed with the currently composed
+        // state to get the new composed state.
         ot_op* new_composed = ot_compose(doc->composed, head);
         if (new_composed == NULL) {
             doc->history.len--;
             return OT_ERR_APPEND_FAILED;
         }
 
-        // Only free the previously composed op if this is at least the 2nd
-        // composition (aka 3rd op in the history). This is because the first
-        // composed op for a document points to the first op in the doc's
-        // history, and we don't want to free anything in the history.
-        if (doc->history.len > 2) {
-            ot_free_op(doc->composed);
-        }
+        release_composed(doc);
         doc->composed = new_composed;
+        doc->composed_bytes = standalone_op_bytes(new_composed);
+        doc->bytes += doc->composed_bytes;
     }
+    doc->bytes += ot_op_bytes(head);
 
     // Don't use ot_free_op because we only want to free the ot_op struct, not
     // its components. We must also only free op if the composition was a
@@ -88,16 +326,326 @@ ot_err ot_doc_append(ot_doc* doc, ot_op** op) {
 
     // The newly composed operation wil have the same hash as the appended op,
     // so we can get away with calculating the hash once and then copying it.
-    hash_op(doc->composed);
-    memcpy(head->hash, doc->composed->hash, 20);
+    if (hash) {
+        hash_op(doc->composed);
+        memcpy(head->hash, doc->composed->hash, 20);
+        index_op(doc, len);
+        ++doc->hashed;
+    } else {
+        memset(head->hash, 0, 20);
+        memset(doc->composed->hash, 0, 20);
+    }
+    doc->size = ot_size(doc->composed);
+    doc->length = length_after(head);
+    store_keyframe(doc);
+
+    return OT_ERR_NONE;
+}
+
+ot_err ot_doc_append(ot_doc* doc, ot_op** op) {
+    if (doc->hashed < ot_doc_len(doc)) {
+        return OT_ERR_APPEND_FAILED;
+    }
+
+    return append(doc, op, true);
+}
+
+// Returns true if op only has skips, inserts and deletes, so that it can be
+// applied to plain text.
+static bool is_text_op(const ot_op* op) {
+    const ot_comp* comps = op->comps.data;
+    for (size_t i = 0; i < op->comps.len; ++i) {
+        ot_comp_type t = comps[i].type;
+        if (t != OT_SKIP && t != OT_INSERT && t != OT_DELETE) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+ot_err ot_doc_append_unhashed(ot_doc* doc, ot_op** op, char** text) {
+    ot_err err = append(doc, op, false);
+    if (err != OT_ERR_NONE) {
+        return err;
+    }
+
+    *text = NULL;
+    if (!is_text_op(*op)) {
+        *text = ot_snapshot(doc->composed);
+        if (*text == NULL) {
+            *text = copy_text("");
+        }
+    }
+
+    return OT_ERR_NONE;
+}
+
+void ot_doc_restore(ot_doc* doc, ot_op** ops, size_t len, ot_op* composed) {
+    if (len == 0) {
+        if (composed != NULL) {
+            ot_free_op(composed);
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        size_t cap = doc->history.cap;
+        ot_op* head = array_append(&doc->history);
+        memcpy(head, ops[i], sizeof(ot_op));
+        doc->bytes += (doc->history.cap - cap) * sizeof(ot_op);
+        doc->bytes += ot_op_bytes(head);
+        free(ops[i]);
+    }
+    for (size_t i = 0; i < len; ++i) {
+        ops[i] = ot_doc_op(doc, i);
+    }
+
+    // A single op is its own composed state, as it is after ot_doc_append.
+    if (len == 1) {
+        ot_free_op(composed);
+        doc->composed = (ot_op*)doc->history.data;
+    } else {
+        doc->composed = composed;
+        doc->composed_bytes = standalone_op_bytes(composed);
+        doc->bytes += doc->composed_bytes;
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        index_op(doc, i);
+    }
+
     doc->size = ot_size(doc->composed);
+    doc->length = length_after(ops[len - 1]);
+    doc->hashed = len;
+}
+
+void ot_doc_restore_keyframe(ot_doc* doc, size_t index, const char* text) {
+    add_keyframe(doc, index, copy_text(text));
+}
+
+void ot_doc_set_hash(ot_doc* doc, size_t index, const char* hash) {
+    size_t len = ot_doc_len(doc);
+    memcpy(ot_doc_op(doc, index)->hash, hash, 20);
+    if (index + 1 < len) {
+        memcpy(ot_doc_op(doc, index + 1)->parent, hash, 20);
+    } else {
+        memcpy(doc->composed->hash, hash, 20);
+    }
+
+    if (index == doc->hashed) {
+        index_op(doc, index);
+        ++doc->hashed;
+    }
+}
+
+// Computes the parent and hash of every op in a batch that's about to be
+// appended, starting from the document's current state. The text after each op
+// that needs a keyframe is stored in keyframes[i]. Returns false if the hashes
+// couldn't be computed by applying the ops to text, in which case nothing is
+// stored in keyframes.
+//
+// The ops are applied to a single copy of the text, which only rehashes the
+// text from each op's first change onwards.
+static bool hash_batch_text(const ot_doc* doc, ot_op** ops, size_t len,
+                            char** keyframes) {
+    char* text = ot_snapshot(doc->composed);
+    ot_hasher hasher;
+    ot_hasher_init(&hasher, text);
+    free(text);
+
+    size_t start = ot_doc_len(doc);
+    for (size_t i = 0; i < len; ++i) {
+        if (!ot_hasher_apply(&hasher, ops[i], ops[i]->hash)) {
+            for (size_t j = 0; j < i; ++j) {
+                free(keyframes[j]);
+                keyframes[j] = NULL;
+            }
+            ot_hasher_free(&hasher);
+            return false;
+        }
+
+        if (wants_keyframe(doc, start + i)) {
+            keyframes[i] = copy_text(hasher.text);
+        }
+    }
+
+    ot_hasher_free(&hasher);
+    return true;
+}
+
+// Computes the hash of every op in a batch by composing them one at a time.
+// This is only used for ops that can't be applied to plain text.
+static bool hash_batch_composed(const ot_doc* doc, ot_op** ops, size_t len,
+                                char** keyframes) {
+    ot_op* state = ot_dup_op(doc->composed);
+    size_t start = ot_doc_len(doc);
+    for (size_t i = 0; i < len && state != NULL; ++i) {
+        ot_op* next = ot_compose(state, ops[i]);
+        ot_free_op(state);
+        state = next;
+        if (state == NULL) {
+            break;
+        }
+
+        hash_op(state);
+        memcpy(ops[i]->hash, state->hash, 20);
+        if (wants_keyframe(doc, start + i)) {
+            keyframes[i] = ot_snapshot(state);
+            if (keyframes[i] == NULL) {
+                keyframes[i] = copy_text("");
+            }
+        }
+    }
+
+    if (state == NULL) {
+        for (size_t i = 0; i < len; ++i) {
+            free(keyframes[i]);
+            keyframes[i] = NULL;
+        }
+        return false;
+    }
+
+    ot_free_op(state);
+    return true;
+}
+
+ot_err ot_doc_append_batch(ot_doc* doc, ot_op** ops, size_t len) {
+    if (len == 0) {
+        return OT_ERR_NONE;
+    }
+
+    // Every op needs a parent, so the document's latest hash has to be known.
+    if (doc->hashed < ot_doc_len(doc)) {
+        return OT_ERR_APPEND_FAILED;
+    }
+
+    // The first op of a document becomes its composed state, so there's
+    // nothing to batch it with.
+    if (ot_doc_len(doc) == 0) {
+        ot_err err = ot_doc_append(doc, ops);
+        if (err != OT_ERR_NONE) {
+            return err;
+        }
+        return ot_doc_append_batch(doc, ops + 1, len - 1);
+    }
+
+    uint32_t size = doc->size;
+    for (size_t i = 0; i < len; ++i) {
+        if (doc->max_size > 0 && ot_size(ops[i]) + size > doc->max_size) {
+            return OT_ERR_MAX_SIZE;
+        }
+        size += ot_size(ops[i]);
+    }
+
+    // Compose the batch by itself first, since its ops are small compared to
+    // the document. Then the document only has to be composed once.
+    ot_op* batch = ot_dup_op(ops[0]);
+    for (size_t i = 1; i < len && batch != NULL; ++i) {
+        ot_op* temp = ot_compose(batch, ops[i]);
+        ot_free_op(batch);
+        batch = temp;
+    }
+    if (batch == NULL) {
+        return OT_ERR_APPEND_FAILED;
+    }
+
+    ot_op* new_composed = ot_compose(doc->composed, batch);
+    ot_free_op(batch);
+    if (new_composed == NULL) {
+        return OT_ERR_APPEND_FAILED;
+    }
+
+    char** keyframes = calloc(len, sizeof(char*));
+    if (!hash_batch_text(doc, ops, len, keyframes) &&
+        !hash_batch_composed(doc, ops, len, keyframes)) {
+        free(keyframes);
+        ot_free_op(new_composed);
+        return OT_ERR_APPEND_FAILED;
+    }
+
+    const char* parent = ot_doc_last(doc)->hash;
+    for (size_t i = 0; i < len; ++i) {
+        memcpy(ops[i]->parent, parent, 20);
+        parent = ops[i]->hash;
+    }
+
+    // Nothing can fail from here on, so the ops can be moved into the history.
+    // The composed state must be released first since it may point into the
+    // history array, which may be reallocated.
+    release_composed(doc);
+    size_t start = ot_doc_len(doc);
+    for (size_t i = 0; i < len; ++i) {
+        size_t cap = doc->history.cap;
+        ot_op* head = array_append(&doc->history);
+        memcpy(head, ops[i], sizeof(ot_op));
+        doc->bytes += (doc->history.cap - cap) * sizeof(ot_op);
+        doc->bytes += ot_op_bytes(head);
+
+        free(ops[i]);
+        ops[i] = head;
+    }
+
+    // Earlier ops in the array may have moved if it was reallocated.
+    for (size_t i = 0; i < len; ++i) {
+        ops[i] = ot_doc_op(doc, start + i);
+        index_op(doc, start + i);
+        if (keyframes[i] != NULL) {
+            add_keyframe(doc, start + i, keyframes[i]);
+        }
+    }
+    free(keyframes);
+
+    doc->composed = new_composed;
+    doc->composed_bytes = standalone_op_bytes(new_composed);
+    doc->bytes += doc->composed_bytes;
+    memcpy(new_composed->hash, ops[len - 1]->hash, 20);
+    doc->size = ot_size(new_composed);
+    doc->length = length_after(ops[len - 1]);
+    doc->hashed += len;
 
     return OT_ERR_NONE;
 }
 
+// Returns the index of the op with the given hash, or the length of the
+// document's history if there isn't one.
+static size_t find_op(const ot_doc* doc, const char* hash) {
+    size_t len = ot_doc_len(doc);
+
+    // Each document only indexes its own ops, so the lookup falls back to the
+    // base for the shared ones. The base may have had more ops appended since
+    // the fork, so only its ops before the fork point count.
+    size_t limit = len;
+    while (doc != NULL && limit > 0) {
+        const ot_hash_index* index = &doc->by_hash;
+        if (index->buckets_len > 0 && limit > doc->base_len) {
+            const ot_op* ops = doc->history.data;
+            const size_t* next = index->next.data;
+            size_t i = *hash_bucket(index, hash);
+            while (i != 0) {
+                size_t pos = doc->base_len + i - 1;
+                if (pos < limit &&
+                    memcmp(ops[i - 1].hash, hash, sizeof(char) * 20) == 0) {
+                    return pos;
+                }
+                i = next[i - 1];
+            }
+        }
+
+        limit = (doc->base_len < limit) ? doc->base_len : limit;
+        doc = doc->base;
+    }
+
+    return len;
+}
+
+size_t ot_doc_find(const ot_doc* doc, const char* hash) {
+    return find_op(doc, hash);
+}
+
 ot_op* ot_doc_compose_after(const ot_doc* doc, const char* after) {
-    array history = doc->history;
-    if (history.len == 0) {
+    size_t len = ot_doc_len(doc);
+    if (len == 0) {
         return NULL;
     }
 
@@ -109,28 +657,21 @@ ot_op* ot_doc_compose_after(const ot_doc* doc, const char* after) {
         }
     }
 
-    bool found = false;
     size_t start = 0;
-    ot_op* ops = (ot_op*)history.data;
     if (!after_null) {
-        for (size_t i = history.len - 1; i < history.len; --i) {
-            ot_op* op = ops + i;
-            if (memcmp(op->hash, after, sizeof(char) * 20) == 0) {
-                start = i + 1;
-                found = true;
-                break;
-            }
-        }
+        start = find_op(doc, after) + 1;
 
-        if (!found) {
+        // Either the op wasn't found or it's the most recent op, in which case
+        // there's nothing to compose.
+        if (start >= len) {
             return NULL;
         }
     }
 
-    ot_op* composed = ot_dup_op(ops + start);
+    ot_op* composed = ot_dup_op(ot_doc_op(doc, start));
     ot_op* temp;
-    for (size_t i = start + 1; i < history.len; ++i) {
-        temp = ot_compose(composed, ops + i);
+    for (size_t i = start + 1; i < len; ++i) {
+        temp = ot_compose(composed, ot_doc_op(doc, i));
         ot_free_op(composed);
         composed = temp;
         if (composed == NULL) {
@@ -141,8 +682,151 @@ ot_op* ot_doc_compose_after(const ot_doc* doc, const char* after) {
     return composed;
 }
 
+void ot_doc_set_keyframe_interval(ot_doc* doc, size_t interval) {
+    doc->keyframe_interval = interval;
+}
+
+// Returns the last keyframe at or before index, or NULL if there isn't one.
+// Keyframes are appended in history order, so they can be binary searched. A
+// fork's own keyframes all come after its base's, so the base is only searched
+// when the fork doesn't have a match.
+static const ot_keyframe* find_keyframe(const ot_doc* doc, size_t index) {
+    const ot_keyframe* keyframes = doc->keyframes.data;
+    size_t lo = 0;
+    size_t hi = doc->keyframes.len;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (keyframes[mid].index <= index) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo > 0) {
+        return keyframes + lo - 1;
+    }
+
+    if (doc->base != NULL) {
+        size_t last = doc->base_len - 1;
+        return find_keyframe(doc->base, (index < last) ? index : last);
+    }
+
+    return NULL;
+}
+
+char* ot_doc_snapshot_at(const ot_doc* doc, const char* hash) {
+    size_t index = find_op(doc, hash);
+    if (index == ot_doc_len(doc)) {
+        return NULL;
+    }
+
+    const ot_keyframe* keyframe = find_keyframe(doc, index);
+    if (keyframe != NULL && keyframe->index == index) {
+        return copy_text(keyframe->text);
+    }
+
+    size_t start;
+    ot_op* composed;
+    if (keyframe != NULL) {
+        composed = ot_new_op();
+        if (keyframe->text[0] != '\0') {
+            ot_insert(composed, keyframe->text);
+        }
+        start = keyframe->index + 1;
+    } else {
+        composed = ot_dup_op(ot_doc_op(doc, 0));
+        start = 1;
+    }
+
+    for (size_t i = start; i <= index && composed != NULL; ++i) {
+        ot_op* temp = ot_compose(composed, ot_doc_op(doc, i));
+        ot_free_op(composed);
+        composed = temp;
+    }
+
+    if (composed == NULL) {
+        return NULL;
+    }
+
+    char* snapshot = ot_snapshot(composed);
+    ot_free_op(composed);
+    if (snapshot == NULL) {
+        snapshot = copy_text("");
+    }
+
+    return snapshot;
+}
+
+size_t ot_doc_bytes(const ot_doc* doc) { return doc->bytes; }
+
+bool ot_doc_publish(ot_doc* doc) {
+    size_t len = ot_doc_len(doc);
+    if (len == 0 || doc->hashed < len) {
+        return false;
+    }
+    if (doc->published != NULL && doc->published->len == len) {
+        return true;
+    }
+
+    ot_doc_version* version = malloc(sizeof(ot_doc_version));
+    memcpy(version->hash, doc->composed->hash, 20);
+    version->len = len;
+    version->size = doc->size;
+    version->length = doc->length;
+    version->refs = 1;
+
+    // A composed state that's the first op in a history (or a shallow copy
+    // of one) lives in an array that may be reallocated, so it can't be
+    // shared by pointer.
+    if (doc->composed_borrowed || doc->composed == (ot_op*)doc->history.data) {
+        version->composed = ot_dup_op(doc->composed);
+        version->composed_refs = malloc(sizeof(uint32_t));
+        *version->composed_refs = 1;
+    } else {
+        if (doc->composed_refs == NULL) {
+            doc->composed_refs = malloc(sizeof(uint32_t));
+            *doc->composed_refs = 1;
+        }
+        __atomic_add_fetch(doc->composed_refs, 1, __ATOMIC_RELAXED);
+        version->composed = doc->composed;
+        version->composed_refs = doc->composed_refs;
+    }
+
+    ot_mutex_lock(&doc->publish_lock);
+    ot_doc_version* prev = doc->published;
+    doc->published = version;
+    ot_mutex_unlock(&doc->publish_lock);
+
+    if (prev != NULL) {
+        ot_doc_version_release(prev);
+    }
+
+    return true;
+}
+
+ot_doc_version* ot_doc_acquire(ot_doc* doc) {
+    // The reference has to be taken before the lock is released, otherwise
+    // the publisher could release the last one in between.
+    ot_mutex_lock(&doc->publish_lock);
+    ot_doc_version* version = doc->published;
+    if (version != NULL) {
+        __atomic_add_fetch(&version->refs, 1, __ATOMIC_RELAXED);
+    }
+    ot_mutex_unlock(&doc->publish_lock);
+
+    return version;
+}
+
+void ot_doc_version_release(ot_doc_version* version) {
+    if (__atomic_sub_fetch(&version->refs, 1, __ATOMIC_ACQ_REL) > 0) {
+        return;
+    }
+
+    release_shared(version->composed, version->composed_refs);
+    free(version);
+}
+
 ot_op* ot_doc_last(const ot_doc* doc) {
-    size_t i = doc->history.len - 1;
-    ot_op* history = (ot_op*)doc->history.data;
-    return history + i;
+    return ot_doc_op(doc, ot_doc_len(doc) - 1);
 }
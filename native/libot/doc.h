@@ -1,12 +1,56 @@
 #ifndef LIBOT_DOC_H
 #define LIBOT_DOC_H
 
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include "array.h"
 #include "compose.h"
 #include "sha1.h"
 #include "ot.h"
+#include "thread.h"
+#include "utf8.h"
+
+// A copy of a document's text after the op at "index" in its history was
+// applied.
+typedef struct ot_keyframe {
+    size_t index;
+    char* text;
+} ot_keyframe;
+
+// Finds the ops in a document's own history by hash in O(1). Each bucket holds
+// the position + 1 of the newest op whose hash falls in it, or 0, and next
+// holds the position + 1 of the next older op in the same bucket, so the
+// newest op with a given hash is found first. Positions count from the start
+// of the document's own history, not including ops shared with its base. Only
+// ops whose hashes are known are indexed. There are a power of two buckets, at
+// least as many as indexed ops.
+typedef struct ot_hash_index {
+    size_t* buckets;
+    size_t buckets_len;
+    array next;
+} ot_hash_index;
+
+// An immutable view of a document's composed state, published with
+// ot_doc_publish so that other threads can read it while more ops are
+// appended. Nothing in a version changes after it's published, and it stays
+// valid until every reference to it has been released, even if the document
+// has moved on or been freed in the meantime.
+typedef struct ot_doc_version {
+    // The composition of the first len ops in the document's history, which
+    // must not be modified. Its text can be read with ot_snapshot.
+    ot_op* composed;
+    char hash[20];
+    size_t len;
+    uint32_t size;
+    uint32_t length;
+
+    // The composed state is shared with the document (and its forks) while
+    // they use it, and composed_refs counts the holders. refs counts the
+    // references to the version itself. Both are counted atomically.
+    uint32_t* composed_refs;
+    uint32_t refs;
+} ot_doc_version;
 
 // Implements an OT document, which is effectively an array of composable
 // operations.
@@ -15,26 +59,187 @@ typedef struct ot_doc {
     ot_op* composed;
     uint32_t size;
     uint32_t max_size;
+
+    // Number of code points in the document's text, which every op appended
+    // to the latest state has to span.
+    uint32_t length;
+
+    // Number of ops at the start of the history whose hashes are known. It's
+    // only behind the length of the history while ops appended with
+    // ot_doc_append_unhashed are waiting for ot_doc_set_hash.
+    size_t hashed;
+
+    // Looks up ops by hash, so that finding an op doesn't scan the history.
+    ot_hash_index by_hash;
+
+    // Keyframes are stored every keyframe_interval ops so that historical
+    // snapshots don't have to be replayed from the beginning of the history.
+    // An interval of 0 disables keyframes.
+    array keyframes;
+    size_t keyframe_interval;
+
+    // A forked document shares a prefix of its base document's history. The
+    // first base_len ops belong to base, and only the ops appended after the
+    // fork are stored in history. base is NULL if the document isn't a fork.
+    struct ot_doc* base;
+    size_t base_len;
+
+    // Number of references to the document: one for its owner and one for
+    // every fork sharing its history. The document is only freed once all of
+    // them have been released with ot_free_doc.
+    uint32_t refs;
+
+    // When composed is shared with other documents or published versions,
+    // composed_refs counts how many of them still use it. It's NULL if
+    // composed isn't shared. Versions are released from other threads, so the
+    // count is changed atomically.
+    uint32_t* composed_refs;
+
+    // Set when composed is a shallow copy of the first op in the base
+    // document's history, meaning that its components belong to base.
+    bool composed_borrowed;
+
+    // Running count of the heap bytes held by the document. See ot_doc_bytes.
+    size_t bytes;
+
+    // Bytes held by the composed state when it isn't part of the history.
+    size_t composed_bytes;
+
+    // The latest version published with ot_doc_publish, or NULL. The lock is
+    // only held while the pointer is swapped or a reader takes a reference,
+    // never while appending.
+    ot_doc_version* published;
+    ot_mutex publish_lock;
 } ot_doc;
 
 // Creates and returns a new document. It must be freed by the caller using
 // ot_free_doc.
 ot_doc* ot_new_doc(void);
 
-// Frees a document that was created with ot_new_doc.
+// Frees a document that was created with ot_new_doc or ot_doc_fork. If the
+// document still has forks, then its memory is kept until they're freed too.
 void ot_free_doc(ot_doc* doc);
 
+// Creates a copy-on-write fork of a document. The fork shares doc's history
+// and composed state, so it's created in constant time and memory. Ops can be
+// appended to both documents independently afterwards, and only the ops that
+// were appended after the fork are stored separately. The fork must be freed
+// with ot_free_doc.
+ot_doc* ot_doc_fork(ot_doc* doc);
+
+// Returns the number of ops in the document's history, including the ops that
+// are shared with a base document.
+size_t ot_doc_len(const ot_doc* doc);
+
+// Returns the op at index i in the document's history. Ops that are shared with
+// a base document must not be modified.
+ot_op* ot_doc_op(const ot_doc* doc, size_t i);
+
 // Appends an operation to a document. The operation must be composable with the
 // current state of the document. Once an operation has been appended to a
 // document, it is moved into the document's history and op is updated to point
 // to its new location.
 ot_err ot_doc_append(ot_doc* doc, ot_op** op);
 
+// Appends an operation like ot_doc_append, except that its hash isn't computed.
+// Hashing reads the whole document's text, so this lets it be done elsewhere
+// (e.g., on another thread) while more ops are appended. The op's position in
+// the history is known straight away.
+//
+// On success, *text is set to NULL if the op only has skips, inserts and
+// deletes, in which case its hash is computed by applying it to the text before
+// it with an ot_hasher. Otherwise, *text is set to the text after the op, which
+// its hash must be computed from with hash_text and which the caller must
+// free.
+//
+// Until their hashes are set, unhashed ops can't be found by hash, and their
+// hash and the parent of the op after them are zeroed. ot_doc_append and
+// ot_doc_append_batch fail while any op is unhashed, and a document with
+// unhashed ops must not be forked.
+ot_err ot_doc_append_unhashed(ot_doc* doc, ot_op** op, char** text);
+
+// Moves a saved history into an empty document, along with composed, the
+// composition of every op in it. Nothing is composed or hashed, so the ops'
+// parents and hashes are kept as they are. The document takes ownership of the
+// ops and of composed, and ops is updated the same way as in ot_doc_append.
+void ot_doc_restore(ot_doc* doc, ot_op** ops, size_t len, ot_op* composed);
+
+// Adds a saved keyframe, the text after the op at index, to a restored
+// document. Keyframes must be restored in order, after ot_doc_restore.
+void ot_doc_restore_keyframe(ot_doc* doc, size_t index, const char* text);
+
+// Sets the hash of the unhashed op at index, which must be the oldest one that
+// doesn't have its hash yet.
+void ot_doc_set_hash(ot_doc* doc, size_t index, const char* hash);
+
+// Appends a sequence of operations to a document, where each operation must be
+// composable with the state after the one before it. This gives the same
+// result as appending the operations one at a time, but the document's
+// composed state is only updated once. Each operation's hash is computed by
+// applying it to the document's text instead of from a composed state. If any
+// operation can't be appended, then none of them are, except that the first
+// operation of an empty document is appended on its own beforehand and stays
+// appended. On success, each element of ops is updated to point to the
+// operation's location in the history.
+ot_err ot_doc_append_batch(ot_doc* doc, ot_op** ops, size_t len);
+
 // Composes a half-closed range of operations in the document's history. That
 // is, every operation after (but not including) "after" is composed with every
 // operation up to and including the most recent operation (after, latest].
 ot_op* ot_doc_compose_after(const ot_doc* doc, const char* after);
 
+// Returns the index of the most recent op in the document's history with the
+// given hash, or the length of the history if there isn't one. Lookups take
+// O(1) time on average, plus O(1) for every fork between the document and the
+// document that the op was appended to.
+size_t ot_doc_find(const ot_doc* doc, const char* hash);
+
+// Sets how often a keyframe of the document's text is stored. Every keyframe
+// holds a full copy of the text, so smaller intervals use more memory in
+// exchange for faster calls to ot_doc_snapshot_at. Setting the interval to 0
+// stops new keyframes from being stored. Existing keyframes are kept.
+void ot_doc_set_keyframe_interval(ot_doc* doc, size_t interval);
+
+// Returns the text of the document as it was after the op with the given hash
+// was applied. The op is found through the document's hash index, and the
+// snapshot is rebuilt from the closest keyframe at or before that op, so at
+// most keyframe_interval ops are composed. Returns NULL if the
+// hash isn't in the document's history. The returned string must be freed by
+// the caller.
+char* ot_doc_snapshot_at(const ot_doc* doc, const char* hash);
+
+// Returns the number of heap bytes held by the document: its own history, its
+// composed state, its hash index and its keyframes. The count is maintained as the document
+// changes, so this doesn't walk any structures.
+//
+// The composed state is counted in full even when it's shared with forks, since
+// it can't be freed while the document references it. The history shared with
+// a base document is only counted by the base.
+size_t ot_doc_bytes(const ot_doc* doc);
+
+// Publishes the document's current composed state and hash as a new version
+// for ot_doc_acquire to return, and releases the document's reference to the
+// previous one. This must be called from the thread that appends to the
+// document. The composed state is replaced rather than modified when an op is
+// appended, so the version shares it instead of copying it, except when the
+// composed state is the first op in a history, which is copied. Returns false
+// if the document is empty or an op is still waiting for its hash, in which
+// case the previous version stays published. Publishing again before anything
+// is appended does nothing.
+//
+// Versions that are no longer current aren't counted by ot_doc_bytes.
+bool ot_doc_publish(ot_doc* doc);
+
+// Returns a reference to the latest published version, or NULL if nothing has
+// been published. This can be called from any thread, including while ops are
+// being appended, and never waits for an append. The reference must be
+// released with ot_doc_version_release.
+ot_doc_version* ot_doc_acquire(ot_doc* doc);
+
+// Releases a reference to a version, freeing it once there are none left.
+// This can be called from any thread.
+void ot_doc_version_release(ot_doc_version* version);
+
 // ot_doc_last returns the last op (which is also the most recent op) in the
 // document's history.
 ot_op* ot_doc_last(const ot_doc* doc);
@@ -59,12 +59,133 @@ char* ot_encode(const ot_op* const op) {
     return enc;
 }
 
+ot_msg* ot_encode_msg(const ot_op* const op) {
+    char* enc = ot_encode(op);
+    if (enc == NULL) {
+        return NULL;
+    }
+
+    return ot_new_msg(enc);
+}
+
+char* ot_encode_tagged(const ot_op* const op, const char* doc_id) {
+    cJSON* cjson = cjson_op(op);
+    cJSON_AddStringToObject(cjson, "docId", doc_id);
+    char* enc = cJSON_PrintUnformatted(cjson);
+    cJSON_Delete(cjson);
+
+    return enc;
+}
+
 char* ot_encode_doc(const ot_doc* const doc) {
     cJSON* root = cJSON_CreateArray();
 
-    ot_op* history = (ot_op*)doc->history.data;
-    for (size_t i = 0; i < doc->history.len; ++i) {
-        cJSON_AddItemToArray(root, cjson_op(history + i));
+    size_t len = ot_doc_len(doc);
+    for (size_t i = 0; i < len; ++i) {
+        cJSON_AddItemToArray(root, cjson_op(ot_doc_op(doc, i)));
+    }
+
+    char* enc = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+
+    return enc;
+}
+
+// Adds the keyframes of doc's first limit ops to keyframes, oldest first. A
+// fork's earlier keyframes belong to its base.
+static void add_keyframes(cJSON* keyframes, const ot_doc* doc, size_t limit) {
+    if (doc->base != NULL) {
+        add_keyframes(keyframes, doc->base,
+                      (limit < doc->base_len) ? limit : doc->base_len);
+    }
+
+    const ot_keyframe* own = doc->keyframes.data;
+    for (size_t i = 0; i < doc->keyframes.len && own[i].index < limit; ++i) {
+        cJSON* keyframe = cJSON_CreateObject();
+        cJSON_AddNumberToObject(keyframe, "index", (double)own[i].index);
+        cJSON_AddStringToObject(keyframe, "text", own[i].text);
+        cJSON_AddItemToArray(keyframes, keyframe);
+    }
+}
+
+char* ot_encode_doc_state(const ot_doc* const doc) {
+    cJSON* history = cJSON_CreateArray();
+    size_t len = ot_doc_len(doc);
+    for (size_t i = 0; i < len; ++i) {
+        cJSON_AddItemToArray(history, cjson_op(ot_doc_op(doc, i)));
+    }
+
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddItemToObject(root, "history", history);
+    cJSON_AddNumberToObject(root, "maxSize", doc->max_size);
+    cJSON_AddNumberToObject(root, "keyframeInterval",
+                            (double)doc->keyframe_interval);
+    if (doc->composed != NULL) {
+        cJSON_AddItemToObject(root, "composed", cjson_op(doc->composed));
+    }
+    cJSON* keyframes = cJSON_CreateArray();
+    add_keyframes(keyframes, doc, len);
+    cJSON_AddItemToObject(root, "keyframes", keyframes);
+
+    char* enc = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+
+    return enc;
+}
+
+char* ot_encode_ack(const char* hash) {
+    char hex[41] = { 0 };
+    atohex(hex, hash, 20);
+
+    // An ack is a fixed size, so it's formatted directly instead of being
+    // built with cJSON.
+    size_t size = sizeof("{\"ack\":\"\"}") + 40;
+    char* enc = malloc(size);
+    snprintf(enc, size, "{\"ack\":\"%s\"}", hex);
+
+    return enc;
+}
+
+char* ot_encode_resume(const char* hash, uint32_t client_id) {
+    char hex[41] = { 0 };
+    atohex(hex, hash, 20);
+
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "resume", hex);
+    cJSON_AddNumberToObject(root, "clientId", client_id);
+
+    char* enc = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+
+    return enc;
+}
+
+char* ot_encode_catch_up(const ot_op* const* ops, size_t len,
+                         uint32_t client_id, const char* head, bool snapshot) {
+    cJSON* msgs = cJSON_CreateArray();
+    for (size_t i = 0; i < len; ++i) {
+        if (snapshot || ops[i]->client_id != client_id) {
+            cJSON_AddItemToArray(msgs, cjson_op(ops[i]));
+            continue;
+        }
+
+        char hash[41] = { 0 };
+        atohex(hash, ops[i]->hash, 20);
+        cJSON* ack = cJSON_CreateObject();
+        cJSON_AddStringToObject(ack, "ack", hash);
+        cJSON_AddItemToArray(msgs, ack);
+    }
+
+    char hex[41] = { 0 };
+    atohex(hex, head, 20);
+
+    // catchUp comes first so that clients can recognize the message without
+    // parsing it.
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddItemToObject(root, "catchUp", msgs);
+    cJSON_AddStringToObject(root, "head", hex);
+    if (snapshot) {
+        cJSON_AddTrueToObject(root, "snapshot");
     }
 
     char* enc = cJSON_PrintUnformatted(root);
@@ -4,14 +4,44 @@
 #include <inttypes.h>
 #include "ot.h"
 #include "doc.h"
+#include "msg.h"
 #include "cjson/cJSON.h"
 
 // Encodes an operation as a UTF-8 JSON string.
 char* ot_encode(const ot_op* const op);
 
+// Encodes an operation as a shared message with one reference, so that it can
+// be sent to many recipients without being encoded or copied again. Returns
+// NULL if the operation couldn't be encoded.
+ot_msg* ot_encode_msg(const ot_op* const op);
+
+// Encodes an operation as a UTF-8 JSON string with a "docId" field identifying
+// the document it belongs to.
+char* ot_encode_tagged(const ot_op* const op, const char* doc_id);
+
 // ot_doc_encode encodes a document as a UTF-8 JSON string.
 char* ot_encode_doc(const ot_doc* const doc);
 
+// Encodes a document's history along with its composed state and settings, so
+// that it can be restored with ot_decode_doc_state without replaying the
+// history. Keyframes are stored too, so historical snapshots of a restored
+// document don't have to be replayed from the beginning.
+char* ot_encode_doc_state(const ot_doc* const doc);
+
+// Encodes an acknowledgement of the op with the given hash, which is sent to
+// the client that sent the op instead of the whole op.
+char* ot_encode_ack(const char* hash);
+
+// Encodes a reconnecting client's request to be caught up from hash, which is
+// the last server state it saw.
+char* ot_encode_resume(const char* hash, uint32_t client_id);
+
+// Encodes the messages that catch a reconnecting client up to head. The
+// client's own ops (those with the given client_id) are encoded as
+// acknowledgements, except in a snapshot, whose only op is the whole document.
+char* ot_encode_catch_up(const ot_op* const* ops, size_t len,
+                         uint32_t client_id, const char* head, bool snapshot);
+
 // Encodes an error as a UTF-8 JSON string.
 char* ot_encode_err(ot_err err);
 
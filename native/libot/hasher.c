@@ -0,0 +1,210 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hasher.h"
+#include "sha1.h"
+
+// Number of bytes between checkpoints, which must be a multiple of SHA-1's
+// 64-byte block size.
+#define CHECKPOINT_BYTES 4096
+
+typedef struct checkpoint {
+    hash_state state;
+
+    // Number of code points that start before the checkpoint.
+    size_t cps;
+} checkpoint;
+
+static bool is_continuation(char byte) {
+    return ((uint8_t)byte & 0xC0) == 0x80;
+}
+
+void ot_hasher_init(ot_hasher* hasher, const char* text) {
+    if (text == NULL) {
+        text = "";
+    }
+
+    hasher->len = strlen(text);
+    hasher->cap = hasher->len + 1;
+    hasher->text = malloc(hasher->cap);
+    memcpy(hasher->text, text, hasher->cap);
+    hasher->scratch = NULL;
+    hasher->scratch_cap = 0;
+
+    array_init(&hasher->checkpoints, sizeof(checkpoint));
+    checkpoint* first = array_append(&hasher->checkpoints);
+    sha1_init(&first->state);
+    first->cps = 0;
+}
+
+void ot_hasher_free(ot_hasher* hasher) {
+    free(hasher->text);
+    free(hasher->scratch);
+    array_free(&hasher->checkpoints);
+}
+
+// Returns the byte offset of the code point at index count, or -1 if the text
+// is shorter than that. The scan starts from the last checkpoint before it.
+static ptrdiff_t offset_of(const ot_hasher* hasher, size_t count) {
+    const checkpoint* checkpoints = hasher->checkpoints.data;
+    size_t lo = 0;
+    size_t hi = hasher->checkpoints.len;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (checkpoints[mid].cps <= count) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    size_t pos = lo * CHECKPOINT_BYTES;
+    size_t cps = checkpoints[lo].cps;
+    while (pos < hasher->len &&
+           (cps < count || is_continuation(hasher->text[pos]))) {
+        if (!is_continuation(hasher->text[pos])) {
+            ++cps;
+        }
+        ++pos;
+    }
+
+    return (cps == count) ? (ptrdiff_t)pos : -1;
+}
+
+// Returns the number of bytes taken up by the first count code points of text,
+// or -1 if text is shorter than that.
+static ptrdiff_t text_bytes(const char* text, const char* end, uint32_t count) {
+    const char* c = text;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (c == end) {
+            return -1;
+        }
+        ++c;
+        while (c != end && is_continuation(*c)) {
+            ++c;
+        }
+    }
+
+    return c - text;
+}
+
+// Writes the text from start onwards with op's components from first onwards
+// applied to it into scratch, and returns its length, or -1 if they can't be
+// applied.
+static ptrdiff_t rewrite(ot_hasher* hasher, size_t start, const ot_op* op,
+                         size_t first) {
+    const ot_comp* comps = op->comps.data;
+    size_t cap = hasher->len - start + 1;
+    for (size_t i = first; i < op->comps.len; ++i) {
+        if (comps[i].type == OT_INSERT) {
+            cap += strlen(comps[i].value.insert.text);
+        }
+    }
+    if (cap > hasher->scratch_cap) {
+        free(hasher->scratch);
+        hasher->scratch = malloc(cap);
+        hasher->scratch_cap = cap;
+    }
+
+    char* out = hasher->scratch;
+    size_t written = 0;
+    const char* src = hasher->text + start;
+    const char* end = hasher->text + hasher->len;
+    for (size_t i = first; i < op->comps.len; ++i) {
+        const ot_comp* comp = comps + i;
+        ptrdiff_t bytes;
+        switch (comp->type) {
+        case OT_SKIP:
+            bytes = text_bytes(src, end, comp->value.skip.count);
+            if (bytes < 0) {
+                return -1;
+            }
+            memcpy(out + written, src, (size_t)bytes);
+            written += (size_t)bytes;
+            src += bytes;
+            break;
+        case OT_INSERT: {
+            size_t len = strlen(comp->value.insert.text);
+            memcpy(out + written, comp->value.insert.text, len);
+            written += len;
+            break;
+        }
+        case OT_DELETE:
+            bytes = text_bytes(src, end, comp->value.delete.count);
+            if (bytes < 0) {
+                return -1;
+            }
+            src += bytes;
+            break;
+        default:
+            return -1;
+        }
+    }
+
+    size_t rest = (size_t)(end - src);
+    memcpy(out + written, src, rest);
+    return (ptrdiff_t)(written + rest);
+}
+
+// Hashes the text from the last checkpoint onwards, adding checkpoints as it
+// goes.
+static void rehash(ot_hasher* hasher, char* hash) {
+    size_t last = hasher->checkpoints.len - 1;
+    checkpoint* checkpoints = hasher->checkpoints.data;
+    hash_state md = checkpoints[last].state;
+    size_t cps = checkpoints[last].cps;
+    size_t pos = last * CHECKPOINT_BYTES;
+
+    while (pos + CHECKPOINT_BYTES <= hasher->len) {
+        const char* block = hasher->text + pos;
+        sha1_process(&md, block, CHECKPOINT_BYTES);
+        for (size_t i = 0; i < CHECKPOINT_BYTES; ++i) {
+            cps += !is_continuation(block[i]);
+        }
+        pos += CHECKPOINT_BYTES;
+
+        checkpoint* next = array_append(&hasher->checkpoints);
+        next->state = md;
+        next->cps = cps;
+    }
+
+    sha1_process(&md, hasher->text + pos, (uint32_t)(hasher->len - pos));
+    sha1_done(&md, hash);
+}
+
+bool ot_hasher_apply(ot_hasher* hasher, const ot_op* op, char* hash) {
+    // The text before the op's first change, and everything saved about it,
+    // stays as it is.
+    const ot_comp* comps = op->comps.data;
+    size_t first = 0;
+    size_t skipped = 0;
+    while (first < op->comps.len && comps[first].type == OT_SKIP) {
+        skipped += comps[first].value.skip.count;
+        ++first;
+    }
+
+    ptrdiff_t start = offset_of(hasher, skipped);
+    if (start < 0) {
+        return false;
+    }
+    ptrdiff_t rewritten = rewrite(hasher, (size_t)start, op, first);
+    if (rewritten < 0) {
+        return false;
+    }
+
+    size_t len = (size_t)start + (size_t)rewritten;
+    if (len + 1 > hasher->cap) {
+        hasher->cap = (len + 1 > hasher->cap * 2) ? len + 1 : hasher->cap * 2;
+        hasher->text = realloc(hasher->text, hasher->cap);
+    }
+    memcpy(hasher->text + start, hasher->scratch, (size_t)rewritten);
+    hasher->text[len] = '\0';
+    hasher->len = len;
+
+    size_t valid = (size_t)start / CHECKPOINT_BYTES + 1;
+    if (valid < hasher->checkpoints.len) {
+        hasher->checkpoints.len = valid;
+    }
+    rehash(hasher, hash);
+    return true;
+}
@@ -0,0 +1,43 @@
+#ifndef LIBOT_HASHER_H
+#define LIBOT_HASHER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "array.h"
+#include "ot.h"
+
+// Keeps a document's text up to date as ops are applied to it, and computes
+// the hash of the text after each one.
+//
+// Rehashing the whole text after every op costs as much as the document is
+// long, which adds up quickly when a stream of ops has to be hashed one after
+// another. The hasher saves SHA-1's state every few kilobytes of text, along
+// with the number of code points before that point, so applying an op only
+// rewrites and rehashes the text from the op's first change onwards. Typing at
+// the end of a large document only hashes its last few kilobytes.
+typedef struct ot_hasher {
+    // The NUL-terminated text, and its length and capacity in bytes.
+    char* text;
+    size_t len;
+    size_t cap;
+
+    // Holds the rewritten end of the text while an op is applied.
+    char* scratch;
+    size_t scratch_cap;
+
+    // The hash state at the start of the text and after every whole interval
+    // of bytes in it.
+    array checkpoints;
+} ot_hasher;
+
+// Initializes a hasher with a copy of text. A NULL text is empty.
+void ot_hasher_init(ot_hasher* hasher, const char* text);
+
+void ot_hasher_free(ot_hasher* hasher);
+
+// Applies op to the text and stores the hash of the new text in hash. Returns
+// false, leaving the text unchanged, if op doesn't fit the text or has
+// components other than skips, inserts and deletes.
+bool ot_hasher_apply(ot_hasher* hasher, const ot_op* op, char* hash);
+
+#endif
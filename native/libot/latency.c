@@ -0,0 +1,65 @@
+#include <string.h>
+#include "latency.h"
+
+void ot_latency_init(ot_latency* latency) {
+    memset(latency, 0, sizeof(ot_latency));
+}
+
+void ot_latency_record(ot_latency* latency, double secs) {
+    if (secs < 0) {
+        secs = 0;
+    }
+
+    size_t bucket = 0;
+    double bound = 0.000001;
+    while (bucket < OT_LATENCY_BUCKETS - 1 && secs >= bound) {
+        bound *= 2;
+        ++bucket;
+    }
+
+    ++latency->buckets[bucket];
+    ++latency->count;
+    latency->total_secs += secs;
+    if (secs > latency->max_secs) {
+        latency->max_secs = secs;
+    }
+}
+
+void ot_latency_merge(ot_latency* dst, const ot_latency* src) {
+    for (size_t i = 0; i < OT_LATENCY_BUCKETS; ++i) {
+        dst->buckets[i] += src->buckets[i];
+    }
+
+    dst->count += src->count;
+    dst->total_secs += src->total_secs;
+    if (src->max_secs > dst->max_secs) {
+        dst->max_secs = src->max_secs;
+    }
+}
+
+double ot_latency_mean(const ot_latency* latency) {
+    if (latency->count == 0) {
+        return 0;
+    }
+
+    return latency->total_secs / (double)latency->count;
+}
+
+double ot_latency_percentile(const ot_latency* latency, double p) {
+    if (latency->count == 0) {
+        return 0;
+    }
+
+    double target = p * (double)latency->count;
+    uint64_t seen = 0;
+    double bound = 0.000001;
+    for (size_t i = 0; i < OT_LATENCY_BUCKETS; ++i) {
+        seen += latency->buckets[i];
+        if ((double)seen >= target) {
+            break;
+        }
+        bound *= 2;
+    }
+
+    return (bound < latency->max_secs) ? bound : latency->max_secs;
+}
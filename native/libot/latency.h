@@ -0,0 +1,36 @@
+#ifndef LIBOT_LATENCY_H
+#define LIBOT_LATENCY_H
+
+#include <stdint.h>
+
+// Number of histogram buckets. Bucket i counts samples below 2^i microseconds,
+// so the last bucket covers anything over half an hour.
+#define OT_LATENCY_BUCKETS 32
+
+// A histogram of durations. Recording a sample is O(1) and doesn't allocate,
+// so it can be done for every message. It isn't synchronized, so each thread
+// should record into its own histogram.
+typedef struct ot_latency {
+    uint64_t count;
+    double total_secs;
+    double max_secs;
+    uint64_t buckets[OT_LATENCY_BUCKETS];
+} ot_latency;
+
+void ot_latency_init(ot_latency* latency);
+
+// Records a duration in seconds.
+void ot_latency_record(ot_latency* latency, double secs);
+
+// Adds every sample in src to dst.
+void ot_latency_merge(ot_latency* dst, const ot_latency* src);
+
+// Returns the mean duration in seconds, or 0 if nothing was recorded.
+double ot_latency_mean(const ot_latency* latency);
+
+// Returns an upper bound on the duration that a fraction p (between 0 and 1) of
+// the samples fall under. The bound is the top of the sample's bucket, so it's
+// within a factor of two of the exact value.
+double ot_latency_percentile(const ot_latency* latency, double p);
+
+#endif
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "log.h"
+#include "encode.h"
+
+static void stderr_sink(ot_log_level level, const char* msg) {
+    (void)level;
+    fprintf(stderr, "%s\n", msg);
+}
+
+static ot_log_level log_level = OT_LOG_INFO;
+static ot_log_func log_sink = stderr_sink;
+
+void ot_log_set_level(ot_log_level level) { log_level = level; }
+
+ot_log_level ot_log_get_level(void) { return log_level; }
+
+void ot_log_set_sink(ot_log_func sink) {
+    log_sink = (sink != NULL) ? sink : stderr_sink;
+}
+
+bool ot_log_enabled(ot_log_level level) {
+    return level != OT_LOG_NONE && level >= log_level;
+}
+
+// A growable string that messages are built up in.
+typedef struct message {
+    char* data;
+    size_t len;
+    size_t cap;
+} message;
+
+static void message_vappend(message* m, const char* fmt, va_list args) {
+    va_list copy;
+    va_copy(copy, args);
+    int n = vsnprintf(NULL, 0, fmt, copy);
+    va_end(copy);
+    if (n < 0) {
+        return;
+    }
+
+    size_t needed = m->len + (size_t)n + 1;
+    if (needed > m->cap) {
+        size_t cap = (m->cap == 0) ? 128 : m->cap;
+        while (cap < needed) {
+            cap *= 2;
+        }
+
+        char* data = realloc(m->data, cap);
+        if (data == NULL) {
+            return;
+        }
+        m->data = data;
+        m->cap = cap;
+    }
+
+    vsnprintf(m->data + m->len, (size_t)n + 1, fmt, args);
+    m->len += (size_t)n;
+}
+
+static void message_append(message* m, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    message_vappend(m, fmt, args);
+    va_end(args);
+}
+
+static void message_prefix(message* m, ot_log_level level, ot_err err) {
+    switch (level) {
+    case OT_LOG_DEBUG:
+        message_append(m, "[DEBUG] ");
+        break;
+    case OT_LOG_INFO:
+        message_append(m, "[INFO] ");
+        break;
+    default:
+        message_append(m, "[ERROR %d] ", err);
+        break;
+    }
+}
+
+static void message_emit(message* m, ot_log_level level) {
+    if (m->data != NULL) {
+        log_sink(level, m->data);
+    }
+    free(m->data);
+}
+
+void ot_log(ot_log_level level, ot_err err, const char* fmt, ...) {
+    if (!ot_log_enabled(level)) {
+        return;
+    }
+
+    message m = { NULL, 0, 0 };
+    message_prefix(&m, level, err);
+
+    va_list args;
+    va_start(args, fmt);
+    message_vappend(&m, fmt, args);
+    va_end(args);
+
+    message_emit(&m, level);
+}
+
+void ot_log_ops(ot_log_level level, ot_err err, const char* msg, ...) {
+    if (!ot_log_enabled(level)) {
+        return;
+    }
+
+    message m = { NULL, 0, 0 };
+    message_prefix(&m, level, err);
+    message_append(&m, "%s", msg);
+
+    va_list args;
+    va_start(args, msg);
+    const char* label;
+    while ((label = va_arg(args, const char*)) != NULL) {
+        const ot_op* op = va_arg(args, const ot_op*);
+        if (op == NULL) {
+            message_append(&m, "\n\t%s: EMPTY", label);
+            continue;
+        }
+
+        char* enc = ot_encode(op);
+        message_append(&m, "\n\t%s: %s", label, enc);
+        free(enc);
+    }
+    va_end(args);
+
+    message_emit(&m, level);
+}
@@ -0,0 +1,82 @@
+#ifndef LIBOT_LOG_H
+#define LIBOT_LOG_H
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include "ot.h"
+
+// Provides leveled logging for libot. Messages below the current level are
+// dropped before anything is formatted, and operations passed to ot_log_ops are
+// only encoded once it's known that the message will be emitted.
+//
+// Logging can also be removed at compile time by defining LIBOT_LOG_LEVEL. Any
+// OT_LOG or OT_LOG_OPS call below that level compiles to nothing, so it won't
+// even check the runtime level. For example, building with
+// -DLIBOT_LOG_LEVEL=OT_LOG_ERROR keeps only error messages.
+
+typedef enum {
+    // Verbose messages that include the full contents of documents and
+    // operations. Encoding these is expensive, so they're disabled by default.
+    OT_LOG_DEBUG = 0,
+
+    // Messages that describe what libot is doing.
+    OT_LOG_INFO = 1,
+
+    // Messages that describe a failure.
+    OT_LOG_ERROR = 2,
+
+    // Disables all messages.
+    OT_LOG_NONE = 3
+} ot_log_level;
+
+#ifndef LIBOT_LOG_LEVEL
+#define LIBOT_LOG_LEVEL OT_LOG_DEBUG
+#endif
+
+// A sink receives every emitted message. The message doesn't end in a newline
+// and is only valid for the duration of the call.
+typedef void (*ot_log_func)(ot_log_level level, const char* msg);
+
+// Sets the minimum level of messages that will be emitted. The default is
+// OT_LOG_INFO.
+void ot_log_set_level(ot_log_level level);
+
+ot_log_level ot_log_get_level(void);
+
+// Sets the function that emitted messages are sent to. Passing NULL restores
+// the default sink, which writes each message to stderr. The level and sink
+// are global, so they should be set before libot is used from multiple
+// threads.
+void ot_log_set_sink(ot_log_func sink);
+
+// Returns true if a message at the given level would be emitted.
+bool ot_log_enabled(ot_log_level level);
+
+// Emits a printf-style message. err is included in the prefix of error
+// messages and is ignored for other levels.
+void ot_log(ot_log_level level, ot_err err, const char* fmt, ...);
+
+// Emits msg followed by a list of labeled operations. The variable arguments
+// are pairs of a const char* label and a const ot_op*, terminated by a NULL
+// label. A NULL operation is logged as "EMPTY".
+//
+// Example:
+//     ot_log_ops(OT_LOG_DEBUG, OT_ERR_NONE, "Appending operation.",
+//                "Document", doc->composed, "Operation", op, NULL);
+void ot_log_ops(ot_log_level level, ot_err err, const char* msg, ...);
+
+#define OT_LOG(level, ...)                                                     \
+    do {                                                                       \
+        if ((level) >= LIBOT_LOG_LEVEL && ot_log_enabled(level)) {             \
+            ot_log((level), __VA_ARGS__);                                      \
+        }                                                                      \
+    } while (0)
+
+#define OT_LOG_OPS(level, ...)                                                 \
+    do {                                                                       \
+        if ((level) >= LIBOT_LOG_LEVEL && ot_log_enabled(level)) {             \
+            ot_log_ops((level), __VA_ARGS__);                                  \
+        }                                                                      \
+    } while (0)
+
+#endif
@@ -0,0 +1,26 @@
+#include <stdlib.h>
+#include <string.h>
+#include "msg.h"
+
+ot_msg* ot_new_msg(char* data) {
+    ot_msg* msg = malloc(sizeof(ot_msg));
+    msg->data = data;
+    msg->len = strlen(data);
+    msg->refs = 1;
+
+    return msg;
+}
+
+ot_msg* ot_msg_retain(ot_msg* msg) {
+    __atomic_add_fetch(&msg->refs, 1, __ATOMIC_RELAXED);
+    return msg;
+}
+
+void ot_msg_release(ot_msg* msg) {
+    if (__atomic_sub_fetch(&msg->refs, 1, __ATOMIC_ACQ_REL) > 0) {
+        return;
+    }
+
+    free(msg->data);
+    free(msg);
+}
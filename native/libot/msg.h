@@ -0,0 +1,35 @@
+#ifndef LIBOT_MSG_H
+#define LIBOT_MSG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// An encoded message that can be shared by every recipient it's sent to. The
+// data is never copied or modified once the message is created, so a socket
+// layer can hold a reference to it for each queued write and release it once
+// the write completes. References are counted atomically, so they can be
+// released from any thread.
+typedef struct ot_msg {
+    char* data;
+
+    // Length of data in bytes, not including its NUL terminator.
+    size_t len;
+
+    uint32_t refs;
+} ot_msg;
+
+// Sends a shared message. A recipient that keeps the message after returning
+// must take its own reference with ot_msg_retain.
+typedef int (*ot_send_msg_func)(ot_msg* msg);
+
+// Creates a message with one reference from a NUL-terminated string that was
+// allocated with malloc. The message takes ownership of data.
+ot_msg* ot_new_msg(char* data);
+
+// Adds a reference to a message and returns it.
+ot_msg* ot_msg_retain(ot_msg* msg);
+
+// Releases a reference to a message, freeing it once there are none left.
+void ot_msg_release(ot_msg* msg);
+
+#endif
@@ -359,6 +359,118 @@ uint32_t ot_comp_size(const ot_comp* comp) {
     return -1;
 }
 
+static size_t fmts_bytes(const array* fmts) {
+    size_t bytes = fmts->cap * sizeof(ot_fmt);
+    ot_fmt* data = fmts->data;
+    for (size_t i = 0; i < fmts->len; ++i) {
+        bytes += strlen(data[i].name) + 1;
+        bytes += strlen(data[i].value) + 1;
+    }
+
+    return bytes;
+}
+
+size_t ot_op_bytes(const ot_op* op) {
+    size_t bytes = op->comps.cap * sizeof(ot_comp);
+    ot_comp* comps = op->comps.data;
+    for (size_t i = 0; i < op->comps.len; ++i) {
+        ot_comp* comp = comps + i;
+        switch (comp->type) {
+        case OT_INSERT:
+            bytes += strlen(comp->value.insert.text) + 1;
+            break;
+        case OT_OPEN_ELEMENT:
+            bytes += strlen(comp->value.open_element.elem) + 1;
+            break;
+        case OT_FORMATTING_BOUNDARY:
+            bytes += fmts_bytes(&comp->value.fmtbound.start);
+            bytes += fmts_bytes(&comp->value.fmtbound.end);
+            break;
+        default:
+            break;
+        }
+    }
+
+    return bytes;
+}
+
+// Returns the number of code points in a string, or -1 if it isn't valid
+// UTF-8. Overlong encodings, surrogates and code points above U+10FFFF are
+// rejected.
+static int64_t valid_utf8_length(const char* str) {
+    const unsigned char* s = (const unsigned char*)str;
+    int64_t length = 0;
+    while (*s != 0) {
+        size_t n;
+        if (*s <= 0x7f) {
+            n = 1;
+        } else if (*s >= 0xc2 && *s <= 0xdf) {
+            n = 2;
+        } else if (*s >= 0xe0 && *s <= 0xef) {
+            n = 3;
+        } else if (*s >= 0xf0 && *s <= 0xf4) {
+            n = 4;
+        } else {
+            return -1;
+        }
+
+        for (size_t i = 1; i < n; ++i) {
+            if ((s[i] & 0xc0) != 0x80) {
+                return -1;
+            }
+        }
+        if ((s[0] == 0xe0 && s[1] < 0xa0) || (s[0] == 0xed && s[1] > 0x9f) ||
+            (s[0] == 0xf0 && s[1] < 0x90) || (s[0] == 0xf4 && s[1] > 0x8f)) {
+            return -1;
+        }
+
+        s += n;
+        ++length;
+    }
+
+    return length;
+}
+
+ot_err ot_validate(const ot_op* op, ot_span* span) {
+    uint64_t before = 0;
+    uint64_t after = 0;
+    const ot_comp* comps = op->comps.data;
+    for (size_t i = 0; i < op->comps.len; ++i) {
+        const ot_comp* comp = comps + i;
+        int64_t count;
+        switch (comp->type) {
+        case OT_SKIP:
+            count = comp->value.skip.count;
+            before += count;
+            after += count;
+            break;
+        case OT_INSERT:
+            count = valid_utf8_length(comp->value.insert.text);
+            if (count < 0) {
+                return OT_ERR_INVALID_COMPONENT;
+            }
+            after += count;
+            break;
+        case OT_DELETE:
+            count = comp->value.delete.count;
+            before += count;
+            break;
+        default:
+            continue;
+        }
+
+        if (count == 0 || before > UINT32_MAX || after > UINT32_MAX) {
+            return OT_ERR_INVALID_COMPONENT;
+        }
+    }
+
+    if (span != NULL) {
+        span->before = (uint32_t)before;
+        span->after = (uint32_t)after;
+    }
+    return OT_ERR_NONE;
+}
+
 void ot_iter_init(ot_iter* iter, const ot_op* op) {
     iter->op = op;
     iter->started = false;
@@ -45,7 +45,23 @@ typedef enum {
 
     // Couldn't append an operation to a document because it would cause the
     // document to go beyond its maximum size.
-    OT_ERR_MAX_SIZE = 11
+    OT_ERR_MAX_SIZE = 11,
+
+    // An operation's hash or parent didn't match the document state that it
+    // was applied to.
+    OT_ERR_HASH_MISMATCH = 12,
+
+    // Couldn't route a message because its docId field was missing.
+    OT_ERR_DOC_ID_MISSING = 13,
+
+    // The operation was already appended, so it was only acknowledged again.
+    OT_ERR_DUPLICATE = 14,
+
+    // An operation didn't span the whole document it was applied to.
+    OT_ERR_SPAN_MISMATCH = 15,
+
+    // A document that was evicted to disk couldn't be read back.
+    OT_ERR_RELOAD_FAILED = 16
 } ot_err;
 
 typedef struct ot_fmt {
@@ -135,6 +151,26 @@ char* ot_snapshot(ot_op* op);
 uint32_t ot_size(const ot_op* op);
 uint32_t ot_comp_size(const ot_comp* comp);
 
+// Returns the number of heap bytes held by an op's components, including any
+// text they own. The ot_op struct itself isn't included.
+size_t ot_op_bytes(const ot_op* op);
+
+// The number of code points an op expects its document to have, and the
+// number the document has after the op is applied.
+typedef struct ot_span {
+    uint32_t before;
+    uint32_t after;
+} ot_span;
+
+// Checks that an op is well formed, in time linear in its size and without
+// allocating: every skip, insert and delete is non-empty, the op doesn't span
+// more than 2^32 - 1 code points, and inserted text is valid UTF-8. Ops from
+// clients should be validated before they're transformed or composed, which
+// only notice malformed ops after doing most of their work. On success, span
+// is set to the op's span if it isn't NULL. Returns OT_ERR_INVALID_COMPONENT
+// if the op isn't well formed.
+ot_err ot_validate(const ot_op* op, ot_span* span);
+
 ot_comp_fmtbound* ot_new_fmtbound();
 
 typedef struct ot_iter {
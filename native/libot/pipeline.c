@@ -0,0 +1,491 @@
+#include "pipeline.h"
+#include "log.h"
+
+#define DEFAULT_CAPACITY 256
+#define DEFAULT_LARGE_BYTES (64 * 1024)
+#define DEFAULT_MAX_OVERTAKES 64
+
+// A message moving through the pipeline.
+typedef struct item {
+    char* json;
+    double submitted;
+    bool large;
+
+    // The decoded op until it's sequenced, and then a copy of the op as it was
+    // appended (the first time, if it's a duplicate). It's NULL if an earlier
+    // stage failed.
+    ot_op* op;
+    ot_err err;
+
+    // The client that sent the message, if its header could be decoded, so
+    // that errors are only sent to it. The op can't be used for this, since
+    // it's gone once something fails.
+    bool has_sender;
+    uint32_t sender;
+
+    // Set if the message is a resume request from the sender for the ops after
+    // resume_hash.
+    bool resume;
+    char resume_hash[20];
+
+    // When hashes are deferred, whether the op was appended without its hash
+    // and its position in the history. text is the document's text after the
+    // op if it can't be applied to the hasher's text, or NULL.
+    bool unhashed;
+    char* text;
+    size_t index;
+} item;
+
+// A hash computed by the hasher that hasn't been stored in the document yet.
+typedef struct computed_hash {
+    size_t index;
+    char hash[20];
+} computed_hash;
+
+// Stores the hashes computed so far in the document. If wait is set, this
+// blocks until every op in the document has its hash. Only the sequencer may
+// call this while the pipeline is running, since it owns the document.
+static void store_hashes(ot_pipeline* pipeline, bool wait) {
+    ot_doc* doc = pipeline->server->doc;
+
+    ot_mutex_lock(&pipeline->hash_lock);
+    while (true) {
+        computed_hash* hashes = pipeline->hashes.data;
+        for (size_t i = 0; i < pipeline->hashes.len; ++i) {
+            ot_doc_set_hash(doc, hashes[i].index, hashes[i].hash);
+        }
+        array_free(&pipeline->hashes);
+        array_init(&pipeline->hashes, sizeof(computed_hash));
+
+        if (!wait || doc == NULL || doc->hashed == ot_doc_len(doc)) {
+            break;
+        }
+        ot_cond_wait(&pipeline->hashed, &pipeline->hash_lock);
+    }
+    ot_mutex_unlock(&pipeline->hash_lock);
+}
+
+// Publishes the document's state for other threads, if the pipeline does.
+static void publish(ot_pipeline* pipeline) {
+    if (pipeline->publish && pipeline->server->doc != NULL) {
+        ot_doc_publish(pipeline->server->doc);
+    }
+}
+
+static void decode_item(ot_pipeline* pipeline, item* it) {
+    double start = ot_now();
+
+    // The decoder doesn't own the document, so ops whose parent is missing
+    // are only rejected once they're sequenced.
+    ot_received received;
+    ot_server_decode(NULL, it->json, &received);
+    it->op = received.op;
+    it->err = received.err;
+    it->has_sender = received.has_sender;
+    it->sender = received.client_id;
+    it->resume = received.resume;
+    memcpy(it->resume_hash, received.hash, 20);
+
+    ot_latency_record(&pipeline->stats.decode, ot_now() - start);
+}
+
+static void sequence_item(ot_pipeline* pipeline, item* it) {
+    if (it->err != OT_ERR_NONE || it->resume) {
+        return;
+    }
+
+    double start = ot_now();
+
+    // The appended op belongs to the document, which the sequencer may append
+    // to again before the encoder gets to it, so the encoder gets a copy.
+    ot_op* appended;
+    if (pipeline->defer_hash) {
+        // Ops sent after the previous one was broadcast may be based on it, so
+        // its hash has to be in the document before they can be found.
+        store_hashes(pipeline, false);
+        publish(pipeline);
+        it->err = ot_server_sequence_unhashed(pipeline->server, it->op,
+                                              &appended, &it->text);
+        if (it->err == OT_ERR_NONE) {
+            it->unhashed = true;
+            it->index = ot_doc_len(pipeline->server->doc) - 1;
+        } else if (it->err == OT_ERR_DUPLICATE) {
+            // Duplicates are rare, so rather than passing the original's hash
+            // along when it's ready, the sequencer waits for it.
+            store_hashes(pipeline, true);
+        }
+    } else {
+        it->err = ot_server_sequence(pipeline->server, it->op, &appended);
+    }
+    bool sequenced = it->err == OT_ERR_NONE || it->err == OT_ERR_DUPLICATE;
+    it->op = sequenced ? ot_dup_op(appended) : NULL;
+    publish(pipeline);
+
+    ot_latency_record(&pipeline->stats.sequence, ot_now() - start);
+}
+
+static void hash_item(ot_pipeline* pipeline, item* it) {
+    if (!it->unhashed) {
+        return;
+    }
+
+    double start = ot_now();
+
+    computed_hash computed;
+    computed.index = it->index;
+    if (it->text != NULL) {
+        // The op can't be applied to plain text, so the hasher starts over
+        // from the text the sequencer passed along.
+        ot_hasher_free(&pipeline->text);
+        ot_hasher_init(&pipeline->text, it->text);
+        hash_text(it->text, computed.hash);
+        free(it->text);
+        it->text = NULL;
+    } else {
+        // The op only has skips, inserts and deletes, and it was checked
+        // against the document's length when it was appended, so it always
+        // applies.
+        ot_hasher_apply(&pipeline->text, it->op, computed.hash);
+    }
+
+    // Ops are hashed in the order they were appended, so an op's parent is
+    // either the op hashed before it or one that was hashed when it was
+    // appended.
+    memcpy(it->op->hash, computed.hash, 20);
+    if (pipeline->last_hashed == it->index) {
+        memcpy(it->op->parent, pipeline->last_hash, 20);
+    }
+    pipeline->last_hashed = it->index + 1;
+    memcpy(pipeline->last_hash, computed.hash, 20);
+
+    ot_mutex_lock(&pipeline->hash_lock);
+    computed_hash* stored = array_append(&pipeline->hashes);
+    *stored = computed;
+    ot_cond_signal(&pipeline->hashed);
+    ot_mutex_unlock(&pipeline->hash_lock);
+
+    ot_latency_record(&pipeline->stats.hash, ot_now() - start);
+}
+
+// Answers a resume request. The catch-up reads the document, so the sequencer
+// waits for this before sequencing anything else, and every op before the
+// request has been hashed by the time it gets here.
+static void resume_item(ot_pipeline* pipeline, item* it) {
+    if (pipeline->defer_hash) {
+        store_hashes(pipeline, false);
+    }
+    ot_server_resume(pipeline->server, it->resume_hash, it->sender);
+
+    ot_mutex_lock(&pipeline->lock);
+    pipeline->catching_up = false;
+    ot_cond_signal(&pipeline->caught_up);
+    ot_mutex_unlock(&pipeline->lock);
+}
+
+static void encode_item(ot_pipeline* pipeline, item* it) {
+    double start = ot_now();
+
+    if (it->resume) {
+        resume_item(pipeline, it);
+    } else if (it->err == OT_ERR_DUPLICATE) {
+        ot_server_acknowledge(pipeline->server, it->op);
+        ot_free_op(it->op);
+    } else if (it->err != OT_ERR_NONE && it->has_sender) {
+        ot_server_reply_err(pipeline->server, it->sender, it->err);
+    } else if (it->err != OT_ERR_NONE) {
+        ot_msg* enc = ot_new_msg(ot_encode_err(it->err));
+        ot_server_send_msg(pipeline->server, enc);
+        ot_msg_release(enc);
+    } else {
+        ot_server_broadcast(pipeline->server, it->op);
+        ot_free_op(it->op);
+    }
+
+    double end = ot_now();
+    ot_latency_record(&pipeline->stats.encode, end - start);
+    ot_latency_record(&pipeline->stats.total, end - it->submitted);
+    ot_latency_record(it->large ? &pipeline->stats.large
+                                : &pipeline->stats.small,
+                      end - it->submitted);
+
+    free(it->json);
+    free(it);
+
+    ot_mutex_lock(&pipeline->lock);
+    ++pipeline->stats.messages;
+    if (pipeline->stats.messages == pipeline->submitted) {
+        ot_cond_broadcast(&pipeline->drained);
+    }
+    ot_mutex_unlock(&pipeline->lock);
+}
+
+static void* decoder_main(void* arg) {
+    ot_pipeline* pipeline = arg;
+    size_t cap = pipeline->decode_ring.cap;
+
+    // Large messages that are waiting to be processed, oldest first. There are
+    // never more of them than a ring can hold, so they're bounded the same way
+    // as queued messages.
+    item** deferred = malloc(sizeof(item*) * cap);
+    size_t deferred_head = 0;
+    size_t deferred_len = 0;
+    size_t overtakes = 0;
+
+    while (true) {
+        item* it = NULL;
+        if (deferred_len == 0) {
+            it = ot_ring_pop(&pipeline->decode_ring);
+            if (it == NULL) {
+                break;
+            }
+        } else if (overtakes < pipeline->max_overtakes && deferred_len < cap) {
+            it = ot_ring_try_pop(&pipeline->decode_ring);
+        }
+
+        if (it == NULL) {
+            it = deferred[deferred_head];
+            deferred_head = (deferred_head + 1) % cap;
+            --deferred_len;
+            overtakes = 0;
+        } else if (it->large) {
+            deferred[(deferred_head + deferred_len) % cap] = it;
+            ++deferred_len;
+            continue;
+        } else if (deferred_len > 0) {
+            ++overtakes;
+        }
+
+        decode_item(pipeline, it);
+        ot_ring_push(&pipeline->sequence_ring, it);
+    }
+
+    free(deferred);
+    ot_ring_close(&pipeline->sequence_ring);
+    return NULL;
+}
+
+// Returns the ring that sequenced items are pushed onto.
+static ot_ring* sequenced_ring(ot_pipeline* pipeline) {
+    return pipeline->defer_hash ? &pipeline->hash_ring
+                                : &pipeline->encode_ring;
+}
+
+static void* sequencer_main(void* arg) {
+    ot_pipeline* pipeline = arg;
+    ot_ring* out = sequenced_ring(pipeline);
+    item* it;
+    while ((it = ot_ring_pop(&pipeline->sequence_ring)) != NULL) {
+        sequence_item(pipeline, it);
+
+        // The item is freed once it's encoded, so whether it's a resume
+        // request is checked before it's passed on.
+        bool resume = it->resume;
+        if (resume) {
+            ot_mutex_lock(&pipeline->lock);
+            pipeline->catching_up = true;
+            ot_mutex_unlock(&pipeline->lock);
+        }
+        ot_ring_push(out, it);
+
+        if (resume) {
+            ot_mutex_lock(&pipeline->lock);
+            while (pipeline->catching_up) {
+                ot_cond_wait(&pipeline->caught_up, &pipeline->lock);
+            }
+            ot_mutex_unlock(&pipeline->lock);
+        }
+    }
+
+    ot_ring_close(out);
+    return NULL;
+}
+
+static void* hasher_main(void* arg) {
+    ot_pipeline* pipeline = arg;
+    item* it;
+    while ((it = ot_ring_pop(&pipeline->hash_ring)) != NULL) {
+        hash_item(pipeline, it);
+        ot_ring_push(&pipeline->encode_ring, it);
+    }
+
+    ot_ring_close(&pipeline->encode_ring);
+    return NULL;
+}
+
+static void* encoder_main(void* arg) {
+    ot_pipeline* pipeline = arg;
+    while (true) {
+        // Ops held in the server's broadcast window, or waiting for its
+        // write-ahead log, are sent whenever the encoder runs out of work,
+        // since nothing else sends on its behalf.
+        item* it = ot_ring_try_pop(&pipeline->encode_ring);
+        if (it == NULL) {
+            ot_server_sync(pipeline->server);
+            it = ot_ring_pop(&pipeline->encode_ring);
+        }
+        if (it == NULL) {
+            break;
+        }
+
+        encode_item(pipeline, it);
+    }
+
+    return NULL;
+}
+
+// Waits for the stages after the sequencer to finish.
+static void join_after_sequencer(ot_pipeline* pipeline) {
+    if (pipeline->defer_hash) {
+        ot_thread_join(pipeline->hasher);
+    }
+    ot_thread_join(pipeline->encoder);
+}
+
+ot_pipeline* ot_new_pipeline(ot_server* server, const ot_pipeline_opts* opts) {
+    ot_pipeline_opts o = { 0 };
+    if (opts != NULL) {
+        o = *opts;
+    }
+    size_t capacity = (o.capacity > 0) ? o.capacity : DEFAULT_CAPACITY;
+
+    ot_pipeline* pipeline = malloc(sizeof(ot_pipeline));
+    pipeline->server = server;
+    pipeline->large_bytes =
+        (o.large_bytes > 0) ? o.large_bytes : DEFAULT_LARGE_BYTES;
+    pipeline->max_overtakes =
+        (o.max_overtakes > 0) ? o.max_overtakes : DEFAULT_MAX_OVERTAKES;
+    ot_ring_init(&pipeline->decode_ring, capacity);
+    ot_ring_init(&pipeline->sequence_ring, capacity);
+    ot_ring_init(&pipeline->hash_ring, capacity);
+    ot_ring_init(&pipeline->encode_ring, capacity);
+    pipeline->defer_hash = o.defer_hash;
+    pipeline->publish = o.publish;
+    pipeline->last_hashed = 0;
+    memset(pipeline->last_hash, 0, 20);
+    array_init(&pipeline->hashes, sizeof(computed_hash));
+    char* text = NULL;
+    if (pipeline->defer_hash && server->doc != NULL) {
+        text = ot_snapshot(server->doc->composed);
+    }
+    ot_hasher_init(&pipeline->text, text);
+    free(text);
+    ot_mutex_init(&pipeline->hash_lock);
+    ot_cond_init(&pipeline->hashed);
+    ot_mutex_init(&pipeline->lock);
+    ot_cond_init(&pipeline->drained);
+    ot_cond_init(&pipeline->caught_up);
+    pipeline->catching_up = false;
+    pipeline->submitted = 0;
+    pipeline->stats.messages = 0;
+    ot_latency_init(&pipeline->stats.decode);
+    ot_latency_init(&pipeline->stats.sequence);
+    ot_latency_init(&pipeline->stats.hash);
+    ot_latency_init(&pipeline->stats.encode);
+    ot_latency_init(&pipeline->stats.total);
+    ot_latency_init(&pipeline->stats.small);
+    ot_latency_init(&pipeline->stats.large);
+
+    // The stages are started from the back so that, if one fails to start,
+    // closing the ring in front of the ones that did is enough to stop them.
+    pipeline->threaded = false;
+    if (!ot_thread_start(&pipeline->encoder, encoder_main, pipeline)) {
+        return pipeline;
+    }
+    if (pipeline->defer_hash &&
+        !ot_thread_start(&pipeline->hasher, hasher_main, pipeline)) {
+        ot_ring_close(&pipeline->encode_ring);
+        ot_thread_join(pipeline->encoder);
+        return pipeline;
+    }
+    if (!ot_thread_start(&pipeline->sequencer, sequencer_main, pipeline)) {
+        ot_ring_close(sequenced_ring(pipeline));
+        join_after_sequencer(pipeline);
+        return pipeline;
+    }
+    if (!ot_thread_start(&pipeline->decoder, decoder_main, pipeline)) {
+        ot_ring_close(&pipeline->sequence_ring);
+        ot_thread_join(pipeline->sequencer);
+        join_after_sequencer(pipeline);
+        return pipeline;
+    }
+
+    pipeline->threaded = true;
+    return pipeline;
+}
+
+void ot_free_pipeline(ot_pipeline* pipeline) {
+    if (pipeline->threaded) {
+        // Closing the first ring lets every stage finish what's queued before
+        // closing the ring after it.
+        ot_ring_close(&pipeline->decode_ring);
+        ot_thread_join(pipeline->decoder);
+        ot_thread_join(pipeline->sequencer);
+        join_after_sequencer(pipeline);
+    }
+
+    // The last hashes are stored so that the document is complete once the
+    // pipeline is gone.
+    if (pipeline->defer_hash) {
+        store_hashes(pipeline, false);
+        publish(pipeline);
+    }
+
+    ot_cond_destroy(&pipeline->caught_up);
+    ot_cond_destroy(&pipeline->drained);
+    ot_mutex_destroy(&pipeline->lock);
+    ot_cond_destroy(&pipeline->hashed);
+    ot_mutex_destroy(&pipeline->hash_lock);
+    array_free(&pipeline->hashes);
+    ot_hasher_free(&pipeline->text);
+    ot_ring_free(&pipeline->encode_ring);
+    ot_ring_free(&pipeline->hash_ring);
+    ot_ring_free(&pipeline->sequence_ring);
+    ot_ring_free(&pipeline->decode_ring);
+    free(pipeline);
+}
+
+void ot_pipeline_submit(ot_pipeline* pipeline, const char* json) {
+    item* it = malloc(sizeof(item));
+    size_t size = strlen(json) + 1;
+    it->json = malloc(size);
+    memcpy(it->json, json, size);
+    it->submitted = ot_now();
+    it->large = size > pipeline->large_bytes;
+    it->op = NULL;
+    it->err = OT_ERR_NONE;
+    it->has_sender = false;
+    it->sender = 0;
+    it->resume = false;
+    it->unhashed = false;
+    it->text = NULL;
+    it->index = 0;
+
+    ot_mutex_lock(&pipeline->lock);
+    ++pipeline->submitted;
+    ot_mutex_unlock(&pipeline->lock);
+
+    if (!pipeline->threaded) {
+        decode_item(pipeline, it);
+        sequence_item(pipeline, it);
+        hash_item(pipeline, it);
+        encode_item(pipeline, it);
+        return;
+    }
+
+    ot_ring_push(&pipeline->decode_ring, it);
+}
+
+void ot_pipeline_drain(ot_pipeline* pipeline) {
+    ot_mutex_lock(&pipeline->lock);
+    while (pipeline->threaded &&
+           pipeline->stats.messages != pipeline->submitted) {
+        ot_cond_wait(&pipeline->drained, &pipeline->lock);
+    }
+    ot_mutex_unlock(&pipeline->lock);
+}
+
+void ot_pipeline_get_stats(ot_pipeline* pipeline, ot_pipeline_stats* stats) {
+    ot_mutex_lock(&pipeline->lock);
+    memcpy(stats, &pipeline->stats, sizeof(ot_pipeline_stats));
+    ot_mutex_unlock(&pipeline->lock);
+}
@@ -0,0 +1,164 @@
+#ifndef LIBOT_PIPELINE_H
+#define LIBOT_PIPELINE_H
+
+#include <stdint.h>
+#include "hasher.h"
+#include "latency.h"
+#include "ring.h"
+#include "server.h"
+#include "thread.h"
+
+// A pipeline splits a server's receive path into three stages which run on
+// their own threads:
+//
+//     decode -> sequence (transform and append) -> encode and send
+//
+// Only the sequencer touches the document, so decoding the next message and
+// encoding the previous result overlap with transforming and appending the
+// current one. The stages are connected by bounded rings, so a slow stage
+// eventually blocks ot_pipeline_submit instead of letting messages pile up.
+// Each stage is a single thread, so messages are sent in the order they were
+// submitted.
+//
+// Large messages (such as a big paste) take much longer to decode, transform
+// and append than keystrokes, so the decoder sets them aside and lets small
+// messages queued behind them overtake them. A large message is processed once
+// the decoder runs out of small ones, or once max_overtakes small ones have
+// overtaken it, so it's delayed by a bounded amount. Only messages from
+// different clients are reordered, since a client doesn't send its next op
+// until its last one is acknowledged.
+//
+// Hashing an appended op reads the whole document's text, so for a large
+// document it dominates the sequencer's time. If defer_hash is set, a fourth
+// stage is added between the sequencer and the encoder:
+//
+//     decode -> sequence -> hash -> encode and send
+//
+// The sequencer appends each op without its hash and hands the op to the
+// hasher, which applies it to its own copy of the document's text, so the
+// sequencer never reads the text and can transform and append the next op
+// while the last one is hashed. The hasher computes hashes in order, and ops are only
+// acknowledged and broadcast once their hash is known. The sequencer stores
+// finished hashes in the document before each op, which is enough for clients'
+// ops to find their parents since a client only sees a hash once it's sent.
+// Until then, an op that's based on the latest hash that was sent is
+// transformed against the unhashed ops after it rather than appended directly.
+//
+// Messages are decoded the way ot_server_receive decodes them, so resume
+// requests are answered with a catch-up (which needs send_to). The catch-up is
+// sent by the encoder along with everything else, and since it reads the
+// document, the sequencer waits for it before sequencing the next message.
+// Resumes are rare, so the stall is cheap.
+//
+// If LIBOT_NO_THREADS is defined or the stages can't be started, each message
+// runs through every stage on the submitting thread, in order.
+//
+// While a pipeline is running, the server's document must not be used by
+// anything else, except that if publish is set, the sequencer publishes the
+// document's state after each message (see ot_doc_publish) and other threads
+// may read it with ot_doc_acquire. With defer_hash, an op's state is published
+// once its hash has been stored, which happens before the next message is
+// sequenced or when the pipeline is freed.
+
+typedef struct ot_pipeline_opts {
+    // Number of messages each ring can hold. 0 uses a default.
+    size_t capacity;
+
+    // Size in bytes above which a message is large. 0 uses a default.
+    size_t large_bytes;
+
+    // Number of small messages that can overtake a large one. 0 uses a
+    // default.
+    size_t max_overtakes;
+
+    // Computes hashes on their own thread.
+    bool defer_hash;
+
+    // Publishes versions of the document for other threads to read.
+    bool publish;
+} ot_pipeline_opts;
+
+typedef struct ot_pipeline_stats {
+    uint64_t messages;
+
+    // Time spent working in each stage.
+    ot_latency decode;
+    ot_latency sequence;
+    ot_latency hash;
+    ot_latency encode;
+
+    // Time from a message being submitted to its result being sent, including
+    // time spent waiting between stages.
+    ot_latency total;
+
+    // The total time of small and large messages.
+    ot_latency small;
+    ot_latency large;
+} ot_pipeline_stats;
+
+typedef struct ot_pipeline {
+    ot_server* server;
+    bool threaded;
+
+    ot_ring decode_ring;
+    ot_ring sequence_ring;
+    ot_ring hash_ring;
+    ot_ring encode_ring;
+    ot_thread decoder;
+    ot_thread sequencer;
+    ot_thread hasher;
+    ot_thread encoder;
+
+    // Hashes computed by the hasher are queued in hashes until the sequencer
+    // stores them in the document. hashed is signaled whenever one is added.
+    bool defer_hash;
+    ot_mutex hash_lock;
+    ot_cond hashed;
+    array hashes;
+
+    bool publish;
+
+    // The document's text as of the last op that the hasher hashed. Only the
+    // hasher uses it once the pipeline is running.
+    ot_hasher text;
+
+    // Position + 1 and hash of the last op that the hasher hashed, or 0.
+    size_t last_hashed;
+    char last_hash[20];
+
+    ot_mutex lock;
+    ot_cond drained;
+    uint64_t submitted;
+
+    // Set while the encoder answers a resume request, which reads the
+    // document, so the sequencer waits on caught_up until it's cleared.
+    bool catching_up;
+    ot_cond caught_up;
+
+    // Each stage only writes to its own histogram. The other fields are
+    // written by the encoder while holding lock.
+    ot_pipeline_stats stats;
+
+    size_t large_bytes;
+    size_t max_overtakes;
+} ot_pipeline;
+
+// Creates a pipeline for a server. The server isn't owned by the pipeline, but
+// it must outlive it.
+ot_pipeline* ot_new_pipeline(ot_server* server, const ot_pipeline_opts* opts);
+
+// Processes any pending messages, stops the stages and frees the pipeline.
+void ot_free_pipeline(ot_pipeline* pipeline);
+
+// Queues a received message. This must only be called from one thread at a
+// time.
+void ot_pipeline_submit(ot_pipeline* pipeline, const char* json);
+
+// Blocks until every submitted message has been sent.
+void ot_pipeline_drain(ot_pipeline* pipeline);
+
+// Copies the pipeline's statistics. The pipeline should be drained first,
+// otherwise the histograms may be read while they're being updated.
+void ot_pipeline_get_stats(ot_pipeline* pipeline, ot_pipeline_stats* stats);
+
+#endif
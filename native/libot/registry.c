@@ -0,0 +1,738 @@
+#include <stdio.h>
+#include "registry.h"
+#include "hex.h"
+#include "log.h"
+
+#define INITIAL_CAP 16
+
+// FNV-1a hash of a NUL-terminated string.
+static uint32_t hash_id(const char* id) {
+    uint32_t hash = 2166136261u;
+    for (const char* c = id; *c != '\0'; ++c) {
+        hash ^= (uint8_t)*c;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static ot_registry_entry** find_slot(const ot_registry* registry,
+                                     const char* doc_id, uint32_t hash) {
+    ot_registry_entry** slot = registry->buckets + (hash & (registry->cap - 1));
+    while (*slot != NULL) {
+        ot_registry_entry* entry = *slot;
+        if (entry->hash == hash && strcmp(entry->id, doc_id) == 0) {
+            break;
+        }
+        slot = &entry->next;
+    }
+
+    return slot;
+}
+
+// Doubles the number of buckets and rehashes every entry into them.
+static void grow(ot_registry* registry) {
+    size_t cap = registry->cap * 2;
+    ot_registry_entry** buckets = calloc(cap, sizeof(ot_registry_entry*));
+    if (buckets == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < registry->cap; ++i) {
+        ot_registry_entry* entry = registry->buckets[i];
+        while (entry != NULL) {
+            ot_registry_entry* next = entry->next;
+            size_t j = entry->hash & (cap - 1);
+            entry->next = buckets[j];
+            buckets[j] = entry;
+            entry = next;
+        }
+    }
+
+    free(registry->buckets);
+    registry->buckets = buckets;
+    registry->cap = cap;
+}
+
+// Returns the entry for the given ID, creating an empty one if it doesn't
+// exist.
+static ot_registry_entry* get_or_add(ot_registry* registry,
+                                     const char* doc_id) {
+    uint32_t hash = hash_id(doc_id);
+    ot_registry_entry** slot = find_slot(registry, doc_id, hash);
+    if (*slot != NULL) {
+        return *slot;
+    }
+
+    size_t id_size = strlen(doc_id) + 1;
+    ot_registry_entry* entry = malloc(sizeof(ot_registry_entry) + id_size);
+    entry->next = NULL;
+    entry->hash = hash;
+    entry->doc = NULL;
+    entry->server = NULL;
+    entry->prev_held = NULL;
+    entry->next_held = NULL;
+    entry->actor = NULL;
+    entry->used = ot_now();
+    entry->evicted = false;
+    entry->older = NULL;
+    entry->newer = NULL;
+    memcpy(entry->id, doc_id, id_size);
+
+    *slot = entry;
+    ++registry->len;
+
+    // Keep the load factor under 3/4 so that chains stay short.
+    if (registry->len * 4 > registry->cap * 3) {
+        grow(registry);
+    }
+
+    return entry;
+}
+
+// Removes entry from the list of documents in memory, if it's in it.
+static void unlink_used(ot_registry* registry, ot_registry_entry* entry) {
+    if (entry->older != NULL) {
+        entry->older->newer = entry->newer;
+    } else if (registry->oldest == entry) {
+        registry->oldest = entry->newer;
+    } else {
+        return;
+    }
+
+    if (entry->newer != NULL) {
+        entry->newer->older = entry->older;
+    } else {
+        registry->newest = entry->older;
+    }
+    entry->older = NULL;
+    entry->newer = NULL;
+}
+
+// Adds entry to the list of documents in memory as the most recently used.
+static void link_newest(ot_registry* registry, ot_registry_entry* entry) {
+    entry->older = registry->newest;
+    entry->newer = NULL;
+    if (registry->newest != NULL) {
+        registry->newest->newer = entry;
+    } else {
+        registry->oldest = entry;
+    }
+    registry->newest = entry;
+}
+
+// Returns whether a server is holding ops that haven't been sent yet.
+static bool holds_ops(const ot_server* server) {
+    return server->window.ops.len > 0 || server->unsynced.len > 0;
+}
+
+// Adds entry to the list of documents whose servers are holding ops, or
+// removes it once its server has sent them.
+static void update_held(ot_registry* registry, ot_registry_entry* entry) {
+    bool holds = entry->server != NULL && holds_ops(entry->server);
+
+    ot_mutex_lock(&registry->held_lock);
+    bool listed = entry->prev_held != NULL || registry->held == entry;
+    if (holds && !listed) {
+        entry->next_held = registry->held;
+        if (registry->held != NULL) {
+            registry->held->prev_held = entry;
+        }
+        registry->held = entry;
+    } else if (!holds && listed) {
+        if (entry->prev_held != NULL) {
+            entry->prev_held->next_held = entry->next_held;
+        } else {
+            registry->held = entry->next_held;
+        }
+        if (entry->next_held != NULL) {
+            entry->next_held->prev_held = entry->prev_held;
+        }
+        entry->prev_held = NULL;
+        entry->next_held = NULL;
+    }
+    ot_mutex_unlock(&registry->held_lock);
+}
+
+// Returns the document's server, creating it the first time it's needed.
+static ot_server* entry_server(ot_registry* registry,
+                               ot_registry_entry* entry) {
+    if (entry->server == NULL) {
+        ot_server* server = ot_new_server(NULL, registry->event);
+        server->id = entry->id;
+        server->route = registry->route;
+        server->route_to = registry->route_to;
+        server->wal = registry->wal;
+        if (registry->setup != NULL) {
+            registry->setup(entry->id, server);
+        }
+        entry->server = server;
+    }
+
+    entry->server->doc = entry->doc;
+    return entry->server;
+}
+
+// Frees the document's server after sending whatever it's holding. The
+// document itself stays in the entry.
+static void release_server(ot_registry* registry, ot_registry_entry* entry) {
+    if (entry->server == NULL) {
+        return;
+    }
+
+    ot_server_sync(entry->server);
+    entry->server->doc = NULL;
+    ot_free_server(entry->server);
+    entry->server = NULL;
+    update_held(registry, entry);
+}
+
+// Returns the path that the document with the given ID is evicted to, which the
+// caller must free. IDs can contain anything, so the file is named after the
+// ID's SHA-1.
+static char* evict_path(const ot_registry* registry, const char* doc_id) {
+    char hash[20];
+    hash_text(doc_id, hash);
+    char hex[41] = { 0 };
+    atohex(hex, hash, 20);
+
+    size_t size = strlen(registry->evict_dir) + sizeof("/.json") + 40;
+    char* path = malloc(size);
+    snprintf(path, size, "%s/%s.json", registry->evict_dir, hex);
+    return path;
+}
+
+// Writes data to path. It's written to a temporary file first, so a failed
+// write never leaves a truncated file behind.
+static bool write_file(const char* path, const char* data) {
+    size_t tmp_size = strlen(path) + sizeof(".tmp");
+    char* tmp = malloc(tmp_size);
+    snprintf(tmp, tmp_size, "%s.tmp", path);
+
+    bool ok = false;
+    FILE* file = fopen(tmp, "wb");
+    if (file != NULL) {
+        size_t len = strlen(data);
+        ok = fwrite(data, 1, len, file) == len;
+        ok = (fclose(file) == 0) && ok;
+        ok = ok && rename(tmp, path) == 0;
+        if (!ok) {
+            remove(tmp);
+        }
+    }
+
+    free(tmp);
+    return ok;
+}
+
+// Reads a whole file into a NUL-terminated string, or returns NULL if it can't
+// be read.
+static char* read_file(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    char* data = NULL;
+    long size = -1;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        size = ftell(file);
+    }
+    if (size >= 0 && fseek(file, 0, SEEK_SET) == 0) {
+        data = malloc((size_t)size + 1);
+        if (fread(data, 1, (size_t)size, file) != (size_t)size) {
+            free(data);
+            data = NULL;
+        } else {
+            data[size] = '\0';
+        }
+    }
+
+    fclose(file);
+    return data;
+}
+
+// Deletes an evicted document's file.
+static void forget_evicted(const ot_registry* registry,
+                           ot_registry_entry* entry) {
+    if (!entry->evicted) {
+        return;
+    }
+
+    char* path = evict_path(registry, entry->id);
+    remove(path);
+    free(path);
+    entry->evicted = false;
+}
+
+static bool evict(ot_registry* registry, ot_registry_entry* entry) {
+    release_server(registry, entry);
+
+    char* path = evict_path(registry, entry->id);
+    char* enc = ot_encode_doc_state(entry->doc);
+    bool ok = write_file(path, enc);
+    free(enc);
+    free(path);
+
+    if (!ok) {
+        OT_LOG(OT_LOG_ERROR, OT_ERR_NONE,
+               "Couldn't evict a document to disk.\n\tDocument: %s",
+               entry->id);
+        return false;
+    }
+
+    ot_free_doc(entry->doc);
+    entry->doc = NULL;
+    entry->evicted = true;
+    unlink_used(registry, entry);
+    ++registry->stats.evictions;
+    return true;
+}
+
+static bool reload(ot_registry* registry, ot_registry_entry* entry) {
+    double start = ot_now();
+
+    char* path = evict_path(registry, entry->id);
+    char* data = read_file(path);
+    ot_err err = OT_ERR_RELOAD_FAILED;
+    ot_doc* doc = NULL;
+    if (data != NULL) {
+        doc = ot_new_doc();
+        err = ot_decode_doc_state(doc, data);
+        free(data);
+    }
+
+    if (err != OT_ERR_NONE) {
+        OT_LOG(OT_LOG_ERROR, OT_ERR_RELOAD_FAILED,
+               "Couldn't reload an evicted document.\n\tDocument: %s\n\t"
+               "Path: %s",
+               entry->id, path);
+        if (doc != NULL) {
+            ot_free_doc(doc);
+        }
+        free(path);
+        return false;
+    }
+
+    remove(path);
+    free(path);
+    entry->doc = doc;
+    entry->evicted = false;
+    ot_latency_record(&registry->stats.reload, ot_now() - start);
+    return true;
+}
+
+// Marks a document as used, reloading it if it was evicted. Returns false if
+// it couldn't be reloaded.
+static bool use(ot_registry* registry, ot_registry_entry* entry) {
+    entry->used = ot_now();
+    if (!entry->evicted) {
+        __atomic_add_fetch(&registry->stats.hits, 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_add_fetch(&registry->stats.misses, 1, __ATOMIC_RELAXED);
+        if (!reload(registry, entry)) {
+            return false;
+        }
+    }
+
+    // Eviction can't be enabled under a runtime, so the list is only touched
+    // by one thread.
+    if (registry->evict_dir != NULL) {
+        unlink_used(registry, entry);
+        link_newest(registry, entry);
+    }
+    return true;
+}
+
+ot_registry* ot_new_registry(ot_route_func route, ot_event_func event) {
+    ot_registry* registry = malloc(sizeof(ot_registry));
+    registry->route = route;
+    registry->event = event;
+    registry->buckets = calloc(INITIAL_CAP, sizeof(ot_registry_entry*));
+    registry->cap = INITIAL_CAP;
+    registry->len = 0;
+    registry->evict_dir = NULL;
+    registry->idle_secs = 0;
+    registry->oldest = NULL;
+    registry->newest = NULL;
+    registry->wal = NULL;
+    registry->route_to = NULL;
+    registry->setup = NULL;
+    ot_mutex_init(&registry->held_lock);
+    registry->held = NULL;
+    memset(&registry->stats, 0, sizeof(ot_registry_stats));
+    ot_latency_init(&registry->stats.reload);
+
+    return registry;
+}
+
+void ot_free_registry(ot_registry* registry) {
+    for (size_t i = 0; i < registry->cap; ++i) {
+        ot_registry_entry* entry = registry->buckets[i];
+        while (entry != NULL) {
+            ot_registry_entry* next = entry->next;
+            release_server(registry, entry);
+            if (entry->doc != NULL) {
+                ot_free_doc(entry->doc);
+            }
+            forget_evicted(registry, entry);
+            free(entry);
+            entry = next;
+        }
+    }
+
+    ot_mutex_destroy(&registry->held_lock);
+    free(registry->buckets);
+    free(registry->evict_dir);
+    free(registry);
+}
+
+void ot_registry_open(ot_registry* registry, const char* doc_id, ot_doc* doc) {
+    ot_registry_entry* entry = get_or_add(registry, doc_id);
+    if (entry->doc != doc) {
+        release_server(registry, entry);
+    }
+    if (entry->doc != NULL && entry->doc != doc) {
+        ot_free_doc(entry->doc);
+    }
+    forget_evicted(registry, entry);
+    entry->doc = doc;
+    entry->used = ot_now();
+    if (registry->evict_dir != NULL) {
+        unlink_used(registry, entry);
+        link_newest(registry, entry);
+    }
+}
+
+bool ot_registry_close(ot_registry* registry, const char* doc_id) {
+    ot_registry_entry** slot = find_slot(registry, doc_id, hash_id(doc_id));
+    ot_registry_entry* entry = *slot;
+    if (entry == NULL) {
+        return false;
+    }
+
+    *slot = entry->next;
+    --registry->len;
+    unlink_used(registry, entry);
+    release_server(registry, entry);
+    if (entry->doc != NULL) {
+        ot_free_doc(entry->doc);
+    }
+    forget_evicted(registry, entry);
+    free(entry);
+
+    return true;
+}
+
+ot_doc* ot_registry_get(ot_registry* registry, const char* doc_id) {
+    ot_registry_entry* entry = *find_slot(registry, doc_id, hash_id(doc_id));
+    if (entry == NULL || !use(registry, entry)) {
+        return NULL;
+    }
+
+    return entry->doc;
+}
+
+bool ot_registry_contains(const ot_registry* registry, const char* doc_id) {
+    return *find_slot(registry, doc_id, hash_id(doc_id)) != NULL;
+}
+
+ot_registry_entry* ot_registry_lookup(ot_registry* registry, const char* doc_id,
+                                      bool create) {
+    if (create) {
+        return get_or_add(registry, doc_id);
+    }
+
+    return *find_slot(registry, doc_id, hash_id(doc_id));
+}
+
+// Picks up the document that the server may have created after it received a
+// message. Ops that the server is holding back stay with it until the document
+// is flushed, so receiving never waits for the write-ahead log.
+static void received(ot_registry* registry, ot_registry_entry* entry,
+                     ot_server* server) {
+    entry->doc = server->doc;
+    update_held(registry, entry);
+}
+
+static void receive_op(ot_registry* registry, ot_registry_entry* entry,
+                       ot_op* op) {
+    ot_server* server = entry_server(registry, entry);
+    ot_server_receive_op(server, op);
+    received(registry, entry, server);
+}
+
+static void send_err(ot_registry* registry, const char* doc_id, ot_err err) {
+    char* enc = ot_encode_err(err);
+    registry->route(doc_id, enc);
+    free(enc);
+}
+
+static void route_err(ot_registry* registry, const char* doc_id, ot_err err,
+                      const char* json) {
+    OT_LOG(OT_LOG_ERROR, err,
+           "Couldn't decode the received operation.\n\tJSON: %s", json);
+    send_err(registry, doc_id, err);
+}
+
+// Receives op once its document is in memory. If the document can't be
+// reloaded, the op is dropped and its sender is sent an error.
+static void receive_loaded(ot_registry* registry, ot_registry_entry* entry,
+                           ot_op* op) {
+    if (!use(registry, entry)) {
+        send_err(registry, entry->id, OT_ERR_RELOAD_FAILED);
+        ot_free_op(op);
+        return;
+    }
+
+    receive_op(registry, entry, op);
+}
+
+// Passes a whole message to the document's server, which answers resume
+// requests as well as receiving ops.
+static void receive_message(ot_registry* registry, ot_registry_entry* entry,
+                            const char* json) {
+    if (!use(registry, entry)) {
+        send_err(registry, entry->id, OT_ERR_RELOAD_FAILED);
+        return;
+    }
+
+    ot_server* server = entry_server(registry, entry);
+    ot_server_receive(server, json);
+    received(registry, entry, server);
+}
+
+// Returns the document ID of a resume request, which the caller must free, or
+// NULL if json isn't a resume request with an ID.
+static char* resume_doc_id(const char* json) {
+    char hash[20];
+    uint32_t client_id;
+    if (ot_decode_resume(hash, &client_id, json) != OT_ERR_NONE) {
+        return NULL;
+    }
+
+    cJSON* root = cJSON_Parse(json);
+    cJSON* doc_idf = cJSON_GetObjectItem(root, "docId");
+    char* doc_id = NULL;
+    if (doc_idf != NULL && doc_idf->type == cJSON_String) {
+        size_t size = strlen(doc_idf->valuestring) + 1;
+        doc_id = malloc(size);
+        memcpy(doc_id, doc_idf->valuestring, size);
+    }
+
+    cJSON_Delete(root);
+    return doc_id;
+}
+
+void ot_registry_receive(ot_registry* registry, const char* json) {
+    OT_LOG(OT_LOG_DEBUG, OT_ERR_NONE, "Received message.\n\tJSON: %s", json);
+
+    // The document is found from the op's header, and the components are only
+    // decoded once it's known where they're going. IDs with escapes need a
+    // full decode to be unescaped.
+    ot_header header;
+    ot_err err = ot_decode_header(&header, json);
+    if (err == OT_ERR_NONE && header.doc_id == NULL) {
+        err = OT_ERR_DOC_ID_MISSING;
+    }
+
+    ot_op* op = ot_new_op();
+    char* doc_id = NULL;
+    if (err == OT_ERR_NONE && header.doc_id_escaped) {
+        err = ot_decode_tagged(op, &doc_id, json);
+    } else if (err == OT_ERR_NONE) {
+        doc_id = malloc(header.doc_id_len + 1);
+        memcpy(doc_id, header.doc_id, header.doc_id_len);
+        doc_id[header.doc_id_len] = '\0';
+        err = ot_decode_body(op, &header);
+    }
+    if (err != OT_ERR_NONE) {
+        free(doc_id);
+        ot_free_op(op);
+
+        // Resume requests aren't ops, so they're only looked for once the
+        // message couldn't be decoded as one.
+        char* resume_id = resume_doc_id(json);
+        if (resume_id == NULL) {
+            route_err(registry, NULL, err, json);
+            return;
+        }
+
+        ot_registry_entry* entry = get_or_add(registry, resume_id);
+        free(resume_id);
+        receive_message(registry, entry, json);
+        return;
+    }
+
+    ot_registry_entry* entry = get_or_add(registry, doc_id);
+    free(doc_id);
+    receive_loaded(registry, entry, op);
+}
+
+void ot_registry_receive_entry(ot_registry* registry, ot_registry_entry* entry,
+                               const char* json) {
+    receive_message(registry, entry, json);
+}
+
+static int compare_used(const void* a, const void* b) {
+    double x = (*(ot_registry_entry* const*)a)->used;
+    double y = (*(ot_registry_entry* const*)b)->used;
+    return (x > y) - (x < y);
+}
+
+// Builds the list of documents in memory from every entry that isn't evicted,
+// in the order they were last used.
+static void list_used(ot_registry* registry) {
+    ot_registry_entry** entries = malloc(sizeof(ot_registry_entry*) *
+                                         (registry->len + 1));
+    size_t len = 0;
+    for (size_t i = 0; i < registry->cap; ++i) {
+        for (ot_registry_entry* entry = registry->buckets[i]; entry != NULL;
+             entry = entry->next) {
+            if (!entry->evicted) {
+                entries[len++] = entry;
+            }
+        }
+    }
+
+    qsort(entries, len, sizeof(ot_registry_entry*), compare_used);
+    for (size_t i = 0; i < len; ++i) {
+        link_newest(registry, entries[i]);
+    }
+    free(entries);
+}
+
+void ot_registry_set_eviction(ot_registry* registry, const char* dir,
+                              double idle_secs) {
+    if (registry->evict_dir != NULL) {
+        for (size_t i = 0; i < registry->cap; ++i) {
+            for (ot_registry_entry* entry = registry->buckets[i];
+                 entry != NULL; entry = entry->next) {
+                if (entry->evicted) {
+                    reload(registry, entry);
+                }
+                entry->older = NULL;
+                entry->newer = NULL;
+            }
+        }
+        registry->oldest = NULL;
+        registry->newest = NULL;
+        free(registry->evict_dir);
+        registry->evict_dir = NULL;
+    }
+
+    if (dir != NULL) {
+        size_t size = strlen(dir) + 1;
+        registry->evict_dir = malloc(size);
+        memcpy(registry->evict_dir, dir, size);
+        list_used(registry);
+    }
+    registry->idle_secs = idle_secs;
+}
+
+size_t ot_registry_evict_idle(ot_registry* registry) {
+    if (registry->evict_dir == NULL) {
+        return 0;
+    }
+
+    // The list is in the order documents were last used, so the sweep stops at
+    // the first one that isn't idle.
+    double now = ot_now();
+    size_t evicted = 0;
+    ot_registry_entry* entry = registry->oldest;
+    while (entry != NULL && now - entry->used >= registry->idle_secs) {
+        ot_registry_entry* newer = entry->newer;
+        if (entry->doc != NULL && evict(registry, entry)) {
+            ++evicted;
+        }
+        entry = newer;
+    }
+
+    return evicted;
+}
+
+double ot_registry_hit_rate(const ot_registry* registry) {
+    uint64_t uses = registry->stats.hits + registry->stats.misses;
+    if (uses == 0) {
+        return 1;
+    }
+
+    return (double)registry->stats.hits / (double)uses;
+}
+
+void ot_registry_set_wal(ot_registry* registry, ot_wal* wal) {
+    registry->wal = wal;
+    for (size_t i = 0; i < registry->cap; ++i) {
+        for (ot_registry_entry* entry = registry->buckets[i]; entry != NULL;
+             entry = entry->next) {
+            if (entry->server != NULL) {
+                ot_server_set_wal(entry->server, wal);
+                update_held(registry, entry);
+            }
+        }
+    }
+}
+
+void ot_registry_set_setup(ot_registry* registry, ot_server_setup_func setup) {
+    registry->setup = setup;
+}
+
+void ot_registry_set_route_to(ot_registry* registry,
+                              ot_route_to_func route_to) {
+    registry->route_to = route_to;
+}
+
+ot_server* ot_registry_server(ot_registry* registry, const char* doc_id) {
+    ot_registry_entry* entry = *find_slot(registry, doc_id, hash_id(doc_id));
+    if (entry == NULL || !use(registry, entry)) {
+        return NULL;
+    }
+
+    return entry_server(registry, entry);
+}
+
+void ot_registry_flush(ot_registry* registry) {
+    // Flushing a document only ever removes it from the list.
+    ot_registry_entry* entry = registry->held;
+    while (entry != NULL) {
+        ot_registry_entry* next = entry->next_held;
+        ot_server_flush(entry->server);
+        update_held(registry, entry);
+        entry = next;
+    }
+}
+
+void ot_registry_flush_entry(ot_registry* registry, ot_registry_entry* entry) {
+    if (entry->server != NULL) {
+        ot_server_sync(entry->server);
+        update_held(registry, entry);
+    }
+}
+
+// Appends a logged op to its document while recovering.
+static ot_err recover_op(void* arg, const char* doc_id, ot_op* op) {
+    ot_registry* registry = arg;
+    ot_registry_entry* entry = get_or_add(registry, doc_id);
+    if (!use(registry, entry)) {
+        ot_free_op(op);
+        return OT_ERR_RELOAD_FAILED;
+    }
+    if (entry->doc == NULL) {
+        entry->doc = ot_new_doc();
+    }
+
+    char hash[20];
+    memcpy(hash, op->hash, 20);
+    ot_err err = ot_doc_append(entry->doc, &op);
+    if (err != OT_ERR_NONE) {
+        ot_free_op(op);
+        return err;
+    }
+
+    return (memcmp(hash, op->hash, 20) == 0) ? OT_ERR_NONE
+                                             : OT_ERR_HASH_MISMATCH;
+}
+
+ot_err ot_registry_recover(ot_registry* registry, const char* path) {
+    return ot_wal_replay(path, recover_op, registry);
+}
@@ -0,0 +1,225 @@
+#ifndef LIBOT_REGISTRY_H
+#define LIBOT_REGISTRY_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "doc.h"
+#include "decode.h"
+#include "encode.h"
+#include "latency.h"
+#include "server.h"
+#include "thread.h"
+
+// A registry hosts many documents in a single server. Received messages must
+// have a "docId" field, which is used to find the document they apply to, and
+// outgoing messages are passed to the route function along with the ID of the
+// document they're about.
+//
+// Each document gets its own server the first time it's sent a message, so
+// every server feature (such as dedup, the bridge cache and broadcast windows)
+// works per document. The setup function configures each new server, and
+// setting route_to lets the servers address single clients, which
+// acknowledgements, resume requests, outbox limits and windows need. A
+// document's server is freed along with the document when it's evicted or
+// closed.
+//
+// Documents are kept in a hash table with separate chaining. An open document
+// costs one entry (a next pointer, the ID's hash, the document, server and
+// actor pointers, when it was last used, its place in the eviction and flush
+// lists and the ID itself) on top of the document and its server. Entries
+// never move once they're created, so pointers to them stay valid until the
+// document is closed.
+//
+// Most documents are idle most of the time, but their histories still take up
+// memory. When eviction is enabled, ot_registry_evict_idle writes documents that
+// haven't been used for a while to disk and frees them, leaving only their
+// entries. Documents in memory are kept in least recently used order, so only
+// the documents that are actually idle are visited. An evicted document is read
+// back the next time it receives a message or is fetched with
+// ot_registry_get. Eviction isn't synchronized, so it can't be used while the
+// registry is hosted by a runtime.
+
+struct ot_actor;
+
+// Configures the server of the document with the given ID when it's created,
+// e.g., by enabling dedup or a broadcast window. Under a runtime, it's called
+// from the worker that processes the document.
+typedef void (*ot_server_setup_func)(const char* doc_id, ot_server* server);
+
+typedef struct ot_registry_entry {
+    struct ot_registry_entry* next;
+    uint32_t hash;
+    ot_doc* doc;
+
+    // The document's server, or NULL if it hasn't been sent a message since it
+    // was opened or reloaded. The server's document is always doc.
+    ot_server* server;
+
+    // Neighbours in the registry's list of documents whose servers are holding
+    // ops, which ot_registry_flush sends.
+    struct ot_registry_entry* prev_held;
+    struct ot_registry_entry* next_held;
+
+    // State used by an ot_runtime hosting the registry, or NULL.
+    struct ot_actor* actor;
+
+    // When the document was last used, as returned by ot_now.
+    double used;
+
+    // Set while the document is on disk, in which case doc is NULL.
+    bool evicted;
+
+    // Neighbours in the registry's list of documents in memory, which runs
+    // from the least to the most recently used. The list is only kept while
+    // eviction is enabled.
+    struct ot_registry_entry* older;
+    struct ot_registry_entry* newer;
+
+    char id[];
+} ot_registry_entry;
+
+typedef struct ot_registry_stats {
+    // Number of times a document was used while it was in memory, and while it
+    // was evicted and had to be reloaded. A runtime's workers share the
+    // counters, so they're updated atomically.
+    uint64_t hits;
+    uint64_t misses;
+
+    uint64_t evictions;
+
+    // Time taken to read and decode each reloaded document.
+    ot_latency reload;
+} ot_registry_stats;
+
+typedef struct ot_registry {
+    ot_route_func route;
+    ot_event_func event;
+    ot_route_to_func route_to;
+    ot_server_setup_func setup;
+
+    // Buckets of the hash table. The number of buckets is always a power of
+    // two.
+    ot_registry_entry** buckets;
+    size_t cap;
+    size_t len;
+
+    // Directory that documents are evicted to, or NULL if eviction is
+    // disabled, and how long a document has to be unused to be evicted.
+    char* evict_dir;
+    double idle_secs;
+
+    // Ends of the list of documents in memory, while eviction is enabled.
+    ot_registry_entry* oldest;
+    ot_registry_entry* newest;
+
+    ot_registry_stats stats;
+
+    // Write-ahead log shared by every document, or NULL.
+    ot_wal* wal;
+
+    // First document whose server is holding ops. The list is guarded by
+    // held_lock, since a runtime's workers add to it.
+    ot_mutex held_lock;
+    ot_registry_entry* held;
+} ot_registry;
+
+ot_registry* ot_new_registry(ot_route_func route, ot_event_func event);
+
+// Frees the registry along with every document in it.
+void ot_free_registry(ot_registry* registry);
+
+// Opens a document under the given ID. The registry takes ownership of doc. If
+// a document is already open under the ID, it's freed and replaced.
+void ot_registry_open(ot_registry* registry, const char* doc_id, ot_doc* doc);
+
+// Sets the function that configures each document's server when it's created.
+// Servers that already exist keep their settings.
+void ot_registry_set_setup(ot_registry* registry, ot_server_setup_func setup);
+
+// Sends messages to the listed clients of a document with route_to instead of
+// passing them to route, so that documents' servers can acknowledge ops,
+// answer resume requests and use outbox limits and broadcast windows (see
+// ot_server_set_send_to). Passing NULL goes back to route. Servers that already
+// exist keep sending the way they did.
+void ot_registry_set_route_to(ot_registry* registry, ot_route_to_func route_to);
+
+// Returns the server of the document with the given ID, creating it if needed,
+// e.g., to track a client's queue with ot_server_connect. Returns NULL if no
+// document is open under the ID or it couldn't be reloaded.
+ot_server* ot_registry_server(ot_registry* registry, const char* doc_id);
+
+// Sends the ops that documents' servers are holding for a broadcast window, and
+// the ops held for the write-ahead log that have become durable, without
+// waiting for the rest. This should be called periodically (e.g., from a
+// timer) and whenever the log reports a synced group, but it can't be used
+// while the registry is hosted by a runtime, which flushes each document after
+// processing its messages instead.
+void ot_registry_flush(ot_registry* registry);
+
+// Sends everything that the server of the document in entry is holding,
+// waiting for its ops to be durable (see ot_server_sync). This is what a
+// runtime calls after processing a document's batch, since the document's
+// actor may not run again for a while.
+void ot_registry_flush_entry(ot_registry* registry, ot_registry_entry* entry);
+
+// Closes and frees the document with the given ID. Returns false if no such
+// document was open.
+bool ot_registry_close(ot_registry* registry, const char* doc_id);
+
+// Returns the document with the given ID, or NULL if it isn't open. The
+// document may also be NULL if it was opened as NULL and hasn't received any
+// operations yet, or if it was evicted and couldn't be reloaded.
+ot_doc* ot_registry_get(ot_registry* registry, const char* doc_id);
+
+// Returns true if a document is open under the given ID.
+bool ot_registry_contains(const ot_registry* registry, const char* doc_id);
+
+// Returns the entry for the given ID. If no document is open under the ID, then
+// an empty entry is added when create is true, and NULL is returned otherwise.
+// The entry's doc is NULL while it's evicted.
+ot_registry_entry* ot_registry_lookup(ot_registry* registry, const char* doc_id,
+                                      bool create);
+
+// Receives a message tagged with a document ID. A document is created if one
+// isn't already open under the ID.
+void ot_registry_receive(ot_registry* registry, const char* json);
+
+// Receives a message for the document in entry. The message's docId field, if
+// any, is ignored.
+void ot_registry_receive_entry(ot_registry* registry, ot_registry_entry* entry,
+                               const char* json);
+
+// Enables eviction to dir, which must already exist, for documents that have
+// been unused for idle_secs. Passing a NULL dir disables eviction. Documents
+// that were evicted to the old directory are reloaded first.
+void ot_registry_set_eviction(ot_registry* registry, const char* dir,
+                              double idle_secs);
+
+// Evicts every document that hasn't been used for the idle time, and returns
+// how many were evicted. A document stays in memory if it can't be written.
+// This should be called periodically, e.g., from a timer.
+size_t ot_registry_evict_idle(ot_registry* registry);
+
+// Returns the fraction of document uses that didn't need a reload, or 1 if no
+// document has been used.
+double ot_registry_hit_rate(const ot_registry* registry);
+
+// Logs every appended op to a write-ahead log shared by all of the documents,
+// and only sends an op once it's durable (see ot_server_set_wal). Receiving a
+// message never waits for the log. Ops are held by their document's server
+// until ot_registry_flush finds them durable, so the log's synced callback
+// should arrange for it to be called. Under a runtime, each document waits for
+// its ops once per batch, and the ops of documents being processed by
+// different workers are synced together. The registry doesn't own the log.
+// Passing NULL stops logging.
+void ot_registry_set_wal(ot_registry* registry, ot_wal* wal);
+
+// Rebuilds documents from a write-ahead log after a restart, before any
+// messages are received. Each logged op is appended to the document it was
+// logged for, creating it if needed. Returns the append's error if an op
+// can't be appended, or OT_ERR_HASH_MISMATCH if it doesn't produce the hash it
+// was logged with, either of which means the registry didn't start out empty.
+ot_err ot_registry_recover(ot_registry* registry, const char* path);
+
+#endif
@@ -0,0 +1,75 @@
+#include <stdlib.h>
+#include "ring.h"
+
+#ifndef LIBOT_NO_THREADS
+#define CAN_BLOCK true
+#else
+#define CAN_BLOCK false
+#endif
+
+void ot_ring_init(ot_ring* ring, size_t cap) {
+    ring->slots = malloc(sizeof(void*) * cap);
+    ring->cap = cap;
+    ring->head = 0;
+    ring->len = 0;
+    ring->closed = false;
+    ot_mutex_init(&ring->lock);
+    ot_cond_init(&ring->not_empty);
+    ot_cond_init(&ring->not_full);
+}
+
+void ot_ring_free(ot_ring* ring) {
+    ot_cond_destroy(&ring->not_full);
+    ot_cond_destroy(&ring->not_empty);
+    ot_mutex_destroy(&ring->lock);
+    free(ring->slots);
+}
+
+bool ot_ring_push(ot_ring* ring, void* item) {
+    ot_mutex_lock(&ring->lock);
+    while (CAN_BLOCK && ring->len == ring->cap && !ring->closed) {
+        ot_cond_wait(&ring->not_full, &ring->lock);
+    }
+
+    if (ring->closed || ring->len == ring->cap) {
+        ot_mutex_unlock(&ring->lock);
+        return false;
+    }
+
+    ring->slots[(ring->head + ring->len) % ring->cap] = item;
+    ++ring->len;
+    ot_cond_signal(&ring->not_empty);
+    ot_mutex_unlock(&ring->lock);
+
+    return true;
+}
+
+static void* pop(ot_ring* ring, bool block) {
+    ot_mutex_lock(&ring->lock);
+    while (block && ring->len == 0 && !ring->closed) {
+        ot_cond_wait(&ring->not_empty, &ring->lock);
+    }
+
+    void* item = NULL;
+    if (ring->len > 0) {
+        item = ring->slots[ring->head];
+        ring->head = (ring->head + 1) % ring->cap;
+        --ring->len;
+        ot_cond_signal(&ring->not_full);
+    }
+    ot_mutex_unlock(&ring->lock);
+
+    return item;
+}
+
+void* ot_ring_pop(ot_ring* ring) { return pop(ring, CAN_BLOCK); }
+
+void* ot_ring_try_pop(ot_ring* ring) { return pop(ring, false); }
+
+void ot_ring_close(ot_ring* ring) {
+    ot_mutex_lock(&ring->lock);
+    ring->closed = true;
+    ot_cond_broadcast(&ring->not_empty);
+    ot_cond_broadcast(&ring->not_full);
+    ot_mutex_unlock(&ring->lock);
+}
@@ -0,0 +1,45 @@
+#ifndef LIBOT_RING_H
+#define LIBOT_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "thread.h"
+
+// A bounded FIFO of pointers for handing work between threads. Pushing to a
+// full ring blocks until there's room, and popping from an empty ring blocks
+// until something is pushed or the ring is closed.
+//
+// Without threads a full or empty ring can never change while the caller waits
+// on it, so pushes to a full ring and pops from an empty ring fail instead of
+// blocking.
+typedef struct ot_ring {
+    void** slots;
+    size_t cap;
+    size_t head;
+    size_t len;
+    bool closed;
+
+    ot_mutex lock;
+    ot_cond not_empty;
+    ot_cond not_full;
+} ot_ring;
+
+void ot_ring_init(ot_ring* ring, size_t cap);
+void ot_ring_free(ot_ring* ring);
+
+// Adds an item to the back of the ring. Returns false if the ring was closed.
+bool ot_ring_push(ot_ring* ring, void* item);
+
+// Removes the item at the front of the ring. Returns NULL once the ring has
+// been closed and emptied.
+void* ot_ring_pop(ot_ring* ring);
+
+// Removes the item at the front of the ring without waiting. Returns NULL if
+// the ring is empty.
+void* ot_ring_try_pop(ot_ring* ring);
+
+// Closes the ring. Items already in the ring can still be popped, but pushes
+// will fail.
+void ot_ring_close(ot_ring* ring);
+
+#endif
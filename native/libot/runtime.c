@@ -0,0 +1,343 @@
+#include "runtime.h"
+
+// Maximum number of messages a worker processes from one document before
+// moving on to the next scheduled document.
+#define BATCH 64
+
+static void inbox_init(ot_inbox* inbox) {
+    inbox->stub.next = NULL;
+    inbox->head = &inbox->stub;
+    inbox->tail = &inbox->stub;
+}
+
+static void inbox_push(ot_inbox* inbox, ot_actor_msg* msg) {
+    __atomic_store_n(&msg->next, NULL, __ATOMIC_RELAXED);
+    ot_actor_msg* prev =
+        __atomic_exchange_n(&inbox->head, msg, __ATOMIC_ACQ_REL);
+
+    // Between the exchange and this store, the queue is briefly disconnected.
+    // The consumer treats that as empty and the producer reschedules the actor
+    // once it's done pushing.
+    __atomic_store_n(&prev->next, msg, __ATOMIC_RELEASE);
+}
+
+// Removes the oldest message from the inbox. Only the thread processing the
+// actor may call this.
+static ot_actor_msg* inbox_pop(ot_inbox* inbox) {
+    ot_actor_msg* tail = inbox->tail;
+    ot_actor_msg* next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (tail == &inbox->stub) {
+        if (next == NULL) {
+            return NULL;
+        }
+
+        inbox->tail = next;
+        tail = next;
+        next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    }
+
+    if (next != NULL) {
+        inbox->tail = next;
+        return tail;
+    }
+
+    ot_actor_msg* head = __atomic_load_n(&inbox->head, __ATOMIC_ACQUIRE);
+    if (tail != head) {
+        return NULL;
+    }
+
+    // tail is the last message, so the stub is pushed behind it to keep the
+    // queue non-empty once tail is removed.
+    inbox_push(inbox, &inbox->stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next != NULL) {
+        inbox->tail = next;
+        return tail;
+    }
+
+    return NULL;
+}
+
+static bool inbox_empty(ot_inbox* inbox) {
+    return __atomic_load_n(&inbox->head, __ATOMIC_SEQ_CST) == &inbox->stub &&
+           inbox->tail == &inbox->stub;
+}
+
+static ot_actor* new_actor(ot_registry_entry* entry) {
+    ot_actor* actor = malloc(sizeof(ot_actor));
+    actor->entry = entry;
+    inbox_init(&actor->inbox);
+    actor->scheduled = 0;
+    actor->next_run = NULL;
+
+    return actor;
+}
+
+static void free_actor(ot_actor* actor) {
+    ot_actor_msg* msg;
+    while ((msg = inbox_pop(&actor->inbox)) != NULL) {
+        free(msg);
+    }
+    free(actor);
+}
+
+// Claims the right to schedule an actor. Returns false if it's already
+// scheduled, in which case whoever scheduled it will see any new messages.
+static bool claim(ot_actor* actor) {
+    return __atomic_exchange_n(&actor->scheduled, 1, __ATOMIC_SEQ_CST) == 0;
+}
+
+static void finish_messages(ot_runtime* runtime, size_t count) {
+    if (count == 0) {
+        return;
+    }
+
+    uint64_t processed =
+        __atomic_add_fetch(&runtime->processed, count, __ATOMIC_SEQ_CST);
+    if (processed == __atomic_load_n(&runtime->submitted, __ATOMIC_SEQ_CST)) {
+        ot_mutex_lock(&runtime->idle_lock);
+        ot_cond_broadcast(&runtime->drained);
+        ot_mutex_unlock(&runtime->idle_lock);
+    }
+}
+
+// Processes a batch of the actor's messages. Returns true if the actor was
+// rescheduled by this call and must be run again.
+static bool run_actor(ot_runtime* runtime, ot_actor* actor) {
+    size_t count = 0;
+    ot_actor_msg* msg;
+    while (count < BATCH && (msg = inbox_pop(&actor->inbox)) != NULL) {
+        ot_registry_receive_entry(runtime->registry, actor->entry, msg->json);
+        free(msg);
+        ++count;
+    }
+
+    // Ops that the document's server held back go out with the batch, since
+    // the actor may not run again for a while.
+    ot_registry_flush_entry(runtime->registry, actor->entry);
+    finish_messages(runtime, count);
+
+    // A producer that pushed after the last pop may have seen the actor as
+    // still scheduled, so the inbox has to be checked again after unscheduling.
+    __atomic_store_n(&actor->scheduled, 0, __ATOMIC_SEQ_CST);
+    if (inbox_empty(&actor->inbox)) {
+        return false;
+    }
+
+    return claim(actor);
+}
+
+static void enqueue(ot_runtime* runtime, ot_worker* worker, ot_actor* actor) {
+    actor->next_run = NULL;
+
+    ot_mutex_lock(&worker->lock);
+    if (worker->run_tail == NULL) {
+        worker->run_head = actor;
+    } else {
+        worker->run_tail->next_run = actor;
+    }
+    worker->run_tail = actor;
+    ot_mutex_unlock(&worker->lock);
+
+    __atomic_add_fetch(&runtime->ready, 1, __ATOMIC_SEQ_CST);
+    ot_mutex_lock(&runtime->idle_lock);
+    ot_cond_signal(&runtime->idle);
+    ot_mutex_unlock(&runtime->idle_lock);
+}
+
+static ot_actor* dequeue(ot_worker* worker) {
+    ot_mutex_lock(&worker->lock);
+    ot_actor* actor = worker->run_head;
+    if (actor != NULL) {
+        worker->run_head = actor->next_run;
+        if (worker->run_head == NULL) {
+            worker->run_tail = NULL;
+        }
+    }
+    ot_mutex_unlock(&worker->lock);
+
+    return actor;
+}
+
+// Takes the next actor from the worker's own run queue, or steals one from
+// another worker if its own queue is empty.
+static ot_actor* take(ot_runtime* runtime, ot_worker* worker) {
+    ot_actor* actor = dequeue(worker);
+    for (size_t i = 1; actor == NULL && i < runtime->threads; ++i) {
+        ot_worker* victim =
+            runtime->workers + (worker->index + i) % runtime->threads;
+        actor = dequeue(victim);
+        if (actor != NULL) {
+            __atomic_add_fetch(&runtime->steals, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    if (actor != NULL) {
+        __atomic_sub_fetch(&runtime->ready, 1, __ATOMIC_SEQ_CST);
+    }
+
+    return actor;
+}
+
+static void* worker_main(void* arg) {
+    ot_worker* worker = arg;
+    ot_runtime* runtime = worker->runtime;
+
+    while (true) {
+        ot_actor* actor = take(runtime, worker);
+        if (actor != NULL) {
+            if (run_actor(runtime, actor)) {
+                enqueue(runtime, worker, actor);
+            }
+            continue;
+        }
+
+        ot_mutex_lock(&runtime->idle_lock);
+        while (__atomic_load_n(&runtime->ready, __ATOMIC_SEQ_CST) == 0 &&
+               !runtime->stopping) {
+            ot_cond_wait(&runtime->idle, &runtime->idle_lock);
+        }
+        bool stop = runtime->stopping &&
+                    __atomic_load_n(&runtime->ready, __ATOMIC_SEQ_CST) == 0;
+        ot_mutex_unlock(&runtime->idle_lock);
+
+        if (stop) {
+            return NULL;
+        }
+    }
+}
+
+static void stop_workers(ot_runtime* runtime, size_t started) {
+    ot_mutex_lock(&runtime->idle_lock);
+    runtime->stopping = true;
+    ot_cond_broadcast(&runtime->idle);
+    ot_mutex_unlock(&runtime->idle_lock);
+
+    for (size_t i = 0; i < started; ++i) {
+        ot_thread_join(runtime->workers[i].thread);
+    }
+}
+
+ot_runtime* ot_new_runtime(ot_registry* registry, size_t threads) {
+    if (threads == 0) {
+        threads = ot_cpu_count();
+    }
+
+    ot_runtime* runtime = malloc(sizeof(ot_runtime));
+    runtime->registry = registry;
+    ot_mutex_init(&runtime->table_lock);
+    ot_mutex_init(&runtime->idle_lock);
+    ot_cond_init(&runtime->idle);
+    ot_cond_init(&runtime->drained);
+    runtime->ready = 0;
+    runtime->stopping = false;
+    runtime->submitted = 0;
+    runtime->processed = 0;
+    runtime->steals = 0;
+    runtime->threads = threads;
+    runtime->workers = malloc(sizeof(ot_worker) * threads);
+
+    for (size_t i = 0; i < threads; ++i) {
+        ot_worker* worker = runtime->workers + i;
+        worker->runtime = runtime;
+        worker->index = i;
+        ot_mutex_init(&worker->lock);
+        worker->run_head = NULL;
+        worker->run_tail = NULL;
+    }
+
+    size_t started = 0;
+    while (started < threads &&
+           ot_thread_start(&runtime->workers[started].thread, worker_main,
+                           runtime->workers + started)) {
+        ++started;
+    }
+
+    // Workers assume that every shard has a thread, so if the pool couldn't be
+    // fully started, then messages are processed inline instead.
+    if (started < threads) {
+        stop_workers(runtime, started);
+        runtime->stopping = false;
+        runtime->threads = 0;
+
+        for (size_t i = 0; i < threads; ++i) {
+            ot_mutex_destroy(&runtime->workers[i].lock);
+        }
+        free(runtime->workers);
+        runtime->workers = NULL;
+    }
+
+    return runtime;
+}
+
+void ot_free_runtime(ot_runtime* runtime) {
+    ot_runtime_drain(runtime);
+    stop_workers(runtime, runtime->threads);
+
+    ot_registry* registry = runtime->registry;
+    for (size_t i = 0; i < registry->cap; ++i) {
+        for (ot_registry_entry* entry = registry->buckets[i]; entry != NULL;
+             entry = entry->next) {
+            if (entry->actor != NULL) {
+                free_actor(entry->actor);
+                entry->actor = NULL;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < runtime->threads; ++i) {
+        ot_mutex_destroy(&runtime->workers[i].lock);
+    }
+    free(runtime->workers);
+
+    ot_cond_destroy(&runtime->drained);
+    ot_cond_destroy(&runtime->idle);
+    ot_mutex_destroy(&runtime->idle_lock);
+    ot_mutex_destroy(&runtime->table_lock);
+    free(runtime);
+}
+
+void ot_runtime_submit(ot_runtime* runtime, const char* doc_id,
+                       const char* json) {
+    size_t size = strlen(json) + 1;
+    ot_actor_msg* msg = malloc(sizeof(ot_actor_msg) + size);
+    msg->json = (char*)(msg + 1);
+    memcpy(msg->json, json, size);
+
+    ot_mutex_lock(&runtime->table_lock);
+    ot_registry_entry* entry =
+        ot_registry_lookup(runtime->registry, doc_id, true);
+    if (entry->actor == NULL) {
+        entry->actor = new_actor(entry);
+    }
+    ot_actor* actor = entry->actor;
+    ot_mutex_unlock(&runtime->table_lock);
+
+    __atomic_add_fetch(&runtime->submitted, 1, __ATOMIC_SEQ_CST);
+    inbox_push(&actor->inbox, msg);
+    if (!claim(actor)) {
+        return;
+    }
+
+    if (runtime->threads == 0) {
+        while (run_actor(runtime, actor)) {
+        }
+        return;
+    }
+
+    enqueue(runtime, runtime->workers + entry->hash % runtime->threads, actor);
+}
+
+void ot_runtime_drain(ot_runtime* runtime) {
+    ot_mutex_lock(&runtime->idle_lock);
+    while (__atomic_load_n(&runtime->processed, __ATOMIC_SEQ_CST) !=
+           __atomic_load_n(&runtime->submitted, __ATOMIC_SEQ_CST)) {
+        // Without threads, every message is processed before submit returns,
+        // so there's nothing to wait for.
+        if (runtime->threads == 0) {
+            break;
+        }
+        ot_cond_wait(&runtime->drained, &runtime->idle_lock);
+    }
+    ot_mutex_unlock(&runtime->idle_lock);
+}
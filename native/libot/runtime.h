@@ -0,0 +1,110 @@
+#ifndef LIBOT_RUNTIME_H
+#define LIBOT_RUNTIME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "registry.h"
+#include "thread.h"
+
+// A runtime processes the messages of a registry's documents on a pool of
+// worker threads.
+//
+// Every document is an actor with its own inbox. Any thread may submit a
+// message to an inbox without taking a lock, and at most one worker processes a
+// document's inbox at a time, so the operations of a document are applied in
+// the order they were submitted while different documents are processed in
+// parallel.
+//
+// When a document receives a message while it's idle, it's scheduled on the run
+// queue of the worker that owns it (chosen by the hash of its ID). Workers
+// whose run queues are empty steal scheduled documents from other workers, so a
+// few busy shards don't leave the rest of the pool idle.
+//
+// If LIBOT_NO_THREADS is defined or no workers can be started, messages are
+// processed on the submitting thread instead.
+//
+// While a runtime is running, the registry may only be modified through the
+// runtime, and the registry's route function must be safe to call from any
+// worker thread.
+
+// A queued message. The JSON is stored in the same allocation, right after the
+// struct.
+typedef struct ot_actor_msg {
+    struct ot_actor_msg* next;
+    char* json;
+} ot_actor_msg;
+
+// An intrusive multiple-producer single-consumer queue. Producers only swap the
+// head pointer, and the consumer owns the tail. The stub node keeps the queue
+// from ever being empty, which is what lets it work without locks.
+typedef struct ot_inbox {
+    ot_actor_msg* head;
+    ot_actor_msg* tail;
+    ot_actor_msg stub;
+} ot_inbox;
+
+typedef struct ot_actor {
+    ot_registry_entry* entry;
+    ot_inbox inbox;
+
+    // Non-zero while the actor is on a run queue or being processed. Whoever
+    // sets it is responsible for scheduling the actor.
+    int scheduled;
+
+    // Link in a worker's run queue.
+    struct ot_actor* next_run;
+} ot_actor;
+
+struct ot_runtime;
+
+typedef struct ot_worker {
+    struct ot_runtime* runtime;
+    size_t index;
+    ot_thread thread;
+
+    // FIFO run queue of scheduled actors.
+    ot_mutex lock;
+    ot_actor* run_head;
+    ot_actor* run_tail;
+} ot_worker;
+
+typedef struct ot_runtime {
+    ot_registry* registry;
+
+    // Guards the registry's table when looking up or creating actors.
+    ot_mutex table_lock;
+
+    ot_worker* workers;
+    size_t threads;
+
+    // Sleeping workers and drain waiters wait on these. ready counts the actors
+    // sitting on run queues.
+    ot_mutex idle_lock;
+    ot_cond idle;
+    ot_cond drained;
+    size_t ready;
+    bool stopping;
+
+    uint64_t submitted;
+    uint64_t processed;
+    uint64_t steals;
+} ot_runtime;
+
+// Creates a runtime for a registry with the given number of worker threads. If
+// threads is 0, then one thread per CPU is used. The registry isn't owned by
+// the runtime, but it must outlive it.
+ot_runtime* ot_new_runtime(ot_registry* registry, size_t threads);
+
+// Processes any pending messages, stops the workers and frees the runtime.
+void ot_free_runtime(ot_runtime* runtime);
+
+// Queues a message for the document with the given ID, creating the document if
+// it isn't open. This may be called from any thread.
+void ot_runtime_submit(ot_runtime* runtime, const char* doc_id,
+                       const char* json);
+
+// Blocks until every message submitted so far has been processed.
+void ot_runtime_drain(ot_runtime* runtime);
+
+#endif
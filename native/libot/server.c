@@ -1,20 +1,458 @@
 #include "server.h"
 
-static void send(ot_server* server, const char* json) {
-    server->send(json);
-    fprintf(stderr, "[INFO] Sent message.\n\tJSON: %s\n", json);
+// Returns whether messages are sent as shared ot_msgs rather than strings.
+static bool sends_msgs(const ot_server* server) {
+    return server->route_to != NULL ||
+           (server->route == NULL &&
+            (server->send_to != NULL || server->send_msg != NULL));
+}
+
+// Returns whether the server knows who each message is for.
+static bool sends_to(const ot_server* server) {
+    return server->route_to != NULL ||
+           (server->route == NULL && server->send_to != NULL);
+}
+
+static void hand_off(ot_server* server, ot_recipients to,
+                     const uint32_t* client_ids, size_t len, ot_msg* msg) {
+    if (server->route_to != NULL) {
+        server->route_to(server->id, to, client_ids, len, msg);
+    } else {
+        server->send_to(to, client_ids, len, msg);
+    }
+    OT_LOG(OT_LOG_DEBUG, OT_ERR_NONE,
+           "Sent message.\n\tRecipients: %d (%zu clients)\n\tJSON: %s", to,
+           len, msg->data);
+}
+
+static uint32_t* outbox_bucket(const ot_outboxes* outboxes,
+                               uint32_t client_id) {
+    uint32_t h = client_id ^ (client_id >> 16);
+    return &outboxes->buckets[h & (outboxes->buckets_len - 1)];
+}
+
+static ot_outbox* find_outbox(const ot_outboxes* outboxes,
+                              uint32_t client_id) {
+    if (outboxes->buckets_len == 0) {
+        return NULL;
+    }
+
+    ot_outbox* boxes = outboxes->boxes.data;
+    uint32_t i = *outbox_bucket(outboxes, client_id);
+    while (i != 0) {
+        if (boxes[i - 1].client_id == client_id) {
+            return &boxes[i - 1];
+        }
+        i = boxes[i - 1].next;
+    }
+
+    return NULL;
+}
+
+// Links every outbox into its bucket, doubling the number of buckets if there
+// are more outboxes than buckets.
+static void index_outboxes(ot_outboxes* outboxes) {
+    size_t len = outboxes->boxes.len;
+    if (len > outboxes->buckets_len) {
+        size_t buckets_len = (outboxes->buckets_len > 0)
+                                 ? outboxes->buckets_len * 2
+                                 : 8;
+        free(outboxes->buckets);
+        outboxes->buckets = malloc(sizeof(uint32_t) * buckets_len);
+        outboxes->buckets_len = buckets_len;
+    }
+    memset(outboxes->buckets, 0, sizeof(uint32_t) * outboxes->buckets_len);
+
+    ot_outbox* boxes = outboxes->boxes.data;
+    for (size_t i = 0; i < len; ++i) {
+        uint32_t* head = outbox_bucket(outboxes, boxes[i].client_id);
+        boxes[i].next = *head;
+        *head = (uint32_t)i + 1;
+    }
+}
+
+// Replaces the link to the outbox at index i in its bucket with next.
+static void relink_outbox(ot_outboxes* outboxes, size_t i, uint32_t next) {
+    ot_outbox* boxes = outboxes->boxes.data;
+    uint32_t* link = outbox_bucket(outboxes, boxes[i].client_id);
+    while (*link != i + 1) {
+        link = &boxes[*link - 1].next;
+    }
+    *link = next;
+}
+
+// Counts a message against a client's outbox. Returns false if it shouldn't be
+// sent because the client is over the limit. Messages without a hash aren't
+// part of the document's history, so they're never held back.
+static bool queue(ot_outboxes* outboxes, ot_outbox* box, const ot_msg* msg,
+                  const char* hash) {
+    if (hash != NULL && box->overflowed) {
+        return false;
+    }
+
+    // A single message larger than the limit is still sent to an empty queue,
+    // since a catch-up wouldn't be any smaller.
+    if (hash != NULL && box->queued > 0 &&
+        box->queued + msg->len > outboxes->limit) {
+        OT_LOG(OT_LOG_INFO, OT_ERR_NONE,
+               "Client %" PRIu32 " has %zu bytes queued, holding back ops.",
+               box->client_id, box->queued);
+        box->overflowed = true;
+        ++outboxes->overflows;
+        return false;
+    }
+
+    box->queued += msg->len;
+    if (hash != NULL) {
+        memcpy(box->hash, hash, 20);
+    }
+    return true;
+}
+
+// Passes a message to send_to without flushing the window first. hash is the
+// state that the message brings its recipients to, or NULL if it doesn't
+// change their document. Clients that are over the outbox limit are left out.
+static void deliver(ot_server* server, ot_recipients to,
+                    const uint32_t* client_ids, size_t len, ot_msg* msg,
+                    const char* hash) {
+    ot_outboxes* outboxes = &server->outboxes;
+    if (outboxes->limit == 0 || outboxes->boxes.len == 0) {
+        hand_off(server, to, client_ids, len, msg);
+        return;
+    }
+
+    // A message for listed clients only looks up their outboxes.
+    if (to == OT_SEND_TO) {
+        uint32_t* sent = malloc(sizeof(uint32_t) * len);
+        size_t sent_len = 0;
+        for (size_t i = 0; i < len; ++i) {
+            ot_outbox* box = find_outbox(outboxes, client_ids[i]);
+            if (box == NULL || queue(outboxes, box, msg, hash)) {
+                sent[sent_len++] = client_ids[i];
+            }
+        }
+        if (sent_len == len) {
+            hand_off(server, to, client_ids, len, msg);
+        } else if (sent_len > 0) {
+            hand_off(server, OT_SEND_TO, sent, sent_len, msg);
+        }
+        free(sent);
+        return;
+    }
+
+    // Otherwise every outbox is visited once, skipping the listed clients
+    // (which are flagged first) if the message is sent to everyone except
+    // them. Tracked recipients that are left out are held after the listed
+    // clients.
+    size_t excluded = (to == OT_SEND_EXCEPT) ? len : 0;
+    uint32_t* held = malloc(sizeof(uint32_t) * (excluded + outboxes->boxes.len));
+    memcpy(held, client_ids, sizeof(uint32_t) * excluded);
+    size_t held_len = excluded;
+
+    for (size_t i = 0; i < excluded; ++i) {
+        ot_outbox* box = find_outbox(outboxes, client_ids[i]);
+        if (box != NULL) {
+            box->listed = true;
+        }
+    }
+
+    ot_outbox* boxes = outboxes->boxes.data;
+    for (size_t i = 0; i < outboxes->boxes.len; ++i) {
+        if (boxes[i].listed) {
+            boxes[i].listed = false;
+        } else if (!queue(outboxes, &boxes[i], msg, hash)) {
+            held[held_len++] = boxes[i].client_id;
+        }
+    }
+
+    if (held_len == excluded) {
+        hand_off(server, to, client_ids, len, msg);
+    } else {
+        hand_off(server, OT_SEND_EXCEPT, held, held_len, msg);
+    }
+
+    free(held);
+}
+
+void ot_server_send(ot_server* server, const char* json) {
+    if (sends_msgs(server)) {
+        size_t size = strlen(json) + 1;
+        char* data = malloc(size);
+        memcpy(data, json, size);
+        ot_msg* msg = ot_new_msg(data);
+        ot_server_send_msg(server, msg);
+        ot_msg_release(msg);
+        return;
+    }
+
+    if (server->route != NULL) {
+        server->route(server->id, json);
+    } else {
+        server->send(json);
+    }
+    OT_LOG(OT_LOG_DEBUG, OT_ERR_NONE, "Sent message.\n\tJSON: %s", json);
+}
+
+static void flush_window(ot_server* server);
+
+void ot_server_send_msg(ot_server* server, ot_msg* msg) {
+    if (!sends_msgs(server)) {
+        ot_server_send(server, msg->data);
+        return;
+    }
+
+    if (sends_to(server)) {
+        flush_window(server);
+        deliver(server, OT_SEND_ALL, NULL, 0, msg, NULL);
+        return;
+    }
+
+    server->send_msg(msg);
+    OT_LOG(OT_LOG_DEBUG, OT_ERR_NONE, "Sent message.\n\tJSON: %s", msg->data);
+}
+
+// Encodes op and passes it to deliver. Nothing is sent if it can't be encoded.
+static void deliver_op(ot_server* server, ot_recipients to,
+                       const uint32_t* client_ids, size_t len,
+                       const ot_op* op) {
+    ot_msg* msg = ot_encode_msg(op);
+    if (msg == NULL) {
+        OT_LOG(OT_LOG_ERROR, OT_ERR_NONE,
+               "Couldn't encode an operation, so it wasn't sent.");
+        return;
+    }
+
+    deliver(server, to, client_ids, len, msg, op->hash);
+    ot_msg_release(msg);
+}
+
+// Sends the op's client an acknowledgement of it.
+static void send_ack(ot_server* server, const ot_op* op) {
+    ot_msg* ack = ot_new_msg(ot_encode_ack(op->hash));
+    deliver(server, OT_SEND_TO, &op->client_id, 1, ack, op->hash);
+    ot_msg_release(ack);
+}
+
+// Composes ops[from, to) into a single op that ends with the hash of the last
+// one. Returns NULL if they couldn't be composed.
+static ot_op* compose_run(const ot_op* const* ops, size_t from, size_t to) {
+    ot_op* composed = ot_dup_op(ops[from]);
+    for (size_t i = from + 1; i < to && composed != NULL; ++i) {
+        ot_op* temp = ot_compose(composed, (ot_op*)ops[i]);
+        ot_free_op(composed);
+        composed = temp;
+    }
+
+    if (composed != NULL) {
+        memcpy(composed->hash, ops[to - 1]->hash, 20);
+    }
+
+    return composed;
+}
+
+// Sends ops[from, to) as one composed message, or one at a time if they can't
+// be composed.
+static void send_run(ot_server* server, const ot_op* const* ops, size_t from,
+                     size_t to, ot_recipients recipients,
+                     const uint32_t* client_ids, size_t len) {
+    ot_op* composed = compose_run(ops, from, to);
+    if (composed == NULL) {
+        OT_LOG(OT_LOG_ERROR, OT_ERR_COMPOSE_FAILED,
+               "Couldn't compose %zu held operations.", to - from);
+        for (size_t i = from; i < to; ++i) {
+            deliver_op(server, recipients, client_ids, len, ops[i]);
+        }
+        return;
+    }
+
+    deliver_op(server, recipients, client_ids, len, composed);
+    ot_free_op(composed);
+}
+
+// Sends the ops held by the broadcast window.
+static void flush_window(ot_server* server) {
+    ot_window* window = &server->window;
+    size_t len = window->ops.len;
+    if (len == 0) {
+        return;
+    }
+    ot_op** ops = window->ops.data;
+
+    uint32_t* origins = malloc(sizeof(uint32_t) * len);
+    size_t origins_len = 0;
+    for (size_t i = 0; i < len; ++i) {
+        size_t j = 0;
+        while (j < origins_len && origins[j] != ops[i]->client_id) {
+            ++j;
+        }
+        if (j == origins_len) {
+            origins[origins_len++] = ops[i]->client_id;
+        }
+    }
+
+    // Clients that didn't send anything see the whole window as one op.
+    const ot_op* const* held = (const ot_op* const*)ops;
+    send_run(server, held, 0, len, OT_SEND_EXCEPT, origins, origins_len);
+
+    // Each client that did has to see its own ops acknowledged in between the
+    // ops that were appended before and after them.
+    for (size_t i = 0; i < origins_len; ++i) {
+        size_t run = 0;
+        for (size_t j = 0; j < len; ++j) {
+            if (ops[j]->client_id != origins[i]) {
+                continue;
+            }
+
+            if (j > run) {
+                send_run(server, held, run, j, OT_SEND_TO, &origins[i], 1);
+            }
+            send_ack(server, ops[j]);
+            run = j + 1;
+        }
+
+        if (run < len) {
+            send_run(server, held, run, len, OT_SEND_TO, &origins[i], 1);
+        }
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        ot_free_op(ops[i]);
+    }
+    window->ops.len = 0;
+    free(origins);
+}
+
+// Sends an appended op, or holds it in the broadcast window.
+static void send_op(ot_server* server, const ot_op* op) {
+    if (!sends_to(server)) {
+        ot_msg* msg = ot_encode_msg(op);
+        if (msg == NULL) {
+            OT_LOG(OT_LOG_ERROR, OT_ERR_NONE,
+                   "Couldn't encode an operation, so it wasn't sent.");
+            return;
+        }
+        ot_server_send_msg(server, msg);
+        ot_msg_release(msg);
+        return;
+    }
+
+    ot_window* window = &server->window;
+    if (window->secs > 0) {
+        double now = ot_now();
+        if (window->ops.len > 0 && now - window->start >= window->secs) {
+            flush_window(server);
+        }
+        if (window->ops.len == 0) {
+            window->start = now;
+        }
+
+        ot_op** held = array_append(&window->ops);
+        *held = ot_dup_op(op);
+        return;
+    }
+
+    send_ack(server, op);
+    deliver_op(server, OT_SEND_EXCEPT, &op->client_id, 1, op);
+}
+
+// Sends the ops waiting for the write-ahead log that are now durable, in the
+// order they were appended.
+static void release_durable(ot_server* server) {
+    size_t len = server->unsynced.len;
+    if (len == 0) {
+        return;
+    }
+
+    ot_unsynced* held = server->unsynced.data;
+    uint64_t durable = ot_wal_durable(server->wal);
+    size_t ready = 0;
+    while (ready < len && held[ready].seq <= durable) {
+        ++ready;
+    }
+
+    for (size_t i = 0; i < ready; ++i) {
+        send_op(server, held[i].op);
+        ot_free_op(held[i].op);
+    }
+
+    // An empty array must be reinitialized, since appending to it allocates
+    // a new buffer.
+    if (ready == len) {
+        array_free(&server->unsynced);
+        array_init(&server->unsynced, sizeof(ot_unsynced));
+    } else if (ready > 0) {
+        memmove(held, held + ready, sizeof(ot_unsynced) * (len - ready));
+        server->unsynced.len = len - ready;
+    }
+}
+
+void ot_server_flush(ot_server* server) {
+    if (server->wal != NULL) {
+        release_durable(server);
+    }
+    flush_window(server);
+}
+
+void ot_server_sync(ot_server* server) {
+    size_t len = server->unsynced.len;
+    if (server->wal != NULL && len > 0) {
+        ot_unsynced* held = server->unsynced.data;
+        if (!ot_wal_wait(server->wal, held[len - 1].seq)) {
+            // The ops will never be durable, so they're dropped. Their
+            // clients will see that they weren't acknowledged when they
+            // resume.
+            OT_LOG(OT_LOG_ERROR, OT_ERR_NONE,
+                   "Dropped %zu operations that couldn't be logged.", len);
+            for (size_t i = 0; i < len; ++i) {
+                ot_free_op(held[i].op);
+            }
+            array_free(&server->unsynced);
+            array_init(&server->unsynced, sizeof(ot_unsynced));
+        }
+    }
+
+    ot_server_flush(server);
+}
+
+void ot_server_broadcast(ot_server* server, const ot_op* op) {
+    if (server->wal == NULL) {
+        send_op(server, op);
+        return;
+    }
+
+    ot_unsynced* held = array_append(&server->unsynced);
+    held->op = ot_dup_op(op);
+    held->seq = ot_wal_append(server->wal, server->id, op);
+    release_durable(server);
 }
 
 static void send_err(ot_server* server, ot_err err) {
     char* enc = ot_encode_err(err);
-    send(server, enc);
+    ot_server_send(server, enc);
     free(enc);
 }
 
+// Sends an error caused by an op from the given client. Without send_to, it's
+// sent to every client.
+static void reply_err(ot_server* server, uint32_t client_id, ot_err err) {
+    ot_msg* msg = ot_new_msg(ot_encode_err(err));
+    if (sends_to(server)) {
+        flush_window(server);
+        deliver(server, OT_SEND_TO, &client_id, 1, msg, NULL);
+    } else {
+        ot_server_send_msg(server, msg);
+    }
+    ot_msg_release(msg);
+}
+
+void ot_server_reply_err(ot_server* server, uint32_t client_id, ot_err err) {
+    reply_err(server, client_id, err);
+}
+
 static bool can_append(const ot_doc* doc, const ot_op* op) {
     const char* parent = op->parent;
 
-    if (doc->history.len == 0) {
+    if (ot_doc_len(doc) == 0) {
         for (int i = 0; i < 20; ++i) {
             if (parent[i] != 0) {
                 return false;
@@ -24,98 +462,209 @@ static bool can_append(const ot_doc* doc, const ot_op* op) {
         return true;
     }
 
-    if (memcmp(doc->composed->hash, parent, sizeof(char) * 20) == 0) {
+    // The latest hash isn't known while it's still being computed, in which
+    // case the op is transformed against the ops after its parent instead.
+    if (doc->hashed == ot_doc_len(doc) &&
+        memcmp(doc->composed->hash, parent, sizeof(char) * 20) == 0) {
         return true;
     }
 
     return false;
 }
 
-static ot_err append_op(ot_server* server, ot_op* op) {
-    ot_doc* doc = server->doc;
+// Returns whether an op with the given parent can't be transformed because the
+// parent isn't in the document's history. A null parent is the empty document.
+static bool parent_missing(const ot_doc* doc, const char* parent) {
+    static const char null_hash[20] = { 0 };
+    if (doc == NULL || memcmp(parent, null_hash, 20) == 0) {
+        return false;
+    }
 
-    if (doc->composed == NULL) {
-        char* op_enc = ot_encode(op);
-        fprintf(stderr, "[INFO] Appending operation to empty document.\n"
-                        "\tOperation: %s\n",
-                op_enc);
-        free(op_enc);
-    } else {
-        char* doc_enc = ot_encode(doc->composed);
-        char* op_enc = ot_encode(op);
-        fprintf(stderr, "[INFO] Appending operation to document.\n"
-                        "\tDocument: %s\n"
-                        "\tOperation: %s\n",
-                doc_enc, op_enc);
-        free(doc_enc);
-        free(op_enc);
+    return ot_doc_find(doc, parent) == ot_doc_len(doc);
+}
+
+// Rejects an op that's malformed, or that's based on the document's latest
+// state but doesn't span it, before any work is done on it.
+static ot_err validate(const ot_doc* doc, const ot_op* op) {
+    ot_span span;
+    ot_err err = ot_validate(op, &span);
+    if (err == OT_ERR_NONE && (doc == NULL || can_append(doc, op))) {
+        uint32_t length = (doc != NULL) ? doc->length : 0;
+        if (span.before != length) {
+            err = OT_ERR_SPAN_MISMATCH;
+        }
+    }
+
+    if (err != OT_ERR_NONE) {
+        OT_LOG(OT_LOG_ERROR, err,
+               "Rejected an invalid operation from client %" PRIu32 ".",
+               op->client_id);
     }
+    return err;
+}
+
+static void drop_snapshot(ot_server* server) {
+    ot_snapshot_cache* cache = &server->snapshot;
+    if (cache->msg != NULL) {
+        ot_msg_release(cache->msg);
+        cache->msg = NULL;
+    }
+}
+
+// Appends op to the document. If text isn't NULL, the op's hash is left for the
+// caller to compute from the text stored in *text.
+static ot_err append_op(ot_server* server, ot_op* op, ot_op** appended,
+                        char** text) {
+    ot_doc* doc = server->doc;
+
+    OT_LOG_OPS(OT_LOG_DEBUG, OT_ERR_NONE, "Appending operation to document.",
+               "Document", doc->composed, "Operation", op, NULL);
 
-    ot_err err = ot_doc_append(doc, &op);
+    ot_err err = (text != NULL) ? ot_doc_append_unhashed(doc, &op, text)
+                                : ot_doc_append(doc, &op);
     if (err != OT_ERR_NONE) {
-        char* doc_enc = ot_encode(doc->composed);
-        char* op_enc = ot_encode(op);
-        fprintf(stderr, "[ERROR %d] Appending operation to document failed.\n"
-                        "\tDocument: %s\n"
-                        "\tOperation: %s\n",
-                err, doc_enc, op_enc);
+        OT_LOG_OPS(OT_LOG_ERROR, err,
+                   "Appending operation to document failed.", "Document",
+                   doc->composed, "Operation", op, NULL);
         ot_free_op(op);
-        free(doc_enc);
-        free(op_enc);
         return err;
     }
 
-    char* append_enc = ot_encode(op);
-    send(server, append_enc);
-    free(append_enc);
+    drop_snapshot(server);
+    *appended = op;
     return OT_ERR_NONE;
 }
 
-static ot_op* xform(const ot_doc* doc, ot_op* op) {
-    char* op_enc = ot_encode(op);
-    ot_op* composed = ot_doc_compose_after(doc, op->parent);
-    if (composed == NULL) {
-        fprintf(stderr, "[ERROR %d] Couldn't find the operation's parent.\n"
-                        "\tOperation: %s\n",
-                OT_ERR_COMPOSE_FAILED, op_enc);
-        free(op_enc);
+// Transforms a client op against the composition of every server op it hasn't
+// seen. Returns the transformed client op, or NULL if they couldn't be
+// transformed.
+static ot_op* xform_against(ot_op* composed, ot_op* op) {
+    OT_LOG_OPS(OT_LOG_DEBUG, OT_ERR_NONE, "Transforming received operation.",
+               "Server Operation", composed, "Client Operation", op, NULL);
+
+    ot_xform_pair p = ot_xform(composed, op);
+    if (p.op1_prime == NULL) {
+        OT_LOG_OPS(OT_LOG_ERROR, OT_ERR_XFORM_FAILED, "Transformation failed.",
+                   "Server Operation", composed, "Client Operation", op, NULL);
         return NULL;
     }
 
-    char* composed_enc = ot_encode(composed);
-    fprintf(stderr, "[INFO] Transforming received operation.\n"
-                    "\tServer Operation: %s\n"
-                    "\tClient Operation: %s\n",
-            composed_enc, op_enc);
+    OT_LOG_OPS(OT_LOG_DEBUG, OT_ERR_NONE, "Transformation succeeded.",
+               "Server Operation'", p.op1_prime, "Client Operation'",
+               p.op2_prime, NULL);
 
-    ot_xform_pair p = ot_xform(composed, op);
-    if (p.op1_prime == NULL) {
-        fprintf(stderr, "[ERROR %d] Transformation failed.\n"
-                        "\tServer Operation: %s\n"
-                        "\tClient Operation: %s\n",
-                OT_ERR_XFORM_FAILED, composed_enc, op_enc);
-        free(composed_enc);
-        free(op_enc);
+    ot_free_op(p.op1_prime);
+    return p.op2_prime;
+}
+
+static void clear_bridges(ot_bridge_cache* cache) {
+    for (size_t i = 0; i < cache->len; ++i) {
+        ot_free_op(cache->entries[i].composed);
+    }
+    cache->len = 0;
+}
+
+// Composes the ops in history[from, len) onto composed, which is freed. If
+// composed is NULL, the composition starts from the op at from. Returns NULL if
+// the ops couldn't be composed.
+static ot_op* compose_onto(const ot_doc* doc, ot_op* composed, size_t from) {
+    size_t len = ot_doc_len(doc);
+    if (composed == NULL) {
+        composed = ot_dup_op(ot_doc_op(doc, from++));
+    }
+
+    for (size_t i = from; i < len && composed != NULL; ++i) {
+        ot_op* temp = ot_compose(composed, ot_doc_op(doc, i));
         ot_free_op(composed);
+        composed = temp;
+    }
+
+    return composed;
+}
+
+// Returns the composition of every server op after parent, which is owned by
+// the cache and only valid until the next lookup. Returns NULL if the parent
+// can't be found or the ops couldn't be composed. This composes the same ops
+// as ot_doc_compose_after, so a bridge is only reused if parent still refers to
+// the same op in the history.
+static ot_op* find_bridge(ot_bridge_cache* cache, const ot_doc* doc,
+                          const char* parent) {
+    static const char null_hash[20] = { 0 };
+
+    size_t len = ot_doc_len(doc);
+    size_t start = 0;
+    if (memcmp(parent, null_hash, 20) != 0) {
+        start = ot_doc_find(doc, parent) + 1;
+    }
+    if (start >= len) {
         return NULL;
     }
 
-    char* op1_prime_enc = ot_encode(p.op1_prime);
-    char* op2_prime_enc = ot_encode(p.op2_prime);
+    ot_bridge* victim = NULL;
+    for (size_t i = 0; i < cache->len; ++i) {
+        ot_bridge* bridge = &cache->entries[i];
+        if (bridge->start == start && bridge->end <= len &&
+            memcmp(bridge->parent, parent, 20) == 0) {
+            if (bridge->end < len) {
+                bridge->composed =
+                    compose_onto(doc, bridge->composed, bridge->end);
+                bridge->end = len;
+                if (bridge->composed == NULL) {
+                    *bridge = cache->entries[--cache->len];
+                    return NULL;
+                }
+            }
 
-    fprintf(stderr, "Transformation succeeded.\n"
-                    "\tServer Operation': %s\n"
-                    "\tClient Operation': %s\n",
-            op1_prime_enc, op2_prime_enc);
+            ++cache->hits;
+            bridge->used = ++cache->tick;
+            return bridge->composed;
+        }
 
-    free(composed_enc);
-    free(op_enc);
-    free(op1_prime_enc);
-    free(op2_prime_enc);
-    ot_free_op(p.op1_prime);
-    ot_free_op(composed);
+        if (victim == NULL || bridge->used < victim->used) {
+            victim = bridge;
+        }
+    }
 
-    return p.op2_prime;
+    ++cache->misses;
+    ot_op* composed = compose_onto(doc, NULL, start);
+    if (composed == NULL) {
+        return NULL;
+    }
+
+    if (cache->len < cache->cap) {
+        victim = &cache->entries[cache->len++];
+    } else {
+        ot_free_op(victim->composed);
+    }
+    memcpy(victim->parent, parent, 20);
+    victim->start = start;
+    victim->end = len;
+    victim->composed = composed;
+    victim->used = ++cache->tick;
+
+    return composed;
+}
+
+static ot_op* xform(ot_server* server, ot_op* op) {
+    const ot_doc* doc = server->doc;
+    ot_bridge_cache* cache = &server->bridges;
+
+    ot_op* composed = (cache->cap > 0)
+                          ? find_bridge(cache, doc, op->parent)
+                          : ot_doc_compose_after(doc, op->parent);
+    if (composed == NULL) {
+        OT_LOG_OPS(OT_LOG_ERROR, OT_ERR_COMPOSE_FAILED,
+                   "Couldn't find the operation's parent.", "Operation", op,
+                   NULL);
+        return NULL;
+    }
+
+    ot_op* op_prime = xform_against(composed, op);
+    if (cache->cap == 0) {
+        ot_free_op(composed);
+    }
+
+    return op_prime;
 }
 
 ot_server* ot_new_server(send_func send, ot_event_func event) {
@@ -123,73 +672,759 @@ ot_server* ot_new_server(send_func send, ot_event_func event) {
     server->send = send;
     server->event = event;
     server->doc = NULL;
+    server->id = NULL;
+    server->route = NULL;
+    server->route_to = NULL;
+    server->send_msg = NULL;
+    server->send_to = NULL;
+    server->window.secs = 0;
+    server->window.start = 0;
+    array_init(&server->window.ops, sizeof(ot_op*));
+    server->snapshot.msg = NULL;
+    memset(&server->bridges, 0, sizeof(ot_bridge_cache));
+    ot_dedup_init(&server->dedup, 0);
+    server->outboxes.limit = 0;
+    server->outboxes.overflows = 0;
+    array_init(&server->outboxes.boxes, sizeof(ot_outbox));
+    server->outboxes.buckets = NULL;
+    server->outboxes.buckets_len = 0;
+    server->wal = NULL;
+    array_init(&server->unsynced, sizeof(ot_unsynced));
 
     return server;
 }
 
 void ot_free_server(ot_server* server) {
+    ot_server_sync(server);
+    array_free(&server->unsynced);
+    array_free(&server->window.ops);
     if (server->doc != NULL) {
         ot_free_doc(server->doc);
     }
 
+    clear_bridges(&server->bridges);
+    free(server->bridges.entries);
+    drop_snapshot(server);
+    ot_dedup_free(&server->dedup);
+    array_free(&server->outboxes.boxes);
+    free(server->outboxes.buckets);
     free(server);
 }
 
-void ot_server_open(ot_server* server, ot_doc* doc) { server->doc = doc; }
+void ot_server_open(ot_server* server, ot_doc* doc) {
+    // Held ops belong to the old document, so they're sent before it's
+    // replaced.
+    ot_server_sync(server);
+    clear_bridges(&server->bridges);
+    drop_snapshot(server);
+    ot_dedup_clear(&server->dedup);
+    server->doc = doc;
+}
+
+void ot_server_set_dedup(ot_server* server, size_t cap) {
+    ot_dedup_free(&server->dedup);
+    ot_dedup_init(&server->dedup, cap);
+}
+
+void ot_server_set_send_msg(ot_server* server, ot_send_msg_func send_msg) {
+    server->send_msg = send_msg;
+}
+
+void ot_server_set_send_to(ot_server* server, ot_send_to_func send_to) {
+    ot_server_flush(server);
+    server->send_to = send_to;
+}
+
+void ot_server_set_wal(ot_server* server, ot_wal* wal) {
+    ot_server_sync(server);
+    server->wal = wal;
+}
+
+void ot_server_set_window(ot_server* server, double secs) {
+    ot_server_flush(server);
+    server->window.secs = secs;
+}
+
+void ot_server_set_bridge_cache(ot_server* server, size_t cap) {
+    ot_bridge_cache* cache = &server->bridges;
+    clear_bridges(cache);
+    free(cache->entries);
+    cache->entries = (cap > 0) ? malloc(sizeof(ot_bridge) * cap) : NULL;
+    cache->cap = cap;
+}
+
+// Returns the number of ops at the start of the history that clients may see.
+// Ops waiting for the write-ahead log are the newest ones, and they're left out
+// of catch-ups and snapshots until they're durable and sent.
+static size_t durable_len(const ot_server* server) {
+    size_t len = (server->doc != NULL) ? ot_doc_len(server->doc) : 0;
+    size_t unsynced = server->unsynced.len;
+    return (unsynced < len) ? len - unsynced : 0;
+}
+
+// Returns the document's state after its first len ops, or NULL if len is 0 or
+// the state couldn't be rebuilt. The latest state is borrowed from the
+// document, while earlier ones are rebuilt from its keyframes and *owned is
+// set so that the caller frees them.
+static ot_op* state_at(const ot_doc* doc, size_t len, bool* owned) {
+    *owned = false;
+    if (len == 0) {
+        return NULL;
+    }
+    if (len == ot_doc_len(doc)) {
+        return doc->composed;
+    }
+
+    char* text = ot_doc_snapshot_at(doc, ot_doc_op(doc, len - 1)->hash);
+    if (text == NULL) {
+        return NULL;
+    }
+
+    // The header matches what composing the ops would have produced.
+    const ot_op* first = ot_doc_op(doc, 0);
+    ot_op* state = ot_new_op();
+    state->client_id = first->client_id;
+    memcpy(state->parent, first->parent, 20);
+    memcpy(state->hash, ot_doc_op(doc, len - 1)->hash, 20);
+    if (text[0] != '\0') {
+        ot_insert(state, text);
+    }
+    free(text);
+    *owned = true;
+    return state;
+}
+
+// Copies the hash of the document's latest durable state, which is all zeros if
+// it's empty.
+static void head_hash(const ot_server* server, char* hash) {
+    size_t len = durable_len(server);
+    if (len > 0) {
+        memcpy(hash, ot_doc_op(server->doc, len - 1)->hash, 20);
+    } else {
+        memset(hash, 0, 20);
+    }
+}
+
+// Encodes the ops after hash for a reconnecting client. Runs of other clients'
+// ops are composed into one op each, and the client's own ops are sent as
+// acknowledgements. If hash isn't in the history, the whole document is sent
+// as a snapshot instead. Only durable ops are included.
+static char* catch_up(const ot_server* server, const char* hash,
+                      uint32_t client_id) {
+    static const char null_hash[20] = { 0 };
+
+    const ot_doc* doc = server->doc;
+    size_t len = durable_len(server);
+    char head[20];
+    head_hash(server, head);
+
+    size_t start = 0;
+    if (memcmp(hash, null_hash, 20) != 0) {
+        start = (len > 0) ? ot_doc_find(doc, hash) + 1 : 1;
+    }
+    if (start > len) {
+        OT_LOG(OT_LOG_INFO, OT_ERR_NONE,
+               "Client %" PRIu32 " can't be resumed, sending a snapshot.",
+               client_id);
+        bool owned;
+        ot_op* state = state_at(doc, len, &owned);
+        const ot_op* composed = state;
+        char* enc = ot_encode_catch_up(&composed, (state != NULL) ? 1 : 0,
+                                       client_id, head, true);
+        if (owned) {
+            ot_free_op(state);
+        }
+        return enc;
+    }
+
+    size_t n = len - start;
+    const ot_op** missed = malloc(sizeof(ot_op*) * (n + 1));
+    for (size_t i = 0; i < n; ++i) {
+        missed[i] = ot_doc_op(doc, start + i);
+    }
+
+    // Composed runs are owned here, while acknowledged ops and runs that
+    // couldn't be composed are borrowed from the history.
+    const ot_op** msgs = malloc(sizeof(ot_op*) * (n + 1));
+    ot_op** owned = malloc(sizeof(ot_op*) * (n + 1));
+    size_t msgs_len = 0;
+    size_t owned_len = 0;
+    size_t run = 0;
+    for (size_t j = 0; j <= n; ++j) {
+        if (j < n && missed[j]->client_id != client_id) {
+            continue;
+        }
+
+        if (j > run) {
+            ot_op* composed = compose_run(missed, run, j);
+            if (composed != NULL) {
+                owned[owned_len++] = composed;
+                msgs[msgs_len++] = composed;
+            } else {
+                for (size_t k = run; k < j; ++k) {
+                    msgs[msgs_len++] = missed[k];
+                }
+            }
+        }
+        if (j < n) {
+            msgs[msgs_len++] = missed[j];
+        }
+        run = j + 1;
+    }
+
+    char* enc = ot_encode_catch_up(msgs, msgs_len, client_id, head, false);
+    for (size_t i = 0; i < owned_len; ++i) {
+        ot_free_op(owned[i]);
+    }
+    free(owned);
+    free(msgs);
+    free(missed);
+
+    return enc;
+}
+
+// Sends a client a catch-up from hash, which brings it to the current head
+// even if it was over the outbox limit.
+static void send_catch_up(ot_server* server, const char* hash,
+                          uint32_t client_id) {
+    flush_window(server);
+    ot_msg* msg = ot_new_msg(catch_up(server, hash, client_id));
+
+    ot_outbox* box = find_outbox(&server->outboxes, client_id);
+    if (box != NULL) {
+        box->overflowed = false;
+        box->queued += msg->len;
+        head_hash(server, box->hash);
+    }
+
+    hand_off(server, OT_SEND_TO, &client_id, 1, msg);
+    ot_msg_release(msg);
+}
+
+void ot_server_set_outbox_limit(ot_server* server, size_t bytes) {
+    server->outboxes.limit = bytes;
+}
+
+void ot_server_connect(ot_server* server, uint32_t client_id) {
+    ot_outboxes* outboxes = &server->outboxes;
+    ot_outbox* box = find_outbox(outboxes, client_id);
+    if (box == NULL) {
+        box = array_append(&outboxes->boxes);
+        box->client_id = client_id;
+        box->listed = false;
+        if (outboxes->boxes.len > outboxes->buckets_len) {
+            index_outboxes(outboxes);
+        } else {
+            uint32_t* head = outbox_bucket(outboxes, client_id);
+            box->next = *head;
+            *head = (uint32_t)outboxes->boxes.len;
+        }
+    }
+
+    box->queued = 0;
+    box->overflowed = false;
+    head_hash(server, box->hash);
+}
+
+void ot_server_disconnect(ot_server* server, uint32_t client_id) {
+    ot_outboxes* outboxes = &server->outboxes;
+    ot_outbox* box = find_outbox(outboxes, client_id);
+    if (box == NULL) {
+        return;
+    }
+
+    // The last outbox is moved into the removed one's place.
+    ot_outbox* boxes = outboxes->boxes.data;
+    size_t i = (size_t)(box - boxes);
+    size_t last = outboxes->boxes.len - 1;
+    relink_outbox(outboxes, i, box->next);
+    if (i != last) {
+        relink_outbox(outboxes, last, (uint32_t)i + 1);
+        *box = boxes[last];
+    }
+    --outboxes->boxes.len;
+}
+
+void ot_server_sent(ot_server* server, uint32_t client_id, size_t bytes) {
+    ot_outbox* box = find_outbox(&server->outboxes, client_id);
+    if (box == NULL) {
+        return;
+    }
+
+    box->queued = (bytes < box->queued) ? box->queued - bytes : 0;
+    if (box->overflowed && box->queued <= server->outboxes.limit / 2) {
+        OT_LOG(OT_LOG_INFO, OT_ERR_NONE,
+               "Client %" PRIu32 " drained its queue, catching it up.",
+               client_id);
+        char hash[20];
+        memcpy(hash, box->hash, 20);
+        send_catch_up(server, hash, client_id);
+    }
+}
+
+char* ot_server_catch_up(ot_server* server, const char* request) {
+    char hash[20];
+    uint32_t client_id;
+    ot_err err = ot_decode_resume(hash, &client_id, request);
+    if (err != OT_ERR_NONE) {
+        OT_LOG(OT_LOG_ERROR, err,
+               "Couldn't decode the resume request.\n\tJSON: %s", request);
+        return NULL;
+    }
+
+    return catch_up(server, hash, client_id);
+}
+
+// Decodes a received message into an op. Resume requests are answered, and ops
+// that can't be decoded or whose parent is missing are rejected, in which case
+// NULL is returned.
+void ot_server_decode(const ot_doc* doc, const char* json,
+                      ot_received* received) {
+    received->op = NULL;
+    received->resume = false;
+    received->has_sender = false;
+    received->client_id = 0;
+    received->err = ot_decode_resume(received->hash, &received->client_id,
+                                     json);
+    if (received->err == OT_ERR_NONE) {
+        received->resume = true;
+        received->has_sender = true;
+        return;
+    }
+
+    // Ops based on a state the server doesn't have are rejected from their
+    // header, so their components are never decoded.
+    ot_header header;
+    received->err = ot_decode_header(&header, json);
+    if (received->err == OT_ERR_NONE) {
+        received->has_sender = true;
+        received->client_id = header.client_id;
+        if (doc != NULL && parent_missing(doc, header.parent)) {
+            OT_LOG(OT_LOG_ERROR, OT_ERR_XFORM_FAILED,
+                   "Rejected an operation from client %" PRIu32
+                   " whose parent isn't in the history.",
+                   header.client_id);
+            received->err = OT_ERR_XFORM_FAILED;
+            return;
+        }
+
+        received->op = ot_new_op();
+        received->err = ot_decode_body(received->op, &header);
+    }
+    if (received->err != OT_ERR_NONE) {
+        OT_LOG(OT_LOG_ERROR, received->err,
+               "Couldn't decode the received operation.\n\tJSON: %s", json);
+        if (received->op != NULL) {
+            ot_free_op(received->op);
+            received->op = NULL;
+        }
+    }
+}
+
+void ot_server_resume(ot_server* server, const char* hash,
+                      uint32_t client_id) {
+    // Only a server that can reply to a single client can answer resume
+    // requests by itself.
+    if (!sends_to(server)) {
+        OT_LOG(OT_LOG_ERROR, OT_ERR_NONE,
+               "Resume requests need send_to or ot_server_catch_up.");
+        return;
+    }
+
+    send_catch_up(server, hash, client_id);
+}
+
+static ot_op* decode_received(ot_server* server, const char* op) {
+    ot_received received;
+    ot_server_decode(server->doc, op, &received);
+    if (received.resume) {
+        ot_server_resume(server, received.hash, received.client_id);
+    } else if (received.err != OT_ERR_NONE && received.has_sender) {
+        reply_err(server, received.client_id, received.err);
+    } else if (received.err != OT_ERR_NONE) {
+        send_err(server, received.err);
+    }
+
+    return received.op;
+}
 
 void ot_server_receive(ot_server* server, const char* op) {
-    fprintf(stderr, "[INFO] Received message.\n\tJSON: %s\n", op);
+    OT_LOG(OT_LOG_DEBUG, OT_ERR_NONE, "Received message.\n\tJSON: %s", op);
+
+    ot_op* dec = decode_received(server, op);
+    if (dec != NULL) {
+        ot_server_receive_op(server, dec);
+    }
+}
+
+void ot_server_acknowledge(ot_server* server, const ot_op* op) {
+    if (!sends_to(server)) {
+        OT_LOG(OT_LOG_INFO, OT_ERR_DUPLICATE,
+               "Dropped an operation that was already appended.");
+        return;
+    }
+
+    // An op that's still waiting for the log is acknowledged once it's
+    // durable.
+    ot_unsynced* held = server->unsynced.data;
+    for (size_t i = 0; i < server->unsynced.len; ++i) {
+        if (memcmp(held[i].op->hash, op->hash, 20) == 0) {
+            return;
+        }
+    }
 
-    ot_op* dec = ot_new_op();
-    ot_err err = ot_decode(dec, op);
+    flush_window(server);
+    send_ack(server, op);
+}
+
+void ot_server_receive_op(ot_server* server, ot_op* op) {
+    uint32_t client_id = op->client_id;
+    ot_op* appended;
+    ot_err err = ot_server_sequence(server, op, &appended);
+    if (err == OT_ERR_DUPLICATE) {
+        ot_server_acknowledge(server, appended);
+        return;
+    }
     if (err != OT_ERR_NONE) {
-        fprintf(stderr, "[ERROR %d] Couldn't decode the received operation.\n"
-                        "\tJSON: %s\n",
-                err, op);
-        send_err(server, err);
-        ot_free_op(dec);
+        reply_err(server, client_id, err);
         return;
     }
 
+    ot_server_broadcast(server, appended);
+}
+
+ot_msg* ot_server_snapshot_msg(ot_server* server) {
+    const ot_doc* doc = server->doc;
+    size_t len = durable_len(server);
+    if (len == 0) {
+        return NULL;
+    }
+
+    // The document may also be changed without going through the server, so
+    // the cached version is checked as well as being dropped on append.
+    ot_snapshot_cache* cache = &server->snapshot;
+    const char* hash = ot_doc_op(doc, len - 1)->hash;
+    if (cache->msg != NULL &&
+        (cache->doc != doc || cache->len != len ||
+         memcmp(cache->hash, hash, 20) != 0)) {
+        drop_snapshot(server);
+    }
+
+    if (cache->msg == NULL) {
+        bool owned;
+        ot_op* state = state_at(doc, len, &owned);
+        cache->msg = (state != NULL) ? ot_encode_msg(state) : NULL;
+        if (owned) {
+            ot_free_op(state);
+        }
+        if (cache->msg == NULL) {
+            return NULL;
+        }
+        cache->doc = doc;
+        cache->len = len;
+        memcpy(cache->hash, hash, 20);
+    }
+
+    return ot_msg_retain(cache->msg);
+}
+
+const char* ot_server_snapshot(ot_server* server, size_t* len) {
+    ot_msg* msg = ot_server_snapshot_msg(server);
+    if (msg == NULL) {
+        if (len != NULL) {
+            *len = 0;
+        }
+        return NULL;
+    }
+
+    // The cache keeps its own reference, so the data outlives this one.
+    ot_msg_release(msg);
+    if (len != NULL) {
+        *len = msg->len;
+    }
+    return msg->data;
+}
+
+// Returns the op that was appended for the given key, or NULL if it isn't
+// remembered.
+static ot_op* find_duplicate(const ot_server* server, const char* key) {
+    size_t i;
+    if (!ot_dedup_find(&server->dedup, key, &i) || server->doc == NULL ||
+        i >= ot_doc_len(server->doc)) {
+        return NULL;
+    }
+
+    return ot_doc_op(server->doc, i);
+}
+
+static ot_err sequence(ot_server* server, ot_op* op, ot_op** appended,
+                       char** text) {
+    ot_err err = validate(server->doc, op);
+    if (err != OT_ERR_NONE) {
+        ot_free_op(op);
+        return err;
+    }
+
+    // The key is taken before op is transformed, since that's how a
+    // retransmission of it will look.
+    char key[20];
+    bool dedup = server->dedup.cap > 0;
+    if (dedup) {
+        ot_dedup_key(op, key);
+        ot_op* original = find_duplicate(server, key);
+        if (original != NULL) {
+            OT_LOG_OPS(OT_LOG_INFO, OT_ERR_DUPLICATE,
+                       "Received an operation that was already appended.",
+                       "Operation", op, NULL);
+            ot_free_op(op);
+            *appended = original;
+            return OT_ERR_DUPLICATE;
+        }
+    }
+
     ot_doc* doc = server->doc;
-    err = OT_ERR_NONE;
     if (doc == NULL) {
-        fputs("[INFO] Creating a new document.\n", stderr);
+        OT_LOG(OT_LOG_INFO, OT_ERR_NONE, "Creating a new document.");
         server->doc = ot_new_doc();
         doc = server->doc;
-        err = append_op(server, dec);
-    } else if (can_append(doc, dec)) {
-        err = append_op(server, dec);
+        err = append_op(server, op, appended, text);
+    } else if (can_append(doc, op)) {
+        err = append_op(server, op, appended, text);
     } else {
-        ot_op* op_prime = xform(doc, dec);
-        ot_free_op(dec);
+        ot_op* op_prime = xform(server, op);
+        ot_free_op(op);
         if (op_prime == NULL) {
             err = OT_ERR_XFORM_FAILED;
         } else {
-            err = append_op(server, op_prime);
+            err = append_op(server, op_prime, appended, text);
         }
     }
 
-    char* doc_enc;
-    if (doc->composed == NULL) {
-        doc_enc = "EMPTY";
+    if (err == OT_ERR_NONE) {
+        if (dedup) {
+            ot_dedup_add(&server->dedup, key, ot_doc_len(doc) - 1);
+        }
+        OT_LOG_OPS(OT_LOG_DEBUG, OT_ERR_NONE, "Document updated.", "Document",
+                   doc->composed, NULL);
     } else {
-        doc_enc = ot_encode(doc->composed);
+        OT_LOG(OT_LOG_INFO, OT_ERR_NONE,
+               "Document unchanged due to an error.\n\tError: %d", err);
     }
 
-    if (err == OT_ERR_NONE) {
-        fprintf(stderr, "[INFO] Document updated.\n"
-                        "\tDocument: %s\n",
-                doc_enc);
-    } else {
-        send_err(server, err);
-        fprintf(stderr, "[INFO] Document unchanged due to an error.\n"
-                        "\tError: %d\n"
-                        "\tDocument: %s\n",
-                err, doc_enc);
+    return err;
+}
+
+ot_err ot_server_sequence(ot_server* server, ot_op* op, ot_op** appended) {
+    return sequence(server, op, appended, NULL);
+}
+
+ot_err ot_server_sequence_unhashed(ot_server* server, ot_op* op,
+                                   ot_op** appended, char** text) {
+    *text = NULL;
+    return sequence(server, op, appended, text);
+}
+
+// The server ops composed after a parent that ops in a batch were based on.
+typedef struct batch_suffix {
+    char parent[20];
+    ot_op* composed;
+} batch_suffix;
+
+// Returns the composition of the server ops after parent, computing it the
+// first time it's needed in the batch. Concurrent ops are usually based on one
+// of a few recent states, so most of the batch shares a handful of suffixes.
+static ot_op* find_suffix(const ot_doc* doc, array* suffixes,
+                          const char* parent) {
+    batch_suffix* data = suffixes->data;
+    for (size_t i = 0; i < suffixes->len; ++i) {
+        if (memcmp(data[i].parent, parent, 20) == 0) {
+            return data[i].composed;
+        }
+    }
+
+    ot_op* composed = ot_doc_compose_after(doc, parent);
+    if (composed == NULL) {
+        return NULL;
+    }
+
+    batch_suffix* suffix = array_append(suffixes);
+    memcpy(suffix->parent, parent, 20);
+    suffix->composed = composed;
+    return composed;
+}
+
+// Transforms a decoded op so that it applies after the document's state at the
+// start of the batch followed by the ops already accepted into the batch.
+// Takes ownership of op and returns the transformed op, or NULL on failure.
+static ot_op* xform_into_batch(const ot_doc* doc, const char* head,
+                               array* suffixes, ot_op* accepted, ot_op* op) {
+    if (memcmp(op->parent, head, 20) != 0) {
+        ot_op* suffix = find_suffix(doc, suffixes, op->parent);
+        if (suffix == NULL) {
+            OT_LOG_OPS(OT_LOG_ERROR, OT_ERR_COMPOSE_FAILED,
+                       "Couldn't find the operation's parent.", "Operation",
+                       op, NULL);
+            ot_free_op(op);
+            return NULL;
+        }
+
+        ot_op* op_prime = xform_against(suffix, op);
+        ot_free_op(op);
+        op = op_prime;
     }
 
-    if (doc->composed != NULL) {
-        free(doc_enc);
+    if (op == NULL || accepted == NULL) {
+        return op;
     }
+
+    ot_op* op_prime = xform_against(accepted, op);
+    ot_free_op(op);
+    return op_prime;
+}
+
+void ot_server_receive_batch(ot_server* server, const char* const* msgs,
+                             size_t len) {
+    if (server->doc == NULL) {
+        OT_LOG(OT_LOG_INFO, OT_ERR_NONE, "Creating a new document.");
+        server->doc = ot_new_doc();
+    }
+    ot_doc* doc = server->doc;
+
+    char head[20] = { 0 };
+    if (ot_doc_len(doc) > 0) {
+        memcpy(head, ot_doc_last(doc)->hash, 20);
+    }
+
+    array suffixes;
+    array_init(&suffixes, sizeof(batch_suffix));
+    ot_op** ops = malloc(sizeof(ot_op*) * len);
+    char (*keys)[20] = malloc(sizeof(*keys) * len);
+    size_t count = 0;
+    bool dedup = server->dedup.cap > 0;
+
+    // The composition of every op accepted into the batch so far. Each op is
+    // transformed against it so that the batch can be appended in order.
+    ot_op* accepted = NULL;
+
+    for (size_t i = 0; i < len; ++i) {
+        OT_LOG(OT_LOG_DEBUG, OT_ERR_NONE, "Received message.\n\tJSON: %s",
+               msgs[i]);
+
+        // Resume requests are answered straight away, from the state before
+        // the batch, and the ops after them are sent once it's appended.
+        ot_op* op = decode_received(server, msgs[i]);
+        if (op == NULL) {
+            continue;
+        }
+
+        ot_err err = validate(doc, op);
+        if (err != OT_ERR_NONE) {
+            reply_err(server, op->client_id, err);
+            ot_free_op(op);
+            continue;
+        }
+
+        // Ops already in the document are acknowledged again, while ones that
+        // are repeated within the batch are acknowledged once the first copy
+        // is appended.
+        if (dedup) {
+            ot_dedup_key(op, keys[count]);
+            ot_op* original = find_duplicate(server, keys[count]);
+            bool repeated = false;
+            for (size_t j = 0; j < count && !repeated; ++j) {
+                repeated = memcmp(keys[j], keys[count], 20) == 0;
+            }
+            if (original != NULL || repeated) {
+                OT_LOG_OPS(OT_LOG_INFO, OT_ERR_DUPLICATE,
+                           "Received an operation that was already appended.",
+                           "Operation", op, NULL);
+                if (original != NULL) {
+                    ot_server_acknowledge(server, original);
+                }
+                ot_free_op(op);
+                continue;
+            }
+        }
+
+        uint32_t client_id = op->client_id;
+        op = xform_into_batch(doc, head, &suffixes, accepted, op);
+        if (op == NULL) {
+            reply_err(server, client_id, OT_ERR_XFORM_FAILED);
+            continue;
+        }
+
+        ot_op* next = (accepted == NULL) ? ot_dup_op(op)
+                                         : ot_compose(accepted, op);
+        if (next == NULL) {
+            reply_err(server, client_id, OT_ERR_APPEND_FAILED);
+            ot_free_op(op);
+            continue;
+        }
+
+        if (accepted != NULL) {
+            ot_free_op(accepted);
+        }
+        accepted = next;
+        ops[count++] = op;
+    }
+
+    if (accepted != NULL) {
+        ot_free_op(accepted);
+    }
+    batch_suffix* data = suffixes.data;
+    for (size_t i = 0; i < suffixes.len; ++i) {
+        ot_free_op(data[i].composed);
+    }
+    array_free(&suffixes);
+
+    // The first op of an empty document is appended by itself so that a
+    // failed batch never leaves some of its ops appended.
+    ot_op** batch = ops;
+    const char (*batch_keys)[20] = (const char (*)[20])keys;
+    size_t batch_len = count;
+    if (batch_len > 0 && ot_doc_len(doc) == 0) {
+        uint32_t client_id = batch[0]->client_id;
+        ot_op* appended;
+        ot_err err = append_op(server, batch[0], &appended, NULL);
+        if (err != OT_ERR_NONE) {
+            reply_err(server, client_id, err);
+        } else {
+            if (dedup) {
+                ot_dedup_add(&server->dedup, batch_keys[0], 0);
+            }
+            ot_server_broadcast(server, appended);
+        }
+        ++batch;
+        ++batch_keys;
+        --batch_len;
+    }
+
+    ot_err err = ot_doc_append_batch(doc, batch, batch_len);
+    if (err == OT_ERR_NONE && batch_len > 0) {
+        drop_snapshot(server);
+    }
+    for (size_t i = 0; i < batch_len; ++i) {
+        if (err != OT_ERR_NONE) {
+            reply_err(server, batch[i]->client_id, err);
+            ot_free_op(batch[i]);
+            continue;
+        }
+
+        if (dedup) {
+            ot_dedup_add(&server->dedup, batch_keys[i],
+                         ot_doc_len(doc) - batch_len + i);
+        }
+        ot_server_broadcast(server, batch[i]);
+    }
+
+    if (err != OT_ERR_NONE) {
+        OT_LOG(OT_LOG_ERROR, err, "Appending a batch of %zu operations failed.",
+               batch_len);
+    } else {
+        OT_LOG_OPS(OT_LOG_DEBUG, OT_ERR_NONE, "Document updated.", "Document",
+                   doc->composed, NULL);
+    }
+
+    free(keys);
+    free(ops);
 }
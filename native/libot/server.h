@@ -9,19 +9,368 @@
 #include "compose.h"
 #include "encode.h"
 #include "decode.h"
+#include "log.h"
+#include "dedup.h"
+#include "wal.h"
+
+// Sends a message about the document with the given ID. doc_id is NULL when
+// the message couldn't be associated with a document (e.g., it was malformed).
+typedef int (*ot_route_func)(const char* doc_id, const char* json);
+
+// The clients that a message sent with an ot_send_to_func is meant for.
+typedef enum {
+    // Every client of the document. The list of clients is empty.
+    OT_SEND_ALL = 0,
+
+    // Only the listed clients.
+    OT_SEND_TO = 1,
+
+    // Every client except the listed ones.
+    OT_SEND_EXCEPT = 2
+} ot_recipients;
+
+// Sends a shared message to some of the document's clients, given by to and a
+// list of len client IDs. A recipient that keeps the message after returning
+// must take its own reference with ot_msg_retain.
+typedef int (*ot_send_to_func)(ot_recipients to, const uint32_t* client_ids,
+                               size_t len, ot_msg* msg);
+
+// Like ot_send_to_func, for a message about the document with the given ID.
+typedef int (*ot_route_to_func)(const char* doc_id, ot_recipients to,
+                                const uint32_t* client_ids, size_t len,
+                                ot_msg* msg);
+
+// Appended ops that are held back so that the ops appended during a short
+// window can be sent as one message. See ot_server_set_window.
+typedef struct ot_window {
+    // Length of the window in seconds. 0 disables the window.
+    double secs;
+
+    // When the first op in the window was appended.
+    double start;
+
+    // Copies of the held ops, in the order they were appended.
+    array ops;
+} ot_window;
+
+// An appended op that's waiting for its write-ahead log record to be durable
+// before it's sent.
+typedef struct ot_unsynced {
+    ot_op* op;
+    uint64_t seq;
+} ot_unsynced;
+
+// The composition of the server ops in history[start, end), which every op
+// whose parent is the op before start is transformed against.
+typedef struct ot_bridge {
+    char parent[20];
+    size_t start;
+    size_t end;
+    ot_op* composed;
+    uint64_t used;
+} ot_bridge;
+
+// A small LRU cache of bridges. Clients that lag behind by the same amount send
+// ops with the same parent, so each of them can reuse the bridge instead of
+// composing the server's history again. When the document has grown since a
+// bridge was cached, only the new ops are composed onto it.
+typedef struct ot_bridge_cache {
+    ot_bridge* entries;
+    size_t len;
+    size_t cap;
+    uint64_t tick;
+    uint64_t hits;
+    uint64_t misses;
+} ot_bridge_cache;
+
+// The encoded composed state of a document at one version, which is handed to
+// every client that joins while the document is at that version.
+typedef struct ot_snapshot_cache {
+    ot_msg* msg;
+    const ot_doc* doc;
+    size_t len;
+    char hash[20];
+} ot_snapshot_cache;
+
+// What's been sent to one client but not yet written to its connection. See
+// ot_server_set_outbox_limit.
+typedef struct ot_outbox {
+    uint32_t client_id;
+    size_t queued;
+
+    // The state the client reaches once it has received everything it was
+    // sent.
+    char hash[20];
+
+    // Whether ops have stopped being sent to the client because its queue went
+    // over the limit.
+    bool overflowed;
+
+    // Set while a message that the client is listed for is being delivered.
+    bool listed;
+
+    // Index + 1 of the next outbox in the same bucket, or 0.
+    uint32_t next;
+} ot_outbox;
+
+typedef struct ot_outboxes {
+    // Maximum number of bytes queued for one client. 0 disables the limit.
+    size_t limit;
+
+    // Number of times a client went over the limit.
+    uint64_t overflows;
+
+    array boxes;
+
+    // Index + 1 of the first outbox in each bucket, or 0, so that a client's
+    // outbox is found in O(1). There are a power of two buckets, at least as
+    // many as outboxes.
+    uint32_t* buckets;
+    size_t buckets_len;
+} ot_outboxes;
 
 typedef struct {
     send_func send;
     ot_event_func event;
     ot_doc* doc;
+
+    // When route is set, outgoing messages are passed to route along with id
+    // instead of being sent with send. When route_to is set, it's used the
+    // same way as send_to, along with id, and takes the place of route.
+    const char* id;
+    ot_route_func route;
+    ot_route_to_func route_to;
+
+    // When send_msg is set (and route isn't), outgoing messages are passed to
+    // it as shared messages instead of being sent with send. Each appended op
+    // is encoded once and the same message can be queued for every client.
+    ot_send_msg_func send_msg;
+
+    // When send_to is set (and route isn't), it's used instead of send_msg and
+    // send. The client that sent an op is sent a short acknowledgement of it
+    // while every other client is sent the op itself, and errors caused by an
+    // op are only sent to its client.
+    ot_send_to_func send_to;
+
+    // A zeroed cache (capacity 0) is disabled.
+    ot_bridge_cache bridges;
+
+    // A zeroed window is disabled.
+    ot_window window;
+
+    // Dropped whenever an op is appended.
+    ot_snapshot_cache snapshot;
+
+    // The most recently appended ops, so that ones sent again can be
+    // recognized. A zeroed table is disabled.
+    ot_dedup dedup;
+
+    // A zeroed set of outboxes is disabled.
+    ot_outboxes outboxes;
+
+    // When wal is set, appended ops are logged to it and held in unsynced, in
+    // the order they were appended, until they're durable.
+    ot_wal* wal;
+    array unsynced;
 } ot_server;
 
 ot_server* ot_new_server(send_func send, ot_event_func event);
 
 void ot_free_server(ot_server* server);
 
+// Switches the server to doc. Ops held for the broadcast window or the
+// write-ahead log belong to the old document, so they're sent first (see
+// ot_server_sync).
 void ot_server_open(ot_server* server, ot_doc* doc);
 
+// Sets how many bridges the server caches. The cache is disabled by default,
+// and setting it to 0 disables it again. Cached bridges are dropped.
+void ot_server_set_bridge_cache(ot_server* server, size_t cap);
+
+// Sets how many of the most recently appended ops the server remembers. An op
+// that's received again (e.g., because its client retried after a timeout) is
+// recognized if the original is still remembered, and is acknowledged again
+// instead of being appended twice. The check is disabled by default, and
+// setting it to 0 disables it again. Remembered ops are forgotten.
+void ot_server_set_dedup(ot_server* server, size_t cap);
+
+// Sets a callback which is sent shared messages instead of strings. Passing
+// NULL sends strings with send again.
+void ot_server_set_send_msg(ot_server* server, ot_send_msg_func send_msg);
+
+// Sets a callback which is told who each message is for. Passing NULL goes
+// back to broadcasting every message.
+void ot_server_set_send_to(ot_server* server, ot_send_to_func send_to);
+
+// Limits how many bytes can be queued for each client. send_to hands messages
+// to the transport without knowing whether a client's connection is keeping up,
+// so each client that's tracked with ot_server_connect has a count of the bytes
+// it was sent, which the transport reduces with ot_server_sent as they're
+// written. A client whose queue would go over the limit stops being sent ops.
+// Once its queue drains to half the limit, it's sent everything it missed as a
+// single catch-up (the same as if it had resumed), with the ops it missed
+// composed into one op, or a snapshot if the server no longer has its state.
+// Other messages, such as errors, are always sent. This requires send_to.
+// Setting bytes to 0 disables the limit.
+void ot_server_set_outbox_limit(ot_server* server, size_t bytes);
+
+// Starts tracking the queue of a client that has just been sent the document's
+// current state.
+void ot_server_connect(ot_server* server, uint32_t client_id);
+
+// Stops tracking a client's queue.
+void ot_server_disconnect(ot_server* server, uint32_t client_id);
+
+// Tells the server that bytes of the messages sent to a client were written to
+// its connection. If the client went over the outbox limit and its queue has
+// drained enough, it's sent a catch-up.
+void ot_server_sent(ot_server* server, uint32_t client_id, size_t bytes);
+
+// Sets a broadcast window of secs seconds. Ops appended within a window are
+// held and then composed into one message, so clients transform once per
+// window instead of once per op, and the intermediate hashes aren't sent.
+// Clients that sent an op during the window are instead sent the ops before and
+// after their own (each composed into one message) with an acknowledgement in
+// between. The window requires send_to; without it ops are always sent as soon
+// as they're appended. Setting secs to 0 disables the window after flushing it.
+//
+// A window is flushed when an op is appended after it has ended, before any
+// other message is sent, or by calling ot_server_flush. Since the server has no
+// timer, whatever drives it should call ot_server_flush every secs seconds so
+// that the last ops of a burst aren't held indefinitely.
+void ot_server_set_window(ot_server* server, double secs);
+
+// Sends any ops held by the broadcast window, along with any ops held for the
+// write-ahead log that have become durable. This must be called from the thread
+// that sends the server's messages.
+void ot_server_flush(ot_server* server);
+
+// Makes appended ops durable before they're sent. Each op is written to the
+// log when it's broadcast, and its acknowledgement and broadcast are held until
+// the log has synced it. Since the log syncs on its own thread, whatever drives
+// the server should call ot_server_flush when the log reports a synced group
+// (see ot_wal_opts), or ot_server_sync to wait for it. The server doesn't own
+// the log, which can be shared by many servers. Passing NULL stops logging
+// after the held ops are synced.
+void ot_server_set_wal(ot_server* server, ot_wal* wal);
+
+// Blocks until every op held for the write-ahead log is durable, and then
+// sends them. If the log has failed, the held ops are dropped instead.
+void ot_server_sync(ot_server* server);
+
 void ot_server_receive(ot_server* server, const char* op);
 
+// A received message, decoded by ot_server_decode.
+typedef struct ot_received {
+    // The decoded op, which the caller owns, or NULL if the message is a
+    // resume request or couldn't be decoded.
+    ot_op* op;
+
+    // Set if the message is a resume request for the ops after hash.
+    bool resume;
+    char hash[20];
+
+    // The client that sent the message, which is known once an op's header or
+    // a resume request is decoded, even if the rest of the op fails.
+    bool has_sender;
+    uint32_t client_id;
+
+    ot_err err;
+} ot_received;
+
+// Decodes a message the way ot_server_receive does, without sending anything.
+// Resume requests are recognized first, and then an op's header is decoded
+// before its components. If doc isn't NULL, an op whose parent isn't in its
+// history is rejected from its header with OT_ERR_XFORM_FAILED. Passing NULL
+// lets a thread that doesn't own the document decode messages, leaving missing
+// parents to be found when the op is sequenced.
+void ot_server_decode(const ot_doc* doc, const char* json,
+                      ot_received* received);
+
+// Answers a resume request decoded by ot_server_decode by sending the client a
+// catch-up. This needs send_to; other servers should use ot_server_catch_up.
+void ot_server_resume(ot_server* server, const char* hash,
+                      uint32_t client_id);
+
+// Answers a resume request from a reconnecting client (see ot_client_resume)
+// with the ops it missed, and returns the reply, which must be sent only to
+// that client and freed by the caller. Returns NULL if request isn't a valid
+// resume request. Servers with send_to answer resume requests passed to
+// ot_server_receive by themselves; others should check for them with
+// ot_decode_resume and call this instead.
+char* ot_server_catch_up(ot_server* server, const char* request);
+
+// Sends a message to the server's clients, either with send or, if it's set,
+// with route.
+void ot_server_send(ot_server* server, const char* json);
+
+// Sends a shared message to the server's clients. It's passed to send_to or
+// send_msg without being copied if either is set, and otherwise sent as a
+// string. The caller keeps its reference to msg.
+void ot_server_send_msg(ot_server* server, ot_msg* msg);
+
+// Sends an appended op to the server's clients, encoding it only once. With
+// send_to, the op's own client is only sent an acknowledgement. The op is held
+// instead if a broadcast window is set, or until it's durable if a write-ahead
+// log is set.
+void ot_server_broadcast(ot_server* server, const ot_op* op);
+
+// Sends an error caused by a message from the given client to that client
+// only. Without send_to, it's sent to every client.
+void ot_server_reply_err(ot_server* server, uint32_t client_id, ot_err err);
+
+// Acknowledges an op that was already appended to the op's client again. This
+// needs send_to; other servers can't reply to a single client, so the
+// duplicate is dropped and the client learns about its op when it resumes.
+void ot_server_acknowledge(ot_server* server, const ot_op* op);
+
+// Applies an already decoded operation to the server's document and sends the
+// result. The server takes ownership of op.
+void ot_server_receive_op(ot_server* server, ot_op* op);
+
+// Receives several messages for the server's document at once, such as every
+// op that arrived from clients typing at the same time. The ops are transformed
+// against the server ops they haven't seen and against each other, and are then
+// appended as a single sequence. The document ends up in the same state as if
+// each message had been passed to ot_server_receive. Messages are decoded the
+// same way, so resume requests in the batch are answered and ops whose parent
+// is missing are rejected from their header. Errors are sent as they're found,
+// and the appended ops are sent in order once the batch is appended.
+void ot_server_receive_batch(ot_server* server, const char* const* msgs,
+                             size_t len);
+
+// Returns the document's composed state encoded as JSON, which is what a
+// client that joins needs to catch up. The encoding is cached until the next
+// append, so any number of clients can join at the same version for the cost
+// of one encode. If len isn't NULL, it's set to the length of the JSON. Returns
+// NULL if the document is empty or couldn't be encoded. The string is owned by
+// the server and is only valid until the next op is appended.
+//
+// With a write-ahead log, the snapshot (like a catch-up) only includes ops that
+// are durable, since the others haven't been sent yet and may still be lost.
+// The state before the held ops is rebuilt from the document's keyframes, as
+// plain text.
+const char* ot_server_snapshot(ot_server* server, size_t* len);
+
+// Like ot_server_snapshot, but returns the snapshot as a shared message with a
+// new reference, which the caller must release. The message stays valid after
+// the cache is dropped, so it can be queued on a socket.
+ot_msg* ot_server_snapshot_msg(ot_server* server);
+
+// Transforms an operation against any operations it hasn't seen and appends it
+// to the server's document without sending anything. The server takes
+// ownership of op. On success, *appended is set to the operation as it was
+// appended, which is owned by the document and only valid until the next
+// append. If op was already appended, OT_ERR_DUPLICATE is returned and
+// *appended is set to the op that was appended the first time.
+ot_err ot_server_sequence(ot_server* server, ot_op* op, ot_op** appended);
+
+// Like ot_server_sequence, but the op is appended with ot_doc_append_unhashed,
+// so its hash isn't computed. When an op is appended, *text is set as it is by
+// ot_doc_append_unhashed, and the hash must be set with ot_doc_set_hash before
+// the op is sent or another op can be based on it. Otherwise *text is set to
+// NULL.
+ot_err ot_server_sequence_unhashed(ot_server* server, ot_op* op,
+                                   ot_op** appended, char** text);
+
 #endif
@@ -73,6 +73,9 @@ extern struct ltc_hash_descriptor {
 int sha1_init(hash_state* md);
 int sha1_process(hash_state* md, const char* in, uint32_t inlen);
 int sha1_done(hash_state* md, char* hash);
+// Computes the SHA-1 of a document's text, which is what identifies the state
+// after an op.
+void hash_text(const char* text, char* hash);
 void hash_op(ot_op* op);
 extern const struct ltc_hash_descriptor sha1_desc;
 
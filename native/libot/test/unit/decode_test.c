@@ -206,6 +206,67 @@ static bool decode_doc_with_insert_skip_and_delete_components(char** msg) {
     return true;
 }
 
+static bool decode_doc_parallel_matches_sequential_decode(char** msg) {
+    const char* const ENCODED_JSON =
+        "[{\"clientId\":0,\"parent\":\"00\",\"hash\":\"00\",\"components\":["
+        "{\"type\":\"insert\",\"text\":\"abc\"}]},{\"clientId\":1,\"parent\":"
+        "\"00\",\"hash\":\"00\",\"components\":[{\"type\":\"skip\",\"count\":3},"
+        "{\"type\":\"insert\",\"text\":\"def\"}]},{\"clientId\":2,\"parent\":"
+        "\"00\",\"hash\":\"00\",\"components\":[{\"type\":\"delete\",\"count\":"
+        "1},{\"type\":\"skip\",\"count\":5}]}]";
+
+    ot_doc* expected = ot_new_doc();
+    ot_err err = ot_decode_doc(expected, ENCODED_JSON);
+    ASSERT_INT_EQUAL(OT_ERR_NONE, err,
+                     "Sequentially decoding the document returned an error.",
+                     msg);
+
+    ot_decode_opts opts = { .threads = 3, .window = 1 };
+    ot_decode_stats stats;
+    ot_doc* actual = ot_new_doc();
+    err = ot_decode_doc_parallel(actual, ENCODED_JSON, &opts, &stats);
+    ASSERT_INT_EQUAL(OT_ERR_NONE, err,
+                     "Decoding the document in parallel returned an error.",
+                     msg);
+    ASSERT_INT_EQUAL(3, (int)stats.ops, "Stats had the wrong number of ops.",
+                     msg);
+    ASSERT_INT_EQUAL((int)expected->history.len, (int)actual->history.len,
+                     "The document's length was incorrect.", msg);
+
+    ot_op* expected_history = expected->history.data;
+    ot_op* actual_history = actual->history.data;
+    for (size_t i = 0; i < expected->history.len; ++i) {
+        ASSERT_OP_EQUAL(expected_history + i, actual_history + i,
+                        "Decoded operation was incorrect.", msg);
+    }
+    ASSERT_OP_EQUAL(expected->composed, actual->composed,
+                    "The document's composed state was incorrect.", msg);
+
+    ot_free_doc(expected);
+    ot_free_doc(actual);
+    return true;
+}
+
+static bool decode_doc_parallel_stops_at_invalid_op(char** msg) {
+    const char* const ENCODED_JSON =
+        "[{\"clientId\":0,\"parent\":\"00\",\"hash\":\"00\",\"components\":["
+        "{\"type\":\"insert\",\"text\":\"abc\"}]},{\"clientId\":1,\"hash\":"
+        "\"00\",\"components\":[]},{\"clientId\":2,\"parent\":\"00\",\"hash\":"
+        "\"00\",\"components\":[{\"type\":\"skip\",\"count\":3}]}]";
+
+    ot_decode_opts opts = { .threads = 2, .window = 2 };
+    ot_decode_stats stats;
+    ot_doc* doc = ot_new_doc();
+    ot_err err = ot_decode_doc_parallel(doc, ENCODED_JSON, &opts, &stats);
+    ASSERT_INT_EQUAL(OT_ERR_PARENT_MISSING, err,
+                     "Decode didn't return the correct error.", msg);
+    ASSERT_INT_EQUAL(1, (int)doc->history.len,
+                     "Ops after the invalid op were appended.", msg);
+
+    ot_free_doc(doc);
+    return true;
+}
+
 static bool decode_returns_correct_error_code(char** msg) {
     const char* ENCODED_JSON = "{\"errorCode\":1}";
     ot_err err = ot_decode(NULL, ENCODED_JSON);
@@ -215,6 +276,121 @@ static bool decode_returns_correct_error_code(char** msg) {
     return true;
 }
 
+static bool decode_ack_returns_hash_and_rejects_ops(char** msg) {
+    char hash[20];
+    for (int i = 0; i < 20; ++i) {
+        hash[i] = (char)(i * 13);
+    }
+
+    char* enc = ot_encode_ack(hash);
+    char decoded[20];
+    ot_err err = ot_decode_ack(decoded, enc);
+    ASSERT_INT_EQUAL(OT_ERR_NONE, err, "The ack couldn't be decoded.", msg);
+    ASSERT_CONDITION(memcmp(hash, decoded, 20) == 0, "matching hash",
+                     "different hash", "The ack had the wrong hash.", msg);
+    free(enc);
+
+    const char* OP_JSON = "{\"clientId\":1,\"parent\":\"00\",\"hash\":\"00\","
+                          "\"components\":[]}";
+    err = ot_decode_ack(decoded, OP_JSON);
+    ASSERT_INT_EQUAL(OT_ERR_HASH_MISSING, err, "An op was decoded as an ack.",
+                     msg);
+
+    return true;
+}
+
+static bool decode_header_then_body_matches_full_decode(char** msg) {
+    const char* const JSON =
+        "{ \"docId\": \"notes\", \"clientId\": 7, \"parent\": \"0a0b\","
+        " \"hash\": \"0c\", \"components\": [{ \"type\": \"skip\","
+        " \"count\": 2 }, { \"type\": \"insert\", \"text\": \"a]}\\\"\" }]}";
+
+    ot_header header;
+    ot_err err = ot_decode_header(&header, JSON);
+    ASSERT_INT_EQUAL(OT_ERR_NONE, err, "The header couldn't be decoded.", msg);
+    ASSERT_INT_EQUAL(5, header.doc_id_len, "The doc ID had the wrong length.",
+                     msg);
+    ASSERT_CONDITION(memcmp(header.doc_id, "notes", 5) == 0, "notes",
+                     "a different ID", "The doc ID was wrong.", msg);
+
+    ot_op* expected = ot_new_op();
+    ot_decode(expected, JSON);
+    ot_op* actual = ot_new_op();
+    err = ot_decode_body(actual, &header);
+    ASSERT_INT_EQUAL(OT_ERR_NONE, err, "The body couldn't be decoded.", msg);
+    ASSERT_OP_EQUAL(expected, actual, "The op was decoded differently.", msg);
+
+    ot_free_op(expected);
+    ot_free_op(actual);
+    return true;
+}
+
+static bool decode_header_fails_if_hash_is_missing(char** msg) {
+    const char* const JSON = "{\"clientId\":1,\"parent\":\"00\","
+                             "\"components\":[]}";
+
+    ot_header header;
+    ot_err err = ot_decode_header(&header, JSON);
+    ASSERT_INT_EQUAL(OT_ERR_HASH_MISSING, err,
+                     "A header without a hash was decoded.", msg);
+
+    return true;
+}
+
+static bool decode_doc_state_restores_keyframes(char** msg) {
+    ot_doc* doc = ot_new_doc();
+    ot_doc_set_keyframe_interval(doc, 2);
+    const char* texts[] = { "a", "b", "c", "d", "e" };
+    for (size_t i = 0; i < 5; ++i) {
+        ot_op* op = ot_new_op();
+        ot_skip(op, doc->size);
+        ot_insert(op, texts[i]);
+        ot_doc_append(doc, &op);
+    }
+
+    char* enc = ot_encode_doc_state(doc);
+    ot_doc* restored = ot_new_doc();
+    ot_err err = ot_decode_doc_state(restored, enc);
+    ASSERT_INT_EQUAL(OT_ERR_NONE, err, "Decoding the state failed.", msg);
+    ASSERT_INT_EQUAL(doc->keyframes.len, restored->keyframes.len,
+                     "The keyframes weren't restored.", msg);
+    ot_keyframe* expected = doc->keyframes.data;
+    ot_keyframe* actual = restored->keyframes.data;
+    for (size_t i = 0; i < doc->keyframes.len; ++i) {
+        ASSERT_INT_EQUAL(expected[i].index, actual[i].index,
+                         "A keyframe has the wrong index.", msg);
+        ASSERT_STR_EQUAL(expected[i].text, actual[i].text,
+                         "A keyframe has the wrong text.", msg);
+    }
+    ASSERT_INT_EQUAL(ot_doc_bytes(doc), ot_doc_bytes(restored),
+                     "The restored keyframes weren't counted.", msg);
+
+    free(enc);
+    ot_free_doc(restored);
+    ot_free_doc(doc);
+    return true;
+}
+
+static bool decode_doc_state_rejects_a_missing_history(char** msg) {
+    const char* invalid[] = {
+        "{}",
+        "{\"history\":5}",
+        "{\"history\":{\"a\":1}}",
+        "{\"history\":[{}],\"composed\":[]}",
+        "{\"history\":[{}],\"composed\":{},\"keyframes\":\"a\"}",
+    };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i) {
+        ot_doc* doc = ot_new_doc();
+        ot_err err = ot_decode_doc_state(doc, invalid[i]);
+        ASSERT_INT_EQUAL(OT_ERR_INVALID_JSON, err,
+                         "An invalid document state was decoded.", msg);
+        ASSERT_INT_EQUAL(0, ot_doc_len(doc), "The document was changed.", msg);
+        ot_free_doc(doc);
+    }
+
+    return true;
+}
+
 results decode_tests() {
     RUN_TEST(decode_returns_op_with_correct_skip_component);
     RUN_TEST(decode_returns_op_with_correct_client_id);
@@ -224,7 +400,14 @@ results decode_tests() {
     RUN_TEST(decode_fails_if_components_field_is_missing);
     RUN_TEST(decode_empty_doc_returns_doc_with_no_components);
     RUN_TEST(decode_doc_with_insert_skip_and_delete_components);
+    RUN_TEST(decode_doc_parallel_matches_sequential_decode);
+    RUN_TEST(decode_doc_parallel_stops_at_invalid_op);
     RUN_TEST(decode_returns_correct_error_code);
+    RUN_TEST(decode_ack_returns_hash_and_rejects_ops);
+    RUN_TEST(decode_header_then_body_matches_full_decode);
+    RUN_TEST(decode_header_fails_if_hash_is_missing);
+    RUN_TEST(decode_doc_state_restores_keyframes);
+    RUN_TEST(decode_doc_state_rejects_a_missing_history);
 
     return (results) { passed, failed };
 }
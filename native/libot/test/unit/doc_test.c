@@ -0,0 +1,474 @@
+#include "../../doc.h"
+#include "unit.h"
+
+// Appends an op to doc that inserts text at the end of the document.
+static void append_text(ot_doc* doc, const char* text) {
+    ot_op* op = ot_new_op();
+    ot_skip(op, doc->size);
+    ot_insert(op, text);
+    ot_doc_append(doc, &op);
+}
+
+static bool snapshot_at_returns_historical_text(char** msg) {
+    const char* const EXPECTED = "abc";
+
+    ot_doc* doc = ot_new_doc();
+    ot_doc_set_keyframe_interval(doc, 2);
+    append_text(doc, "a");
+    append_text(doc, "b");
+    append_text(doc, "c");
+    ot_op* third = ot_doc_last(doc);
+    char hash[20];
+    memcpy(hash, third->hash, 20);
+    append_text(doc, "d");
+    append_text(doc, "e");
+
+    char* actual = ot_doc_snapshot_at(doc, hash);
+    ASSERT_STR_EQUAL(EXPECTED, actual, "Snapshot was incorrect.", msg);
+
+    free(actual);
+    ot_free_doc(doc);
+    return true;
+}
+
+static bool snapshot_at_uses_keyframe_for_exact_match(char** msg) {
+    const char* const EXPECTED = "ab";
+
+    ot_doc* doc = ot_new_doc();
+    ot_doc_set_keyframe_interval(doc, 2);
+    append_text(doc, "a");
+    append_text(doc, "b");
+    char hash[20];
+    memcpy(hash, ot_doc_last(doc)->hash, 20);
+    append_text(doc, "c");
+
+    ASSERT_INT_EQUAL(1, (int)doc->keyframes.len,
+                     "Wrong number of keyframes were stored.", msg);
+
+    char* actual = ot_doc_snapshot_at(doc, hash);
+    ASSERT_STR_EQUAL(EXPECTED, actual, "Snapshot was incorrect.", msg);
+
+    free(actual);
+    ot_free_doc(doc);
+    return true;
+}
+
+static bool snapshot_at_without_keyframes(char** msg) {
+    const char* const EXPECTED = "ab";
+
+    ot_doc* doc = ot_new_doc();
+    append_text(doc, "a");
+    append_text(doc, "b");
+    char hash[20];
+    memcpy(hash, ot_doc_last(doc)->hash, 20);
+    append_text(doc, "c");
+
+    char* actual = ot_doc_snapshot_at(doc, hash);
+    ASSERT_STR_EQUAL(EXPECTED, actual, "Snapshot was incorrect.", msg);
+
+    free(actual);
+    ot_free_doc(doc);
+    return true;
+}
+
+static bool snapshot_at_returns_null_for_unknown_hash(char** msg) {
+    ot_doc* doc = ot_new_doc();
+    append_text(doc, "a");
+
+    char hash[20];
+    memset(hash, 0xFF, 20);
+    char* actual = ot_doc_snapshot_at(doc, hash);
+    ASSERT_CONDITION(actual == NULL, "NULL", actual,
+                     "Snapshot of an unknown hash wasn't NULL.", msg);
+
+    ot_free_doc(doc);
+    return true;
+}
+
+// Asserts that the document's composed state has the expected text.
+#define ASSERT_DOC_TEXT(expected, doc, detail, msg)                            \
+    {                                                                          \
+        char* text = ot_snapshot((doc)->composed);                             \
+        bool equal = strcmp(expected, text) == 0;                              \
+        ASSERT_CONDITION(equal, expected, text, detail, msg);                  \
+        free(text);                                                            \
+    }
+
+static bool fork_shares_history_with_base(char** msg) {
+    ot_doc* doc = ot_new_doc();
+    append_text(doc, "abc");
+    append_text(doc, "def");
+
+    ot_doc* fork = ot_doc_fork(doc);
+    ASSERT_INT_EQUAL(2, (int)ot_doc_len(fork),
+                     "Fork had the wrong history length.", msg);
+    ASSERT_INT_EQUAL(0, (int)fork->history.len,
+                     "Fork copied its base's history.", msg);
+    ASSERT_CONDITION(fork->composed == doc->composed, "shared", "copied",
+                     "Fork didn't share its base's composed state.", msg);
+
+    ot_free_doc(fork);
+    ot_free_doc(doc);
+    return true;
+}
+
+static bool fork_and_base_diverge_independently(char** msg) {
+    ot_doc* doc = ot_new_doc();
+    append_text(doc, "abc");
+
+    ot_doc* fork = ot_doc_fork(doc);
+    append_text(doc, "def");
+    append_text(fork, "xyz");
+    append_text(fork, "!");
+
+    ASSERT_DOC_TEXT("abcdef", doc, "Base document had the wrong text.", msg);
+    ASSERT_DOC_TEXT("abcxyz!", fork, "Fork had the wrong text.", msg);
+    ASSERT_INT_EQUAL(3, (int)ot_doc_len(fork),
+                     "Fork had the wrong history length.", msg);
+    ASSERT_CONDITION(memcmp(ot_doc_op(fork, 1)->parent,
+                            ot_doc_op(doc, 0)->hash, 20) == 0,
+                     "base hash", "other hash",
+                     "Fork's first op had the wrong parent.", msg);
+
+    ot_free_doc(doc);
+    ot_free_doc(fork);
+    return true;
+}
+
+static bool fork_outlives_its_base(char** msg) {
+    ot_doc* doc = ot_new_doc();
+    append_text(doc, "abc");
+    append_text(doc, "def");
+
+    ot_doc* fork = ot_doc_fork(doc);
+    ot_doc* fork_of_fork = ot_doc_fork(fork);
+    ot_free_doc(doc);
+    ot_free_doc(fork);
+
+    append_text(fork_of_fork, "ghi");
+    ASSERT_DOC_TEXT("abcdefghi", fork_of_fork, "Fork had the wrong text.",
+                    msg);
+
+    ot_free_doc(fork_of_fork);
+    return true;
+}
+
+// Appends an op to doc that deletes the last count characters.
+static void delete_last(ot_doc* doc, uint32_t count) {
+    ot_op* op = ot_new_op();
+    ot_skip(op, doc->size - count);
+    ot_delete(op, count);
+    ot_doc_append(doc, &op);
+}
+
+static bool find_returns_most_recent_op_visible_to_each_fork(char** msg) {
+    // Enough ops to grow the index past its first table.
+    const size_t OPS = 40;
+
+    ot_doc* doc = ot_new_doc();
+    append_text(doc, "a");
+    char first[20];
+    memcpy(first, ot_doc_last(doc)->hash, 20);
+    for (size_t i = 1; i < OPS; ++i) {
+        append_text(doc, "b");
+    }
+
+    // Every op in the base is found, including ones shared with a fork.
+    ot_doc* fork = ot_doc_fork(doc);
+    for (size_t i = 0; i < OPS; ++i) {
+        const char* hash = ot_doc_op(doc, i)->hash;
+        ASSERT_INT_EQUAL(i, ot_doc_find(doc, hash),
+                         "An op wasn't found in the base.", msg);
+        ASSERT_INT_EQUAL(i, ot_doc_find(fork, hash),
+                         "A shared op wasn't found in the fork.", msg);
+    }
+
+    // Ops appended to the base after the fork aren't part of the fork.
+    append_text(doc, "c");
+    const char* later = ot_doc_last(doc)->hash;
+    ASSERT_INT_EQUAL(ot_doc_len(fork), ot_doc_find(fork, later),
+                     "The fork found an op that isn't in its history.", msg);
+
+    // Going back to an earlier state repeats its hash, and the newest op with
+    // it is found.
+    delete_last(fork, OPS - 1);
+    ASSERT_CONDITION(memcmp(first, ot_doc_last(fork)->hash, 20) == 0,
+                     "repeated hash", "different hash",
+                     "Deleting didn't return to the first state.", msg);
+    ASSERT_INT_EQUAL(OPS, ot_doc_find(fork, first),
+                     "The fork didn't find its newest op.", msg);
+    ASSERT_INT_EQUAL(0, ot_doc_find(doc, first),
+                     "The base found the fork's op.", msg);
+
+    ot_free_doc(fork);
+    ot_free_doc(doc);
+    return true;
+}
+
+// Computes the bytes held by a document by walking all of its structures.
+static size_t walk_bytes(const ot_doc* doc) {
+    size_t bytes = sizeof(ot_doc) + doc->history.cap * sizeof(ot_op);
+    ot_op* ops = doc->history.data;
+    for (size_t i = 0; i < doc->history.len; ++i) {
+        bytes += ot_op_bytes(ops + i);
+    }
+
+    if (doc->composed_borrowed) {
+        bytes += sizeof(ot_op);
+    } else if (doc->composed != NULL && doc->composed != ops) {
+        bytes += sizeof(ot_op) + ot_op_bytes(doc->composed);
+    }
+
+    bytes += doc->by_hash.buckets_len * sizeof(size_t);
+    bytes += doc->by_hash.next.cap * sizeof(size_t);
+
+    bytes += doc->keyframes.cap * sizeof(ot_keyframe);
+    ot_keyframe* keyframes = doc->keyframes.data;
+    for (size_t i = 0; i < doc->keyframes.len; ++i) {
+        bytes += strlen(keyframes[i].text) + 1;
+    }
+
+    return bytes;
+}
+
+static bool bytes_are_updated_on_append(char** msg) {
+    ot_doc* doc = ot_new_doc();
+    ot_doc_set_keyframe_interval(doc, 2);
+    ASSERT_INT_EQUAL((int)walk_bytes(doc), (int)ot_doc_bytes(doc),
+                     "Empty document had the wrong byte count.", msg);
+
+    const char* texts[] = { "abc", "def", "ghijkl", "m", "nop" };
+    for (size_t i = 0; i < 5; ++i) {
+        append_text(doc, texts[i]);
+        ASSERT_INT_EQUAL((int)walk_bytes(doc), (int)ot_doc_bytes(doc),
+                         "Document had the wrong byte count.", msg);
+    }
+
+    ot_op* invalid = ot_new_op();
+    ot_skip(invalid, 1000);
+    ot_err err = ot_doc_append(doc, &invalid);
+    ASSERT_INT_EQUAL(OT_ERR_APPEND_FAILED, err, "Invalid op was appended.",
+                     msg);
+    ASSERT_INT_EQUAL((int)walk_bytes(doc), (int)ot_doc_bytes(doc),
+                     "Failed append changed the byte count.", msg);
+
+    ot_free_op(invalid);
+    ot_free_doc(doc);
+    return true;
+}
+
+static bool bytes_of_fork_exclude_shared_history(char** msg) {
+    ot_doc* doc = ot_new_doc();
+    append_text(doc, "abc");
+
+    ot_doc* fork = ot_doc_fork(doc);
+    ASSERT_INT_EQUAL((int)walk_bytes(fork), (int)ot_doc_bytes(fork),
+                     "Fork had the wrong byte count.", msg);
+
+    append_text(fork, "def");
+    append_text(doc, "ghi");
+    ASSERT_INT_EQUAL((int)walk_bytes(fork), (int)ot_doc_bytes(fork),
+                     "Diverged fork had the wrong byte count.", msg);
+    ASSERT_INT_EQUAL((int)walk_bytes(doc), (int)ot_doc_bytes(doc),
+                     "Base document had the wrong byte count.", msg);
+
+    ot_free_doc(fork);
+    ot_free_doc(doc);
+    return true;
+}
+
+// Returns an op that inserts text at the end of a document of the given size.
+static ot_op* insert_at_end(uint32_t size, const char* text) {
+    ot_op* op = ot_new_op();
+    ot_skip(op, size);
+    ot_insert(op, text);
+    return op;
+}
+
+static bool append_batch_matches_sequential_appends(char** msg) {
+    const char* texts[] = { "ab", "c", "d\xc3\xa9" "f", "g", "hij" };
+    const size_t LEN = 5;
+
+    ot_doc* expected = ot_new_doc();
+    ot_doc* actual = ot_new_doc();
+    ot_doc_set_keyframe_interval(expected, 2);
+    ot_doc_set_keyframe_interval(actual, 2);
+    append_text(expected, "xyz");
+    append_text(actual, "xyz");
+
+    // Skips are counted in code points, while a document's size is counted in
+    // bytes, so the sizes are tracked separately.
+    ot_op* batch[5];
+    uint32_t size = 3;
+    for (size_t i = 0; i < LEN; ++i) {
+        ot_op* op = insert_at_end(size, texts[i]);
+        ot_doc_append(expected, &op);
+        batch[i] = insert_at_end(size, texts[i]);
+        size += utf8_length(texts[i]);
+    }
+
+    ot_err err = ot_doc_append_batch(actual, batch, LEN);
+    ASSERT_INT_EQUAL(OT_ERR_NONE, err, "Appending the batch failed.", msg);
+    ASSERT_INT_EQUAL(ot_doc_len(expected), ot_doc_len(actual),
+                     "The document has the wrong length.", msg);
+    ASSERT_INT_EQUAL(expected->keyframes.len, actual->keyframes.len,
+                     "The wrong number of keyframes were stored.", msg);
+    ASSERT_DOC_TEXT("xyzabcd\xc3\xa9" "fghij", actual,
+                    "The document has the wrong text.", msg);
+
+    for (size_t i = 0; i < ot_doc_len(expected); ++i) {
+        ot_op* e = ot_doc_op(expected, i);
+        ot_op* a = ot_doc_op(actual, i);
+        ASSERT_CONDITION(memcmp(e->hash, a->hash, 20) == 0 &&
+                             memcmp(e->parent, a->parent, 20) == 0,
+                         "matching hashes", "different hashes",
+                         "An op has the wrong hash or parent.", msg);
+    }
+    ASSERT_CONDITION(
+        memcmp(expected->composed->hash, actual->composed->hash, 20) == 0,
+        "matching hash", "different hash",
+        "The composed state has the wrong hash.", msg);
+    ASSERT_INT_EQUAL((int)walk_bytes(actual), (int)ot_doc_bytes(actual),
+                     "The document has the wrong byte count.", msg);
+
+    ot_free_doc(expected);
+    ot_free_doc(actual);
+    return true;
+}
+
+static bool append_batch_appends_nothing_on_failure(char** msg) {
+    ot_doc* doc = ot_new_doc();
+    append_text(doc, "abc");
+    append_text(doc, "def");
+    size_t bytes = ot_doc_bytes(doc);
+
+    ot_op* batch[2];
+    batch[0] = insert_at_end(6, "g");
+    batch[1] = insert_at_end(1000, "h");
+    ot_err err = ot_doc_append_batch(doc, batch, 2);
+    ASSERT_INT_EQUAL(OT_ERR_APPEND_FAILED, err, "An invalid batch was appended.",
+                     msg);
+    ASSERT_INT_EQUAL(2, ot_doc_len(doc), "The document has the wrong length.",
+                     msg);
+    ASSERT_INT_EQUAL(bytes, ot_doc_bytes(doc),
+                     "The document's byte count changed.", msg);
+    ASSERT_DOC_TEXT("abcdef", doc, "The document has the wrong text.", msg);
+
+    ot_free_op(batch[0]);
+    ot_free_op(batch[1]);
+    ot_free_doc(doc);
+    return true;
+}
+
+static bool published_version_outlives_appends_and_doc(char** msg) {
+    ot_doc* doc = ot_new_doc();
+    ASSERT_CONDITION(!ot_doc_publish(doc) && ot_doc_acquire(doc) == NULL,
+                     "nothing published", "a version",
+                     "An empty document was published.", msg);
+
+    append_text(doc, "a");
+    ot_doc_publish(doc);
+    ot_doc_version* first = ot_doc_acquire(doc);
+    append_text(doc, "b");
+    append_text(doc, "c");
+    ot_doc_publish(doc);
+    ot_doc_version* latest = ot_doc_acquire(doc);
+
+    // The fork shares the published composed state with the version.
+    ot_doc* fork = ot_doc_fork(doc);
+    append_text(doc, "d");
+    ot_free_doc(doc);
+    ot_free_doc(fork);
+
+    char* text = ot_snapshot(first->composed);
+    ASSERT_STR_EQUAL("a", text, "The first version changed.", msg);
+    free(text);
+    text = ot_snapshot(latest->composed);
+    ASSERT_STR_EQUAL("abc", text, "The latest version was incorrect.", msg);
+    ASSERT_INT_EQUAL(3, latest->len, "The version had the wrong length.", msg);
+
+    char hash[20];
+    hash_text(text, hash);
+    ASSERT_CONDITION(memcmp(hash, latest->hash, 20) == 0, "matching hash",
+                     "different hash", "The version's hash was incorrect.",
+                     msg);
+    free(text);
+
+    ot_doc_version_release(first);
+    ot_doc_version_release(latest);
+    return true;
+}
+
+typedef struct version_reader {
+    ot_doc* doc;
+    bool done;
+    size_t reads;
+    size_t mismatches;
+} version_reader;
+
+// Repeatedly checks that the latest published version's text matches its hash.
+static void* read_versions(void* arg) {
+    version_reader* reader = arg;
+    while (!__atomic_load_n(&reader->done, __ATOMIC_ACQUIRE)) {
+        ot_doc_version* version = ot_doc_acquire(reader->doc);
+        if (version == NULL) {
+            continue;
+        }
+
+        char* text = ot_snapshot(version->composed);
+        char hash[20];
+        hash_text(text, hash);
+        if (memcmp(hash, version->hash, 20) != 0 ||
+            strlen(text) != version->size) {
+            ++reader->mismatches;
+        }
+        ++reader->reads;
+
+        free(text);
+        ot_doc_version_release(version);
+    }
+
+    return NULL;
+}
+
+static bool published_versions_are_consistent_while_appending(char** msg) {
+    ot_doc* doc = ot_new_doc();
+    version_reader reader = { .doc = doc };
+    ot_thread thread;
+    if (!ot_thread_start(&thread, read_versions, &reader)) {
+        ot_free_doc(doc);
+        return true;
+    }
+
+    for (int i = 0; i < 500; ++i) {
+        append_text(doc, "x");
+        ot_doc_publish(doc);
+    }
+    __atomic_store_n(&reader.done, true, __ATOMIC_RELEASE);
+    ot_thread_join(thread);
+
+    ASSERT_INT_EQUAL(0, reader.mismatches,
+                     "A reader saw an inconsistent version.", msg);
+
+    ot_free_doc(doc);
+    return true;
+}
+
+results doc_tests() {
+    RUN_TEST(snapshot_at_returns_historical_text);
+    RUN_TEST(snapshot_at_uses_keyframe_for_exact_match);
+    RUN_TEST(snapshot_at_without_keyframes);
+    RUN_TEST(snapshot_at_returns_null_for_unknown_hash);
+    RUN_TEST(fork_shares_history_with_base);
+    RUN_TEST(fork_and_base_diverge_independently);
+    RUN_TEST(fork_outlives_its_base);
+    RUN_TEST(find_returns_most_recent_op_visible_to_each_fork);
+    RUN_TEST(bytes_are_updated_on_append);
+    RUN_TEST(bytes_of_fork_exclude_shared_history);
+    RUN_TEST(append_batch_matches_sequential_appends);
+    RUN_TEST(append_batch_appends_nothing_on_failure);
+    RUN_TEST(published_version_outlives_appends_and_doc);
+    RUN_TEST(published_versions_are_consistent_while_appending);
+
+    return (results) { passed, failed };
+}
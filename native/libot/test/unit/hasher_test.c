@@ -0,0 +1,103 @@
+#include "../../doc.h"
+#include "../../hasher.h"
+#include "unit.h"
+
+// Appends op to doc and applies it to hasher, and checks that both produce
+// the same hash.
+static bool apply_both(ot_doc* doc, ot_hasher* hasher, ot_op* op,
+                       char** msg) {
+    char hash[20];
+    bool applied = ot_hasher_apply(hasher, op, hash);
+    ot_err err = ot_doc_append(doc, &op);
+    ASSERT_INT_EQUAL(OT_ERR_NONE, err, "Appending the op failed.", msg);
+    ASSERT_CONDITION(applied, "applied", "rejected",
+                     "The hasher rejected the op.", msg);
+    ASSERT_CONDITION(memcmp(hash, op->hash, 20) == 0, "matching hash",
+                     "different hash", "The hasher's hash was incorrect.",
+                     msg);
+
+    return true;
+}
+
+static bool hasher_matches_document_hashes(char** msg) {
+    // The text spans several checkpoints, and some code points straddle them.
+    char text[10001];
+    for (size_t i = 0; i < 10000; i += 2) {
+        text[i] = '\xc3';
+        text[i + 1] = '\xa9';
+    }
+    text[10000] = '\0';
+
+    ot_doc* doc = ot_new_doc();
+    ot_hasher hasher;
+    ot_hasher_init(&hasher, NULL);
+
+    ot_op* op = ot_new_op();
+    ot_insert(op, text);
+    if (!apply_both(doc, &hasher, op, msg)) {
+        return false;
+    }
+
+    // Insert at the end, in the middle and at the start.
+    op = ot_new_op();
+    ot_skip(op, 5000);
+    ot_insert(op, "abc");
+    if (!apply_both(doc, &hasher, op, msg)) {
+        return false;
+    }
+    op = ot_new_op();
+    ot_skip(op, 2500);
+    ot_insert(op, "d\xc3\xa9");
+    ot_skip(op, 2503);
+    if (!apply_both(doc, &hasher, op, msg)) {
+        return false;
+    }
+    op = ot_new_op();
+    ot_insert(op, "f");
+    ot_skip(op, 5005);
+    if (!apply_both(doc, &hasher, op, msg)) {
+        return false;
+    }
+
+    // Delete across a checkpoint.
+    op = ot_new_op();
+    ot_skip(op, 2000);
+    ot_delete(op, 3000);
+    ot_skip(op, 6);
+    if (!apply_both(doc, &hasher, op, msg)) {
+        return false;
+    }
+
+    char* snapshot = ot_snapshot(doc->composed);
+    ASSERT_STR_EQUAL(snapshot, hasher.text, "The hasher's text was incorrect.",
+                     msg);
+
+    free(snapshot);
+    ot_hasher_free(&hasher);
+    ot_free_doc(doc);
+    return true;
+}
+
+static bool hasher_rejects_ops_that_dont_fit(char** msg) {
+    ot_hasher hasher;
+    ot_hasher_init(&hasher, "abc");
+
+    ot_op* op = ot_new_op();
+    ot_skip(op, 2);
+    ot_delete(op, 2);
+    char hash[20];
+    ASSERT_CONDITION(!ot_hasher_apply(&hasher, op, hash), "rejected",
+                     "applied", "An op that doesn't fit was applied.", msg);
+    ASSERT_STR_EQUAL("abc", hasher.text, "The text was changed.", msg);
+
+    ot_free_op(op);
+    ot_hasher_free(&hasher);
+    return true;
+}
+
+results hasher_tests() {
+    RUN_TEST(hasher_matches_document_hashes);
+    RUN_TEST(hasher_rejects_ops_that_dont_fit);
+
+    return (results) { passed, failed };
+}
@@ -0,0 +1,91 @@
+#include "../../log.h"
+#include "unit.h"
+
+static int logged = 0;
+static char logged_msg[256];
+
+static void capture(ot_log_level level, const char* msg) {
+    (void)level;
+    ++logged;
+    snprintf(logged_msg, sizeof(logged_msg), "%s", msg);
+}
+
+static void start_capture(ot_log_level level) {
+    logged = 0;
+    logged_msg[0] = '\0';
+    ot_log_set_sink(capture);
+    ot_log_set_level(level);
+}
+
+static void stop_capture() {
+    ot_log_set_sink(NULL);
+    ot_log_set_level(OT_LOG_INFO);
+}
+
+static bool log_drops_messages_below_level(char** msg) {
+    start_capture(OT_LOG_INFO);
+    OT_LOG(OT_LOG_DEBUG, OT_ERR_NONE, "Dropped %d.", 1);
+    int debug_logged = logged;
+    OT_LOG(OT_LOG_INFO, OT_ERR_NONE, "Kept %d.", 2);
+    stop_capture();
+
+    ASSERT_INT_EQUAL(0, debug_logged, "A debug message was emitted.", msg);
+    ASSERT_INT_EQUAL(1, logged, "An info message wasn't emitted.", msg);
+    ASSERT_STR_EQUAL("[INFO] Kept 2.", logged_msg,
+                     "The emitted message was incorrect.", msg);
+
+    return true;
+}
+
+static bool log_prefixes_errors_with_code(char** msg) {
+    start_capture(OT_LOG_ERROR);
+    OT_LOG(OT_LOG_ERROR, OT_ERR_XFORM_FAILED, "Failed.");
+    stop_capture();
+
+    ASSERT_STR_EQUAL("[ERROR 9] Failed.", logged_msg,
+                     "The emitted message was incorrect.", msg);
+
+    return true;
+}
+
+static bool log_ops_encodes_labeled_ops(char** msg) {
+    ot_op* op = ot_new_op();
+    ot_insert(op, "abc");
+
+    start_capture(OT_LOG_DEBUG);
+    OT_LOG_OPS(OT_LOG_DEBUG, OT_ERR_NONE, "Ops.", "Operation", op, "Document",
+               NULL, NULL);
+    stop_capture();
+
+    char* enc = ot_encode(op);
+    char expected[256];
+    snprintf(expected, sizeof(expected),
+             "[DEBUG] Ops.\n\tOperation: %s\n\tDocument: EMPTY", enc);
+    free(enc);
+    ot_free_op(op);
+
+    ASSERT_STR_EQUAL(expected, logged_msg, "The emitted message was incorrect.",
+                     msg);
+
+    return true;
+}
+
+static bool log_none_disables_all_messages(char** msg) {
+    start_capture(OT_LOG_NONE);
+    OT_LOG(OT_LOG_ERROR, OT_ERR_XFORM_FAILED, "Failed.");
+    OT_LOG(OT_LOG_NONE, OT_ERR_NONE, "Never.");
+    stop_capture();
+
+    ASSERT_INT_EQUAL(0, logged, "A message was emitted.", msg);
+
+    return true;
+}
+
+results log_tests() {
+    RUN_TEST(log_drops_messages_below_level);
+    RUN_TEST(log_prefixes_errors_with_code);
+    RUN_TEST(log_ops_encodes_labeled_ops);
+    RUN_TEST(log_none_disables_all_messages);
+
+    return (results) { passed, failed };
+}
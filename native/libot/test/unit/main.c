@@ -9,6 +9,14 @@ extern results array_tests();
 extern results xform_tests();
 extern results encode_tests();
 extern results server_tests();
+extern results verify_tests();
+extern results doc_tests();
+extern results log_tests();
+extern results registry_tests();
+extern results runtime_tests();
+extern results pipeline_tests();
+extern results wal_tests();
+extern results hasher_tests();
 
 int main() {
     fclose(stderr);
@@ -20,6 +28,14 @@ int main() {
     RUN_SUITE(xform_tests);
     RUN_SUITE(encode_tests);
     RUN_SUITE(server_tests);
+    RUN_SUITE(verify_tests);
+    RUN_SUITE(doc_tests);
+    RUN_SUITE(log_tests);
+    RUN_SUITE(registry_tests);
+    RUN_SUITE(runtime_tests);
+    RUN_SUITE(pipeline_tests);
+    RUN_SUITE(wal_tests);
+    RUN_SUITE(hasher_tests);
 
     printf("\n%d tests passed.\n"
            "%d tests failed.\n"
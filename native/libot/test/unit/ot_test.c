@@ -432,6 +432,55 @@ static bool size_with_delete_and_insert(char** msg) {
     return true;
 }
 
+static bool validate_returns_span_in_code_points(char** msg) {
+    ot_op* op = ot_new_op();
+    ot_skip(op, 2);
+    ot_insert(op, "\xc3\xa9t\xc3\xa9");
+    ot_delete(op, 3);
+
+    ot_span span;
+    ot_err err = ot_validate(op, &span);
+    ASSERT_INT_EQUAL(OT_ERR_NONE, err, "A valid op was rejected.", msg);
+    ASSERT_INT_EQUAL(5, span.before, "Unexpected span before the op.", msg);
+    ASSERT_INT_EQUAL(5, span.after, "Unexpected span after the op.", msg);
+
+    ot_free_op(op);
+    return true;
+}
+
+static bool validate_rejects_empty_components(char** msg) {
+    // The builders drop empty components, but a decoded op can still have
+    // them.
+    ot_op* op = ot_new_op();
+    ot_insert(op, "a");
+    ot_comp* comp = array_append(&op->comps);
+    comp->type = OT_DELETE;
+    comp->value.delete.count = 0;
+
+    ot_err err = ot_validate(op, NULL);
+    ASSERT_INT_EQUAL(OT_ERR_INVALID_COMPONENT, err,
+                     "An empty delete wasn't rejected.", msg);
+
+    ot_free_op(op);
+    return true;
+}
+
+static bool validate_rejects_invalid_utf8(char** msg) {
+    const char* const INVALID[] = { "\x80", "a\xc3", "\xc0\xaf",
+                                    "\xed\xa0\x80", "\xf4\x90\x80\x80" };
+
+    for (size_t i = 0; i < sizeof(INVALID) / sizeof(INVALID[0]); ++i) {
+        ot_op* op = ot_new_op();
+        ot_insert(op, INVALID[i]);
+        ot_err err = ot_validate(op, NULL);
+        ot_free_op(op);
+        ASSERT_INT_EQUAL(OT_ERR_INVALID_COMPONENT, err,
+                         "Invalid UTF-8 wasn't rejected.", msg);
+    }
+
+    return true;
+}
+
 results ot_tests() {
     RUN_TEST(start_fmt_appends_correct_comp_type);
     RUN_TEST(start_fmt_appends_correct_name_and_value);
@@ -456,6 +505,9 @@ results ot_tests() {
     RUN_TEST(size_of_op_with_only_inserts_equals_length_of_snapshot);
     RUN_TEST(size_with_delete);
     RUN_TEST(size_with_delete_and_insert);
+    RUN_TEST(validate_returns_span_in_code_points);
+    RUN_TEST(validate_rejects_empty_components);
+    RUN_TEST(validate_rejects_invalid_utf8);
 
     return (results) { passed, failed };
 }
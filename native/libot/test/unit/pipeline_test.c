@@ -0,0 +1,348 @@
+#include "../../pipeline.h"
+#include "../../verify.h"
+#include "unit.h"
+
+static int sent = 0;
+static char last_sent[512];
+
+// The pipeline only sends from the encoder thread, so no locking is needed.
+static int send(const char* msg) {
+    ++sent;
+    snprintf(last_sent, sizeof(last_sent), "%s", msg);
+
+    return 0;
+}
+
+static int event(ot_event_type t, ot_op* op) {
+    (void)t;
+    (void)op;
+
+    return 0;
+}
+
+// Builds a history of len ops where each op is parented on the one before it.
+static ot_doc* new_history(size_t len) {
+    ot_doc* doc = ot_new_doc();
+    for (size_t i = 0; i < len; ++i) {
+        ot_op* op = ot_new_op();
+        if (i > 0) {
+            ot_skip(op, (uint32_t)doc->size);
+        }
+        ot_insert(op, "x");
+        ot_doc_append(doc, &op);
+    }
+
+    return doc;
+}
+
+static bool pipeline_appends_and_sends_in_order(char** msg) {
+    const size_t OPS = 100;
+
+    ot_doc* history = new_history(OPS);
+    ot_server* server = ot_new_server(send, event);
+    ot_pipeline_opts opts = { .capacity = 4 };
+    ot_pipeline* pipeline = ot_new_pipeline(server, &opts);
+    sent = 0;
+
+    for (size_t i = 0; i < OPS; ++i) {
+        char* enc = ot_encode(ot_doc_op(history, i));
+        ot_pipeline_submit(pipeline, enc);
+        free(enc);
+    }
+    ot_pipeline_drain(pipeline);
+
+    ot_pipeline_stats stats;
+    ot_pipeline_get_stats(pipeline, &stats);
+    ASSERT_INT_EQUAL(OPS, stats.messages,
+                     "The wrong number of messages were processed.", msg);
+    ASSERT_INT_EQUAL(OPS, stats.sequence.count,
+                     "The wrong number of ops were sequenced.", msg);
+    ASSERT_INT_EQUAL(OPS, sent, "The wrong number of messages were sent.",
+                     msg);
+
+    char* expected = ot_encode(ot_doc_op(history, OPS - 1));
+    ASSERT_STR_EQUAL(expected, last_sent, "The last message was incorrect.",
+                     msg);
+    free(expected);
+
+    ASSERT_CONDITION(
+        memcmp(history->composed->hash, server->doc->composed->hash, 20) == 0,
+        "matching hash", "different hash",
+        "The ops were applied out of order.", msg);
+
+    ot_free_pipeline(pipeline);
+    ot_free_server(server);
+    ot_free_doc(history);
+    return true;
+}
+
+static bool pipeline_sends_error_when_decode_fails(char** msg) {
+    ot_server* server = ot_new_server(send, event);
+    ot_pipeline* pipeline = ot_new_pipeline(server, NULL);
+    sent = 0;
+
+    ot_pipeline_submit(pipeline, "not json");
+    ot_free_pipeline(pipeline);
+
+    char* expected = ot_encode_err(OT_ERR_INVALID_JSON);
+    ASSERT_INT_EQUAL(1, sent, "The wrong number of messages were sent.", msg);
+    ASSERT_STR_EQUAL(expected, last_sent, "The error message was incorrect.",
+                     msg);
+    free(expected);
+
+    ot_free_server(server);
+    return true;
+}
+
+static ot_recipients sent_to;
+static uint32_t sent_to_id;
+static char last_sent_to[512];
+
+static int send_to(ot_recipients to, const uint32_t* client_ids, size_t len,
+                   ot_msg* m) {
+    ++sent;
+    sent_to = to;
+    sent_to_id = (len > 0) ? client_ids[0] : 0;
+    snprintf(last_sent_to, sizeof(last_sent_to), "%s", m->data);
+
+    return 0;
+}
+
+static bool pipeline_replies_to_the_sender_of_an_invalid_op(char** msg) {
+    ot_doc* doc = new_history(1);
+    ot_server* server = ot_new_server(send, event);
+    ot_server_open(server, doc);
+    ot_server_set_send_to(server, send_to);
+    ot_pipeline* pipeline = ot_new_pipeline(server, NULL);
+    sent = 0;
+
+    // The op is based on the latest state but doesn't span it.
+    ot_op* op = ot_new_op();
+    op->client_id = 5;
+    memcpy(op->parent, ot_doc_last(doc)->hash, 20);
+    ot_insert(op, "y");
+    char* enc = ot_encode(op);
+    ot_pipeline_submit(pipeline, enc);
+    free(enc);
+    ot_free_op(op);
+    ot_free_pipeline(pipeline);
+
+    char* expected = ot_encode_err(OT_ERR_SPAN_MISMATCH);
+    ASSERT_INT_EQUAL(1, sent, "The wrong number of messages were sent.", msg);
+    ASSERT_INT_EQUAL(OT_SEND_TO, sent_to,
+                     "The error wasn't sent to a single client.", msg);
+    ASSERT_INT_EQUAL(5, sent_to_id, "The error wasn't sent to its sender.",
+                     msg);
+    ASSERT_STR_EQUAL(expected, last_sent_to, "The error message was incorrect.",
+                     msg);
+    free(expected);
+
+    ot_free_server(server);
+    return true;
+}
+
+static bool latency_percentile_is_bounded_by_bucket(char** msg) {
+    ot_latency latency;
+    ot_latency_init(&latency);
+    for (int i = 0; i < 99; ++i) {
+        ot_latency_record(&latency, 0.000010);
+    }
+    ot_latency_record(&latency, 0.5);
+
+    double p50 = ot_latency_percentile(&latency, 0.5);
+    ASSERT_CONDITION(p50 >= 0.000010 && p50 <= 0.000020, "10-20us",
+                     "outside of the bucket", "The p50 latency was incorrect.",
+                     msg);
+    ASSERT_CONDITION(ot_latency_percentile(&latency, 1) == 0.5, "0.5",
+                     "not the max", "The p100 latency wasn't the maximum.",
+                     msg);
+
+    return true;
+}
+
+// Encodes an op from the given client that inserts text at the start of doc.
+static char* encode_concurrent_insert(const ot_doc* doc, uint32_t client_id,
+                                      const char* text) {
+    ot_op* op = ot_new_op();
+    op->client_id = client_id;
+    memcpy(op->parent, ot_doc_last(doc)->hash, 20);
+    ot_insert(op, text);
+    ot_skip(op, (uint32_t)doc->size);
+
+    char* enc = ot_encode(op);
+    ot_free_op(op);
+    return enc;
+}
+
+static bool pipeline_lets_small_ops_overtake_large_ones(char** msg) {
+    enum { SMALL = 20, LARGE_LEN = 4096 };
+
+    // Every op is encoded up front, since the document can't be read while the
+    // pipeline is appending to it.
+    ot_doc* doc = new_history(1);
+    char* paste = malloc(LARGE_LEN + 1);
+    memset(paste, 'p', LARGE_LEN);
+    paste[LARGE_LEN] = '\0';
+    char* encs[SMALL + 1];
+    encs[0] = encode_concurrent_insert(doc, 100, paste);
+    for (size_t i = 1; i <= SMALL; ++i) {
+        encs[i] = encode_concurrent_insert(doc, (uint32_t)i, "y");
+    }
+    free(paste);
+
+    ot_server* server = ot_new_server(send, event);
+    ot_server_open(server, doc);
+    ot_pipeline_opts opts = { .capacity = 4, .large_bytes = 1024,
+                              .max_overtakes = 8 };
+    ot_pipeline* pipeline = ot_new_pipeline(server, &opts);
+    for (size_t i = 0; i <= SMALL; ++i) {
+        ot_pipeline_submit(pipeline, encs[i]);
+        free(encs[i]);
+    }
+    ot_pipeline_drain(pipeline);
+
+    ot_pipeline_stats stats;
+    ot_pipeline_get_stats(pipeline, &stats);
+    ASSERT_INT_EQUAL(1, stats.large.count,
+                     "The paste wasn't counted as large.", msg);
+    ASSERT_INT_EQUAL(SMALL, stats.small.count,
+                     "The keystrokes weren't counted as small.", msg);
+    ASSERT_INT_EQUAL(1 + LARGE_LEN + SMALL, server->doc->size,
+                     "Not every op was appended.", msg);
+
+    ot_free_pipeline(pipeline);
+    ot_free_server(server);
+    return true;
+}
+
+static bool pipeline_sends_ops_once_deferred_hashes_are_ready(char** msg) {
+    enum { CLIENTS = 30 };
+
+    ot_doc* doc = new_history(1);
+    char* encs[CLIENTS];
+    for (size_t i = 0; i < CLIENTS; ++i) {
+        encs[i] = encode_concurrent_insert(doc, (uint32_t)i + 1, "y");
+    }
+
+    ot_server* server = ot_new_server(send, event);
+    ot_server_open(server, doc);
+    ot_pipeline_opts opts = { .capacity = 4, .defer_hash = true,
+                              .publish = true };
+    ot_pipeline* pipeline = ot_new_pipeline(server, &opts);
+    sent = 0;
+    for (size_t i = 0; i < CLIENTS; ++i) {
+        ot_pipeline_submit(pipeline, encs[i]);
+        free(encs[i]);
+    }
+    ot_pipeline_drain(pipeline);
+
+    // A client can base its next op on the last hash it was sent.
+    ot_op* last = ot_new_op();
+    ASSERT_INT_EQUAL(OT_ERR_NONE, ot_decode(last, last_sent),
+                     "The last op sent couldn't be decoded.", msg);
+    ot_op* next = ot_new_op();
+    next->client_id = 100;
+    memcpy(next->parent, last->hash, 20);
+    ot_skip(next, 1 + CLIENTS);
+    ot_insert(next, "z");
+    char* enc = ot_encode(next);
+    ot_pipeline_submit(pipeline, enc);
+    free(enc);
+    ot_free_op(next);
+    ot_free_op(last);
+
+    ot_pipeline_stats stats;
+    ot_pipeline_drain(pipeline);
+    ot_pipeline_get_stats(pipeline, &stats);
+    ot_free_pipeline(pipeline);
+
+    ASSERT_INT_EQUAL(CLIENTS + 1, sent,
+                     "The wrong number of messages were sent.", msg);
+    ASSERT_INT_EQUAL(CLIENTS + 1, stats.hash.count,
+                     "The wrong number of ops were hashed.", msg);
+    ASSERT_INT_EQUAL(ot_doc_len(server->doc), server->doc->hashed,
+                     "Not every hash was stored in the document.", msg);
+    ASSERT_INT_EQUAL(2 + CLIENTS, server->doc->size,
+                     "Not every op was appended.", msg);
+
+    ot_verify_result result;
+    ot_verify_ops(server->doc->history.data, ot_doc_len(server->doc), NULL,
+                  &result);
+    ASSERT_INT_EQUAL(OT_ERR_NONE, result.err,
+                     "The stored parents and hashes were incorrect.", msg);
+
+    char* expected = ot_encode(ot_doc_last(server->doc));
+    ASSERT_STR_EQUAL(expected, last_sent, "The last message was incorrect.",
+                     msg);
+    free(expected);
+
+    // The last op's hash was stored when the pipeline was freed, so its state
+    // was published then.
+    ot_doc_version* version = ot_doc_acquire(server->doc);
+    ASSERT_CONDITION(version != NULL &&
+                         version->len == ot_doc_len(server->doc) &&
+                         memcmp(version->hash,
+                                ot_doc_last(server->doc)->hash, 20) == 0,
+                     "the latest state", "an older state",
+                     "The published version was out of date.", msg);
+    ot_doc_version_release(version);
+
+    ot_free_server(server);
+    return true;
+}
+
+static bool pipeline_answers_resume_requests(char** msg) {
+    ot_doc* doc = new_history(1);
+    char resume_from[20];
+    memcpy(resume_from, ot_doc_last(doc)->hash, 20);
+    char* insert = encode_concurrent_insert(doc, 1, "y");
+
+    ot_server* server = ot_new_server(send, event);
+    ot_server_open(server, doc);
+    ot_server_set_send_to(server, send_to);
+    ot_pipeline_opts opts = { .defer_hash = true };
+    ot_pipeline* pipeline = ot_new_pipeline(server, &opts);
+    sent = 0;
+
+    // The resume request comes right after an op whose hash is computed on
+    // the hasher's thread, and its catch-up must still include the op.
+    char* resume = ot_encode_resume(resume_from, 9);
+    ot_pipeline_submit(pipeline, insert);
+    ot_pipeline_submit(pipeline, resume);
+    ot_free_pipeline(pipeline);
+
+    ASSERT_INT_EQUAL(3, sent, "The wrong number of messages were sent.", msg);
+    ASSERT_INT_EQUAL(OT_SEND_TO, sent_to,
+                     "The catch-up wasn't sent to a single client.", msg);
+    ASSERT_INT_EQUAL(9, sent_to_id,
+                     "The catch-up wasn't sent to the resumed client.", msg);
+
+    ot_catch_up catch_up;
+    ot_err err = ot_decode_catch_up(&catch_up, last_sent_to);
+    ASSERT_INT_EQUAL(OT_ERR_NONE, err, "The catch-up couldn't be decoded.",
+                     msg);
+    ASSERT_INT_EQUAL(1, catch_up.msgs.len,
+                     "The catch-up didn't have the missed op.", msg);
+    ASSERT_CONDITION(memcmp(catch_up.head, ot_doc_last(server->doc)->hash,
+                            20) == 0,
+                     "the latest hash", "another hash",
+                     "The catch-up didn't end at the latest state.", msg);
+
+    ot_free_catch_up(&catch_up);
+    free(insert);
+    free(resume);
+    ot_free_server(server);
+    return true;
+}
+
+results pipeline_tests() {
+    RUN_TEST(pipeline_appends_and_sends_in_order);
+    RUN_TEST(pipeline_sends_error_when_decode_fails);
+    RUN_TEST(pipeline_replies_to_the_sender_of_an_invalid_op);
+    RUN_TEST(pipeline_lets_small_ops_overtake_large_ones);
+    RUN_TEST(pipeline_sends_ops_once_deferred_hashes_are_ready);
+    RUN_TEST(pipeline_answers_resume_requests);
+    RUN_TEST(latency_percentile_is_bounded_by_bucket);
+
+    return (results) { passed, failed };
+}
@@ -0,0 +1,378 @@
+#include "../../registry.h"
+#include "unit.h"
+
+static char routed_id[64];
+static bool routed_null_id = false;
+static int routed = 0;
+
+static int route(const char* doc_id, const char* json) {
+    (void)json;
+    ++routed;
+    routed_null_id = (doc_id == NULL);
+    snprintf(routed_id, sizeof(routed_id), "%s", (doc_id != NULL) ? doc_id : "");
+
+    return 0;
+}
+
+static int routed_to = 0;
+static ot_recipients routed_recipients;
+
+static int route_to(const char* doc_id, ot_recipients to,
+                    const uint32_t* client_ids, size_t len, ot_msg* msg) {
+    (void)client_ids;
+    (void)len;
+    (void)msg;
+    ++routed_to;
+    routed_recipients = to;
+    snprintf(routed_id, sizeof(routed_id), "%s",
+             (doc_id != NULL) ? doc_id : "");
+
+    return 0;
+}
+
+static void setup_dedup(const char* doc_id, ot_server* server) {
+    (void)doc_id;
+    ot_server_set_dedup(server, 16);
+}
+
+static void setup_window(const char* doc_id, ot_server* server) {
+    (void)doc_id;
+    ot_server_set_window(server, 60);
+}
+
+static int event(ot_event_type t, ot_op* op) {
+    (void)t;
+    (void)op;
+
+    return 0;
+}
+
+// Encodes op tagged with doc_id, and frees it.
+static char* tag(ot_op* op, const char* doc_id) {
+    char* enc = ot_encode(op);
+    ot_free_op(op);
+
+    cJSON* root = cJSON_Parse(enc);
+    cJSON_AddStringToObject(root, "docId", doc_id);
+    char* tagged = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    free(enc);
+
+    return tagged;
+}
+
+// Encodes a new op that inserts text at the start of an empty document, tagged
+// with doc_id.
+static char* tagged_insert(const char* doc_id, const char* text) {
+    ot_op* op = ot_new_op();
+    ot_insert(op, text);
+    return tag(op, doc_id);
+}
+
+static bool registry_receive_creates_and_routes_per_document(char** msg) {
+    ot_registry* registry = ot_new_registry(route, event);
+    routed = 0;
+
+    char* a = tagged_insert("a", "abc");
+    ot_registry_receive(registry, a);
+    ASSERT_STR_EQUAL("a", routed_id, "The message was routed incorrectly.",
+                     msg);
+
+    char* b = tagged_insert("b", "xyz");
+    ot_registry_receive(registry, b);
+    ASSERT_STR_EQUAL("b", routed_id, "The message was routed incorrectly.",
+                     msg);
+    ASSERT_INT_EQUAL(2, routed, "The wrong number of messages were routed.",
+                     msg);
+
+    ASSERT_INT_EQUAL(2, registry->len, "The registry has the wrong size.", msg);
+    ASSERT_INT_EQUAL(3, ot_registry_get(registry, "a")->size,
+                     "Document a has the wrong size.", msg);
+    ASSERT_CONDITION(ot_registry_get(registry, "c") == NULL, "NULL",
+                     "not NULL", "An unknown document was found.", msg);
+
+    free(a);
+    free(b);
+    ot_free_registry(registry);
+    return true;
+}
+
+static bool registry_receive_routes_error_when_doc_id_is_missing(char** msg) {
+    ot_registry* registry = ot_new_registry(route, event);
+    routed = 0;
+
+    ot_op* op = ot_new_op();
+    ot_insert(op, "abc");
+    char* enc = ot_encode(op);
+    ot_free_op(op);
+
+    ot_registry_receive(registry, enc);
+    ASSERT_INT_EQUAL(1, routed, "The error wasn't routed.", msg);
+    ASSERT_CONDITION(routed_null_id, "NULL", "not NULL",
+                     "The error was routed to a document.", msg);
+    ASSERT_INT_EQUAL(0, registry->len, "A document was created.", msg);
+
+    free(enc);
+    ot_free_registry(registry);
+    return true;
+}
+
+static bool registry_gives_each_document_its_own_server(char** msg) {
+    ot_registry* registry = ot_new_registry(route, event);
+    ot_registry_set_route_to(registry, route_to);
+    ot_registry_set_setup(registry, setup_dedup);
+    routed = 0;
+    routed_to = 0;
+
+    // A retried op is acknowledged again instead of being appended twice,
+    // which needs the document's server to remember it between messages.
+    ot_op* op = ot_new_op();
+    op->client_id = 7;
+    ot_insert(op, "abc");
+    char* a = tag(op, "a");
+    ot_registry_receive(registry, a);
+    int first = routed_to;
+    ot_registry_receive(registry, a);
+    ASSERT_INT_EQUAL(3, ot_registry_get(registry, "a")->size,
+                     "The retried op was appended again.", msg);
+    ASSERT_INT_EQUAL(first + 1, routed_to,
+                     "The retried op wasn't acknowledged once.", msg);
+    ASSERT_INT_EQUAL(OT_SEND_TO, routed_recipients,
+                     "The acknowledgement wasn't sent to its client.", msg);
+    ASSERT_STR_EQUAL("a", routed_id, "The acknowledgement was routed "
+                     "incorrectly.", msg);
+    ASSERT_INT_EQUAL(0, routed, "A message was routed without route_to.",
+                     msg);
+
+    // Another document has its own dedup history.
+    char* b = tagged_insert("b", "abc");
+    ot_registry_receive(registry, b);
+    ASSERT_INT_EQUAL(3, ot_registry_get(registry, "b")->size,
+                     "Document b has the wrong size.", msg);
+
+    free(a);
+    free(b);
+    ot_free_registry(registry);
+    return true;
+}
+
+static bool registry_flush_sends_held_ops(char** msg) {
+    ot_registry* registry = ot_new_registry(route, event);
+    ot_registry_set_route_to(registry, route_to);
+    ot_registry_set_setup(registry, setup_window);
+    routed_to = 0;
+
+    char* a = tagged_insert("a", "abc");
+    ot_registry_receive(registry, a);
+    ASSERT_INT_EQUAL(0, routed_to, "The windowed op was sent right away.",
+                     msg);
+    ASSERT_CONDITION(registry->held != NULL, "held", "not held",
+                     "The document isn't listed as holding ops.", msg);
+
+    ot_registry_flush(registry);
+    ASSERT_CONDITION(routed_to > 0, "sent", "not sent",
+                     "Flushing didn't send the held op.", msg);
+    ASSERT_CONDITION(registry->held == NULL, "empty", "not empty",
+                     "The flushed document is still listed.", msg);
+
+    free(a);
+    ot_free_registry(registry);
+    return true;
+}
+
+static bool registry_finds_documents_after_growing(char** msg) {
+    const int LEN = 1000;
+    ot_registry* registry = ot_new_registry(route, event);
+
+    char id[16];
+    for (int i = 0; i < LEN; ++i) {
+        snprintf(id, sizeof(id), "doc-%d", i);
+        ot_registry_open(registry, id, ot_new_doc());
+    }
+    ASSERT_INT_EQUAL(LEN, registry->len, "The registry has the wrong size.",
+                     msg);
+
+    for (int i = 0; i < LEN; i += 2) {
+        snprintf(id, sizeof(id), "doc-%d", i);
+        ASSERT_CONDITION(ot_registry_close(registry, id), "true", "false",
+                         "An open document couldn't be closed.", msg);
+    }
+
+    for (int i = 0; i < LEN; ++i) {
+        snprintf(id, sizeof(id), "doc-%d", i);
+        bool expected = (i % 2 == 1);
+        ASSERT_CONDITION(ot_registry_contains(registry, id) == expected,
+                         expected ? "open" : "closed",
+                         expected ? "closed" : "open",
+                         "A document was in the wrong state.", msg);
+    }
+    ASSERT_INT_EQUAL(LEN / 2, registry->len, "The registry has the wrong size.",
+                     msg);
+
+    ot_free_registry(registry);
+    return true;
+}
+
+static bool registry_evicts_idle_documents_and_reloads_them(char** msg) {
+    ot_registry* registry = ot_new_registry(route, event);
+    ot_registry_set_eviction(registry, "/tmp", 0);
+    routed = 0;
+
+    char* a = tagged_insert("evict-a", "abc");
+    char* b = tagged_insert("evict-b", "xyz");
+    ot_registry_receive(registry, a);
+    ot_registry_receive(registry, b);
+    free(a);
+    free(b);
+
+    ASSERT_INT_EQUAL(2, ot_registry_evict_idle(registry),
+                     "The wrong number of documents were evicted.", msg);
+    ot_registry_entry* entry = ot_registry_lookup(registry, "evict-a", false);
+    ASSERT_CONDITION(entry->evicted && entry->doc == NULL, "evicted",
+                     "in memory", "The document wasn't evicted.", msg);
+
+    // An op based on the evicted state is appended once it's reloaded.
+    ot_op* op = ot_new_op();
+    hash_text("abc", op->parent);
+    ot_skip(op, 3);
+    ot_insert(op, "d");
+    char* next = tag(op, "evict-a");
+    ot_registry_receive(registry, next);
+    free(next);
+
+    ASSERT_INT_EQUAL(3, routed, "The reloaded op wasn't routed.", msg);
+    ot_doc* doc = ot_registry_get(registry, "evict-a");
+    ASSERT_INT_EQUAL(2, ot_doc_len(doc),
+                     "The reloaded document has the wrong history.", msg);
+    char hash[20];
+    hash_text("abcd", hash);
+    ASSERT_CONDITION(memcmp(hash, ot_doc_last(doc)->hash, 20) == 0,
+                     "matching hash", "different hash",
+                     "The op was applied to the wrong state.", msg);
+    ASSERT_INT_EQUAL(3, ot_registry_get(registry, "evict-b")->size,
+                     "The other document wasn't reloaded.", msg);
+
+    // The first two messages and fetching the reloaded document were hits.
+    ASSERT_INT_EQUAL(3, registry->stats.hits,
+                     "The wrong number of hits were counted.", msg);
+    ASSERT_INT_EQUAL(2, registry->stats.misses,
+                     "The wrong number of reloads were counted.", msg);
+    ASSERT_INT_EQUAL(2, registry->stats.reload.count,
+                     "Reload latency wasn't recorded.", msg);
+    ASSERT_CONDITION(ot_registry_hit_rate(registry) == 3.0 / 5.0, "0.6",
+                     "something else", "The hit rate was incorrect.", msg);
+
+    ot_free_registry(registry);
+    return true;
+}
+
+static bool registry_evicts_only_idle_documents(char** msg) {
+    ot_registry* registry = ot_new_registry(route, event);
+
+    char* a = tagged_insert("idle-a", "abc");
+    char* b = tagged_insert("idle-b", "xyz");
+    ot_registry_receive(registry, a);
+    ot_registry_receive(registry, b);
+    free(a);
+    free(b);
+    ASSERT_INT_EQUAL(2, registry->stats.hits,
+                     "Uses weren't counted without eviction.", msg);
+
+    // Only the document that was used longest ago has been idle long enough.
+    ot_registry_set_eviction(registry, "/tmp", 1000);
+    ot_registry_lookup(registry, "idle-a", false)->used -= 2000;
+    ot_registry_evict_idle(registry);
+    ASSERT_CONDITION(ot_registry_lookup(registry, "idle-a", false)->evicted,
+                     "evicted", "in memory",
+                     "The idle document wasn't evicted.", msg);
+    ot_registry_entry* entry = ot_registry_lookup(registry, "idle-b", false);
+    ASSERT_CONDITION(!entry->evicted && entry->doc != NULL,
+                     "in memory", "evicted",
+                     "A document that was in use was evicted.", msg);
+    ASSERT_INT_EQUAL(1, registry->stats.evictions,
+                     "The wrong number of documents were evicted.", msg);
+
+    ot_free_registry(registry);
+    return true;
+}
+
+static bool registry_recovers_documents_from_its_wal(char** msg) {
+    const char* PATH = "/tmp/libot_registry_test.log";
+    remove(PATH);
+
+    // The group isn't due for a long time, so nothing is synced until the
+    // test waits for it.
+    ot_wal_opts opts = { .group_secs = 60 };
+    ot_wal* wal = ot_open_wal(PATH, &opts);
+    ot_registry* registry = ot_new_registry(route, event);
+    ot_registry_set_wal(registry, wal);
+    routed = 0;
+
+    char* a = tagged_insert("wal-a", "abc");
+    char* b = tagged_insert("wal-b", "xyz");
+    ot_op* op = ot_new_op();
+    hash_text("abc", op->parent);
+    ot_skip(op, 3);
+    ot_insert(op, "d");
+    char* next = tag(op, "wal-a");
+    ot_registry_receive(registry, a);
+    ot_registry_receive(registry, b);
+    ot_registry_receive(registry, next);
+    free(a);
+    free(b);
+    free(next);
+
+    // Receiving doesn't wait for the log, and flushing only sends durable ops.
+    ASSERT_INT_EQUAL(0, routed, "An op was routed before it was durable.",
+                     msg);
+    ot_registry_flush(registry);
+    ASSERT_INT_EQUAL(0, routed, "Flushing sent an op that wasn't durable.",
+                     msg);
+
+    ASSERT_CONDITION(ot_wal_wait(wal, 3), "synced", "failed",
+                     "The log couldn't be synced.", msg);
+    ot_registry_flush(registry);
+    ASSERT_INT_EQUAL(3, routed, "Not every durable op was routed.", msg);
+    ASSERT_CONDITION(registry->held == NULL, "empty", "not empty",
+                     "A flushed document is still listed.", msg);
+    ot_registry_set_wal(registry, NULL);
+    ot_close_wal(wal);
+
+    ot_registry* recovered = ot_new_registry(route, event);
+    ASSERT_INT_EQUAL(OT_ERR_NONE, ot_registry_recover(recovered, PATH),
+                     "The registry couldn't be recovered.", msg);
+    const char* ids[] = { "wal-a", "wal-b" };
+    for (size_t i = 0; i < 2; ++i) {
+        ot_doc* expected = ot_registry_get(registry, ids[i]);
+        ot_doc* actual = ot_registry_get(recovered, ids[i]);
+        ASSERT_CONDITION(actual != NULL &&
+                             ot_doc_len(actual) == ot_doc_len(expected) &&
+                             memcmp(ot_doc_last(actual)->hash,
+                                    ot_doc_last(expected)->hash, 20) == 0,
+                         "matching history", "different history",
+                         "A document wasn't recovered.", msg);
+    }
+
+    // The logged ops can't be appended on top of the recovered documents.
+    ASSERT_CONDITION(ot_registry_recover(recovered, PATH) != OT_ERR_NONE,
+                     "an error", "no error",
+                     "Recovering twice wasn't detected.", msg);
+
+    ot_free_registry(recovered);
+    ot_free_registry(registry);
+    remove(PATH);
+    return true;
+}
+
+results registry_tests() {
+    RUN_TEST(registry_receive_creates_and_routes_per_document);
+    RUN_TEST(registry_receive_routes_error_when_doc_id_is_missing);
+    RUN_TEST(registry_gives_each_document_its_own_server);
+    RUN_TEST(registry_flush_sends_held_ops);
+    RUN_TEST(registry_finds_documents_after_growing);
+    RUN_TEST(registry_evicts_idle_documents_and_reloads_them);
+    RUN_TEST(registry_evicts_only_idle_documents);
+    RUN_TEST(registry_recovers_documents_from_its_wal);
+
+    return (results) { passed, failed };
+}
@@ -0,0 +1,107 @@
+#include "../../runtime.h"
+#include "unit.h"
+
+static int routed = 0;
+
+static int route(const char* doc_id, const char* json) {
+    (void)doc_id;
+    (void)json;
+    __atomic_add_fetch(&routed, 1, __ATOMIC_SEQ_CST);
+
+    return 0;
+}
+
+static int event(ot_event_type t, ot_op* op) {
+    (void)t;
+    (void)op;
+
+    return 0;
+}
+
+// Builds a history of len ops where each op is parented on the one before it.
+// A server can only append the ops without transforming them if they're
+// received in order.
+static ot_doc* new_history(size_t len) {
+    ot_doc* doc = ot_new_doc();
+    for (size_t i = 0; i < len; ++i) {
+        ot_op* op = ot_new_op();
+        if (i > 0) {
+            ot_skip(op, (uint32_t)doc->size);
+        }
+        ot_insert(op, "x");
+        ot_doc_append(doc, &op);
+    }
+
+    return doc;
+}
+
+static bool runtime_applies_each_documents_ops_in_order(char** msg) {
+    const size_t DOCS = 16;
+    const size_t OPS = 50;
+
+    ot_doc* history = new_history(OPS);
+    ot_registry* registry = ot_new_registry(route, event);
+    ot_runtime* runtime = ot_new_runtime(registry, 4);
+    routed = 0;
+
+    char id[16];
+    for (size_t i = 0; i < OPS; ++i) {
+        char* enc = ot_encode(ot_doc_op(history, i));
+        for (size_t j = 0; j < DOCS; ++j) {
+            snprintf(id, sizeof(id), "doc-%zu", j);
+            ot_runtime_submit(runtime, id, enc);
+        }
+        free(enc);
+    }
+    ot_runtime_drain(runtime);
+
+    ASSERT_INT_EQUAL(DOCS * OPS, routed,
+                     "The wrong number of messages were routed.", msg);
+    ASSERT_INT_EQUAL(DOCS * OPS, runtime->processed,
+                     "The wrong number of messages were processed.", msg);
+
+    for (size_t j = 0; j < DOCS; ++j) {
+        snprintf(id, sizeof(id), "doc-%zu", j);
+        ot_doc* doc = ot_registry_get(registry, id);
+        ASSERT_INT_EQUAL(OPS, ot_doc_len(doc), "A document has the wrong length.",
+                         msg);
+        ASSERT_CONDITION(
+            memcmp(history->composed->hash, doc->composed->hash, 20) == 0,
+            "matching hash", "different hash",
+            "A document's ops were applied out of order.", msg);
+    }
+
+    ot_free_runtime(runtime);
+    ot_free_registry(registry);
+    ot_free_doc(history);
+    return true;
+}
+
+static bool runtime_free_processes_pending_messages(char** msg) {
+    const size_t OPS = 20;
+
+    ot_doc* history = new_history(OPS);
+    ot_registry* registry = ot_new_registry(route, event);
+    ot_runtime* runtime = ot_new_runtime(registry, 2);
+
+    for (size_t i = 0; i < OPS; ++i) {
+        char* enc = ot_encode(ot_doc_op(history, i));
+        ot_runtime_submit(runtime, "doc", enc);
+        free(enc);
+    }
+    ot_free_runtime(runtime);
+
+    ASSERT_INT_EQUAL(OPS, ot_doc_len(ot_registry_get(registry, "doc")),
+                     "The document has the wrong length.", msg);
+
+    ot_free_registry(registry);
+    ot_free_doc(history);
+    return true;
+}
+
+results runtime_tests() {
+    RUN_TEST(runtime_applies_each_documents_ops_in_order);
+    RUN_TEST(runtime_free_processes_pending_messages);
+
+    return (results) { passed, failed };
+}
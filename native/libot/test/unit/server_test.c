@@ -1,3 +1,4 @@
+#include "../../client.h"
 #include "../../server.h"
 #include "unit.h"
 
@@ -58,7 +59,7 @@ static bool server_receive_fires_event_when_parent_cannot_be_found(char** msg) {
     return true;
 }
 
-static bool server_receive_fires_event_when_append_error_occurs(char** msg) {
+static bool server_receive_rejects_op_that_does_not_span_document(char** msg) {
     ot_op* initial_op = ot_new_op();
     ot_insert(initial_op, "abc");
 
@@ -77,8 +78,9 @@ static bool server_receive_fires_event_when_append_error_occurs(char** msg) {
 
     ot_op* dec = ot_new_op();
     ot_err err = ot_decode(dec, sent_msg);
-    ASSERT_INT_EQUAL(OT_ERR_APPEND_FAILED, err, "Sent error was incorrect.",
+    ASSERT_INT_EQUAL(OT_ERR_SPAN_MISMATCH, err, "Sent error was incorrect.",
                      msg);
+    ASSERT_INT_EQUAL(1, ot_doc_len(server->doc), "The op was appended.", msg);
 
     ot_free_op(dec);
     ot_free_op(invalid_op);
@@ -179,13 +181,792 @@ static bool server_receive_when_empty_doc_is_opened(char** msg) {
     return true;
 }
 
+// Encodes an op that's parented on the given hash, or on the empty document if
+// parent is NULL.
+static char* encode_with_parent(ot_op* op, const char* parent) {
+    if (parent != NULL) {
+        memcpy(op->parent, parent, 20);
+    }
+    op->client_id = 1;
+
+    char* enc = ot_encode(op);
+    ot_free_op(op);
+    return enc;
+}
+
+// Builds a batch of concurrent ops for a document that contains "abc" followed
+// by "def". Some of the ops are based on the first state and some on the
+// second, so they have to be transformed against different server suffixes.
+static void build_concurrent_batch(ot_doc* doc, char** msgs) {
+    const char* first = ot_doc_op(doc, 0)->hash;
+    const char* second = ot_doc_op(doc, 1)->hash;
+
+    ot_op* op = ot_new_op();
+    ot_insert(op, "1");
+    ot_skip(op, 3);
+    msgs[0] = encode_with_parent(op, first);
+
+    op = ot_new_op();
+    ot_skip(op, 6);
+    ot_insert(op, "2");
+    msgs[1] = encode_with_parent(op, second);
+
+    op = ot_new_op();
+    ot_skip(op, 1);
+    ot_delete(op, 1);
+    ot_skip(op, 1);
+    msgs[2] = encode_with_parent(op, first);
+
+    op = ot_new_op();
+    ot_skip(op, 3);
+    ot_insert(op, "3");
+    ot_skip(op, 3);
+    msgs[3] = encode_with_parent(op, second);
+}
+
+static ot_doc* new_abc_def_doc() {
+    ot_doc* doc = ot_new_doc();
+
+    ot_op* op = ot_new_op();
+    ot_insert(op, "abc");
+    ot_doc_append(doc, &op);
+
+    op = ot_new_op();
+    ot_skip(op, 3);
+    ot_insert(op, "def");
+    ot_doc_append(doc, &op);
+
+    return doc;
+}
+
+static bool server_receive_batch_matches_sequential_receive(char** msg) {
+    const size_t LEN = 4;
+
+    ot_server* expected = ot_new_server(send, event);
+    ot_server_open(expected, new_abc_def_doc());
+    ot_server* actual = ot_new_server(send, event);
+    ot_server_open(actual, new_abc_def_doc());
+
+    char* msgs[4];
+    build_concurrent_batch(expected->doc, msgs);
+    for (size_t i = 0; i < LEN; ++i) {
+        ot_server_receive(expected, msgs[i]);
+    }
+    ot_server_receive_batch(actual, (const char* const*)msgs, LEN);
+
+    ASSERT_INT_EQUAL(ot_doc_len(expected->doc), ot_doc_len(actual->doc),
+                     "The document has the wrong length.", msg);
+    char* expected_text = ot_snapshot(expected->doc->composed);
+    char* actual_text = ot_snapshot(actual->doc->composed);
+    ASSERT_STR_EQUAL(expected_text, actual_text,
+                     "The document has the wrong text.", msg);
+    ASSERT_CONDITION(memcmp(expected->doc->composed->hash,
+                            actual->doc->composed->hash, 20) == 0,
+                     "matching hash", "different hash",
+                     "The document has the wrong hash.", msg);
+
+    char* last = ot_encode(ot_doc_last(actual->doc));
+    ASSERT_STR_EQUAL(last, sent_msg, "The last op wasn't sent last.", msg);
+
+    free(last);
+    free(expected_text);
+    free(actual_text);
+    for (size_t i = 0; i < LEN; ++i) {
+        free(msgs[i]);
+    }
+    ot_free_server(expected);
+    ot_free_server(actual);
+    return true;
+}
+
+static bool server_receive_batch_creates_document(char** msg) {
+    ot_server* server = ot_new_server(send, event);
+
+    ot_op* op = ot_new_op();
+    ot_insert(op, "abc");
+    char* first = encode_with_parent(op, NULL);
+    op = ot_new_op();
+    ot_insert(op, "xyz");
+    char* second = encode_with_parent(op, NULL);
+    const char* msgs[] = { first, second };
+
+    ot_server_receive_batch(server, msgs, 2);
+    ASSERT_INT_EQUAL(2, ot_doc_len(server->doc),
+                     "The document has the wrong length.", msg);
+    ASSERT_INT_EQUAL(6, server->doc->size, "The document has the wrong size.",
+                     msg);
+
+    free(first);
+    free(second);
+    ot_free_server(server);
+    return true;
+}
+
+static bool server_reuses_bridges_for_ops_with_the_same_parent(char** msg) {
+    const size_t LEN = 4;
+    char* msgs[4];
+
+    ot_server* expected = ot_new_server(send, event);
+    ot_server_open(expected, new_abc_def_doc());
+    ot_server* actual = ot_new_server(send, event);
+    ot_server_set_bridge_cache(actual, 8);
+    ot_server_open(actual, new_abc_def_doc());
+
+    build_concurrent_batch(expected->doc, msgs);
+    for (size_t i = 0; i < LEN; ++i) {
+        ot_server_receive(expected, msgs[i]);
+        ot_server_receive(actual, msgs[i]);
+    }
+
+    // Each parent is composed once, and the later ops only compose the ops
+    // that were appended since onto the cached bridge.
+    ASSERT_INT_EQUAL(2, actual->bridges.misses,
+                     "The wrong number of bridges were composed.", msg);
+    ASSERT_INT_EQUAL(2, actual->bridges.hits,
+                     "The wrong number of bridges were reused.", msg);
+
+    char* expected_text = ot_snapshot(expected->doc->composed);
+    char* actual_text = ot_snapshot(actual->doc->composed);
+    ASSERT_STR_EQUAL(expected_text, actual_text,
+                     "The document has the wrong text.", msg);
+    ASSERT_CONDITION(memcmp(expected->doc->composed->hash,
+                            actual->doc->composed->hash, 20) == 0,
+                     "matching hash", "different hash",
+                     "The document has the wrong hash.", msg);
+
+    free(expected_text);
+    free(actual_text);
+    for (size_t i = 0; i < LEN; ++i) {
+        free(msgs[i]);
+    }
+    ot_free_server(expected);
+    ot_free_server(actual);
+    return true;
+}
+
+// A socket layer with a few connected clients, each of which queues a
+// reference to every message it's sent.
+#define SOCKETS 3
+static ot_msg* queued[SOCKETS];
+
+static int send_msg(ot_msg* m) {
+    for (size_t i = 0; i < SOCKETS; ++i) {
+        queued[i] = ot_msg_retain(m);
+    }
+
+    return 0;
+}
+
+static bool server_fans_out_one_shared_message(char** msg) {
+    ot_server* server = ot_new_server(send, event);
+    ot_server_set_send_msg(server, send_msg);
+
+    ot_op* op = ot_new_op();
+    ot_insert(op, "abc");
+    char* enc = ot_encode(op);
+    ot_free_op(op);
+    ot_server_receive(server, enc);
+
+    char* expected = ot_encode(ot_doc_last(server->doc));
+    for (size_t i = 0; i < SOCKETS; ++i) {
+        ASSERT_CONDITION(queued[i] == queued[0], "the same message",
+                         "a copy", "The message was copied for a client.",
+                         msg);
+    }
+    ASSERT_INT_EQUAL(SOCKETS, queued[0]->refs,
+                     "The server didn't release its reference.", msg);
+    ASSERT_INT_EQUAL(strlen(expected), queued[0]->len,
+                     "The message has the wrong length.", msg);
+    ASSERT_STR_EQUAL(expected, queued[0]->data,
+                     "The message has the wrong data.", msg);
+
+    for (size_t i = 0; i < SOCKETS; ++i) {
+        ot_msg_release(queued[i]);
+    }
+    free(expected);
+    free(enc);
+    ot_free_server(server);
+    return true;
+}
+
+// Records the last message sent to the origin and to everyone else.
+static char* to_origin = NULL;
+static char* to_others = NULL;
+
+static int send_to(ot_recipients to, const uint32_t* client_ids, size_t len,
+                   ot_msg* m) {
+    (void)client_ids;
+    (void)len;
+    char** dst = (to == OT_SEND_TO) ? &to_origin : &to_others;
+    free(*dst);
+    *dst = malloc(m->len + 1);
+    memcpy(*dst, m->data, m->len + 1);
+
+    return 0;
+}
+
+// The last message sent by a client.
+static char* client_sent = NULL;
+
+static int client_send(const char* m) {
+    free(client_sent);
+    size_t size = strlen(m) + 1;
+    client_sent = malloc(size);
+    memcpy(client_sent, m, size);
+
+    return 0;
+}
+
+static int client_event(ot_event_type t, ot_op* op) {
+    (void)t;
+    (void)op;
+    return 0;
+}
+
+static bool server_acknowledges_origin_and_sends_op_to_others(char** msg) {
+    ot_server* server = ot_new_server(send, event);
+    ot_server_set_send_to(server, send_to);
+    ot_client* client = ot_new_client(client_send, client_event);
+    client->client_id = 1;
+
+    ot_op* op = ot_new_op();
+    ot_insert(op, "abc");
+    ot_client_apply(client, &op);
+    char* enc = ot_encode(op);
+    ot_server_receive(server, enc);
+
+    char* expected_op = ot_encode(ot_doc_last(server->doc));
+    char* expected_ack = ot_encode_ack(ot_doc_last(server->doc)->hash);
+    ASSERT_STR_EQUAL(expected_op, to_others,
+                     "The other clients weren't sent the op.", msg);
+    ASSERT_STR_EQUAL(expected_ack, to_origin,
+                     "The origin wasn't sent an acknowledgement.", msg);
+
+    ot_client_receive(client, to_origin);
+    ASSERT_CONDITION(!client->ack_required, "acknowledged",
+                     "waiting for an ack",
+                     "The client didn't accept the acknowledgement.", msg);
+
+    free(expected_op);
+    free(expected_ack);
+    free(enc);
+    free(to_origin);
+    free(to_others);
+    to_origin = NULL;
+    to_others = NULL;
+    ot_free_client(client);
+    ot_free_server(server);
+    return true;
+}
+
+// Queues each message for the clients it's meant for, out of clients 1 to 3.
+#define WINDOW_CLIENTS 3
+static char* inboxes[WINDOW_CLIENTS + 1][8];
+static size_t inbox_lens[WINDOW_CLIENTS + 1];
+
+static int send_to_inboxes(ot_recipients to, const uint32_t* client_ids,
+                           size_t len, ot_msg* m) {
+    for (uint32_t id = 1; id <= WINDOW_CLIENTS; ++id) {
+        bool listed = false;
+        for (size_t i = 0; i < len; ++i) {
+            listed = listed || client_ids[i] == id;
+        }
+        if ((to == OT_SEND_TO) != listed && to != OT_SEND_ALL) {
+            continue;
+        }
+
+        char* copy = malloc(m->len + 1);
+        memcpy(copy, m->data, m->len + 1);
+        inboxes[id][inbox_lens[id]++] = copy;
+    }
+
+    return 0;
+}
+
+static bool server_window_composes_ops_per_recipient(char** msg) {
+    ot_server* server = ot_new_server(send, event);
+    ot_server_set_send_to(server, send_to_inboxes);
+    ot_server_set_window(server, 1000);
+
+    ot_client* clients[WINDOW_CLIENTS + 1];
+    for (uint32_t id = 1; id <= WINDOW_CLIENTS; ++id) {
+        clients[id] = ot_new_client(client_send, client_event);
+        clients[id]->client_id = id;
+        inbox_lens[id] = 0;
+    }
+
+    // Clients 1 and 2 type at the same time while client 3 watches.
+    const char* text[] = { NULL, "a", "b" };
+    for (uint32_t id = 1; id <= 2; ++id) {
+        ot_op* op = ot_new_op();
+        ot_insert(op, text[id]);
+        ot_client_apply(clients[id], &op);
+        char* enc = ot_encode(op);
+        ot_server_receive(server, enc);
+        free(enc);
+    }
+
+    ASSERT_INT_EQUAL(0, inbox_lens[3], "Ops were sent before the flush.", msg);
+    ot_server_flush(server);
+    ASSERT_INT_EQUAL(1, inbox_lens[3],
+                     "The watching client wasn't sent one op.", msg);
+    ASSERT_INT_EQUAL(2, inbox_lens[1],
+                     "The first client wasn't sent an ack and an op.", msg);
+    ASSERT_INT_EQUAL(2, inbox_lens[2],
+                     "The second client wasn't sent an op and an ack.", msg);
+
+    char* expected = ot_snapshot(server->doc->composed);
+    for (uint32_t id = 1; id <= WINDOW_CLIENTS; ++id) {
+        for (size_t i = 0; i < inbox_lens[id]; ++i) {
+            ot_client_receive(clients[id], inboxes[id][i]);
+            free(inboxes[id][i]);
+        }
+        inbox_lens[id] = 0;
+
+        char* actual = ot_snapshot(clients[id]->doc->composed);
+        ASSERT_STR_EQUAL(expected, actual, "A client didn't converge.", msg);
+        ASSERT_CONDITION(memcmp(server->doc->composed->hash,
+                                clients[id]->doc->composed->hash, 20) == 0,
+                         "matching hash", "different hash",
+                         "A client has the wrong hash.", msg);
+        free(actual);
+        ot_free_client(clients[id]);
+    }
+
+    free(expected);
+    ot_free_server(server);
+    return true;
+}
+
+static bool server_snapshot_is_cached_until_append(char** msg) {
+    ot_server* server = ot_new_server(send, event);
+    ASSERT_CONDITION(ot_server_snapshot(server, NULL) == NULL, "NULL",
+                     "a snapshot", "An empty server returned a snapshot.", msg);
+
+    ot_server_open(server, new_abc_def_doc());
+    size_t len;
+    const char* first = ot_server_snapshot(server, &len);
+    char* expected = ot_encode(server->doc->composed);
+    ASSERT_STR_EQUAL(expected, first, "The snapshot was incorrect.", msg);
+    ASSERT_INT_EQUAL(strlen(expected), len, "The length was incorrect.", msg);
+    free(expected);
+
+    ASSERT_CONDITION(ot_server_snapshot(server, NULL) == first, "cached",
+                     "encoded again",
+                     "The snapshot wasn't reused for the same version.", msg);
+
+    ot_msg* held = ot_server_snapshot_msg(server);
+    ot_op* op = ot_new_op();
+    ot_skip(op, 6);
+    ot_insert(op, "g");
+    char* enc = encode_with_parent(op, ot_doc_last(server->doc)->hash);
+    ot_server_receive(server, enc);
+    free(enc);
+
+    expected = ot_encode(server->doc->composed);
+    ASSERT_STR_EQUAL(expected, ot_server_snapshot(server, NULL),
+                     "The snapshot wasn't updated after an append.", msg);
+    free(expected);
+    ASSERT_CONDITION(strstr(held->data, "\"g\"") == NULL, "old version",
+                     "new version", "A held snapshot was changed.", msg);
+
+    ot_msg_release(held);
+    ot_free_server(server);
+    return true;
+}
+
+static void deliver_inbox(ot_client* client) {
+    uint32_t id = client->client_id;
+    for (size_t i = 0; i < inbox_lens[id]; ++i) {
+        ot_client_receive(client, inboxes[id][i]);
+        free(inboxes[id][i]);
+    }
+    inbox_lens[id] = 0;
+}
+
+static void drop_inbox(uint32_t id) {
+    for (size_t i = 0; i < inbox_lens[id]; ++i) {
+        free(inboxes[id][i]);
+    }
+    inbox_lens[id] = 0;
+}
+
+static void apply_insert(ot_server* server, ot_client* client, uint32_t before,
+                         const char* text, uint32_t after, bool lost) {
+    ot_op* op = ot_new_op();
+    if (before > 0) {
+        ot_skip(op, before);
+    }
+    ot_insert(op, text);
+    if (after > 0) {
+        ot_skip(op, after);
+    }
+    ot_client_apply(client, &op);
+    if (!lost) {
+        ot_server_receive(server, client_sent);
+    }
+}
+
+static bool server_catches_up_a_resumed_client(char** msg) {
+    ot_server* server = ot_new_server(send, event);
+    ot_server_set_send_to(server, send_to_inboxes);
+    ot_client* one = ot_new_client(client_send, client_event);
+    one->client_id = 1;
+    ot_client* two = ot_new_client(client_send, client_event);
+    two->client_id = 2;
+
+    apply_insert(server, one, 0, "ab", 0, false);
+    deliver_inbox(one);
+    deliver_inbox(two);
+
+    // Client 2's connection drops, losing its op and everything sent to it.
+    apply_insert(server, one, 2, "cd", 0, false);
+    apply_insert(server, two, 0, "x", 2, true);
+    deliver_inbox(one);
+    drop_inbox(2);
+
+    ot_client_resume(two);
+    ot_server_receive(server, client_sent);
+    ASSERT_INT_EQUAL(1, inbox_lens[2], "The catch-up wasn't sent.", msg);
+    ASSERT_INT_EQUAL(0, inbox_lens[1], "Another client was sent the catch-up.",
+                     msg);
+    deliver_inbox(two);
+
+    // The lost op was sent again and can now be appended.
+    ot_server_receive(server, client_sent);
+    deliver_inbox(one);
+    deliver_inbox(two);
+
+    char* expected = ot_snapshot(server->doc->composed);
+    char* actual_one = ot_snapshot(one->doc->composed);
+    char* actual_two = ot_snapshot(two->doc->composed);
+    ASSERT_STR_EQUAL("xabcd", expected, "The lost op wasn't appended.", msg);
+    ASSERT_STR_EQUAL(expected, actual_one, "Client 1 didn't converge.", msg);
+    ASSERT_STR_EQUAL(expected, actual_two, "Client 2 didn't converge.", msg);
+    ASSERT_CONDITION(!two->ack_required, "acknowledged", "waiting for an ack",
+                     "The resent op wasn't acknowledged.", msg);
+
+    free(expected);
+    free(actual_one);
+    free(actual_two);
+    free(client_sent);
+    client_sent = NULL;
+    ot_free_client(one);
+    ot_free_client(two);
+    ot_free_server(server);
+    return true;
+}
+
+static bool server_sends_snapshot_when_hash_is_unknown(char** msg) {
+    ot_server* server = ot_new_server(send, event);
+    ot_server_open(server, new_abc_def_doc());
+
+    char unknown[20];
+    memset(unknown, 0x5a, 20);
+    char* request = ot_encode_resume(unknown, 7);
+    char* reply = ot_server_catch_up(server, request);
+
+    ot_client* client = ot_new_client(client_send, client_event);
+    client->client_id = 7;
+    ot_client_receive(client, reply);
+
+    char* actual = ot_snapshot(client->doc->composed);
+    ASSERT_STR_EQUAL("abcdef", actual, "The snapshot wasn't applied.", msg);
+    ASSERT_CONDITION(memcmp(client->last_hash, server->doc->composed->hash,
+                            20) == 0,
+                     "matching hash", "different hash",
+                     "The client's last hash wasn't updated.", msg);
+
+    free(actual);
+    free(reply);
+    free(request);
+    ot_free_client(client);
+    ot_free_server(server);
+    return true;
+}
+
+static bool server_receive_batch_answers_resume_requests(char** msg) {
+    ot_server* server = ot_new_server(send, event);
+    ot_server_set_send_to(server, send_to_inboxes);
+    ot_server_open(server, new_abc_def_doc());
+    for (uint32_t id = 1; id <= WINDOW_CLIENTS; ++id) {
+        drop_inbox(id);
+    }
+
+    ot_op* op = ot_new_op();
+    ot_skip(op, 6);
+    ot_insert(op, "g");
+    char* insert = encode_with_parent(op, ot_doc_last(server->doc)->hash);
+    char* resume = ot_encode_resume(ot_doc_op(server->doc, 0)->hash, 2);
+    const char* msgs[] = { insert, resume };
+    ot_server_receive_batch(server, msgs, 2);
+
+    ASSERT_INT_EQUAL(3, ot_doc_len(server->doc),
+                     "The op in the batch wasn't appended.", msg);
+    ASSERT_INT_EQUAL(2, inbox_lens[2],
+                     "The resumed client wasn't sent a catch-up and the op.",
+                     msg);
+    ASSERT_CONDITION(strstr(inboxes[2][0], "catchUp") != NULL, "a catch-up",
+                     inboxes[2][0], "The catch-up wasn't sent first.", msg);
+    ASSERT_INT_EQUAL(1, inbox_lens[1], "The op wasn't acknowledged.", msg);
+
+    for (uint32_t id = 1; id <= WINDOW_CLIENTS; ++id) {
+        drop_inbox(id);
+    }
+    free(insert);
+    free(resume);
+    ot_free_server(server);
+    return true;
+}
+
+static bool server_acknowledges_a_resent_op_without_appending_it(char** msg) {
+    ot_server* server = ot_new_server(send, event);
+    ot_server_set_send_to(server, send_to_inboxes);
+    ot_server_set_dedup(server, 16);
+    ot_client* client = ot_new_client(client_send, client_event);
+    client->client_id = 1;
+
+    apply_insert(server, client, 0, "ab", 0, false);
+    size_t size = strlen(client_sent) + 1;
+    char* resent = malloc(size);
+    memcpy(resent, client_sent, size);
+    deliver_inbox(client);
+
+    // The first op is received again while the next one is in flight.
+    apply_insert(server, client, 2, "cd", 0, true);
+    ot_server_receive(server, resent);
+    ASSERT_INT_EQUAL(1, ot_doc_len(server->doc),
+                     "The resent op was appended again.", msg);
+    ASSERT_INT_EQUAL(1, inbox_lens[1], "The resent op wasn't acknowledged.",
+                     msg);
+    deliver_inbox(client);
+    ASSERT_CONDITION(client->ack_required, "waiting for an ack",
+                     "acknowledged",
+                     "The repeated ack was taken for the next op's.", msg);
+
+    ot_server_receive(server, client_sent);
+    deliver_inbox(client);
+
+    char* actual = ot_snapshot(server->doc->composed);
+    ASSERT_STR_EQUAL("abcd", actual, "The next op wasn't appended.", msg);
+    ASSERT_CONDITION(!client->ack_required, "acknowledged",
+                     "waiting for an ack", "The next op wasn't acknowledged.",
+                     msg);
+
+    drop_inbox(2);
+    drop_inbox(3);
+    free(actual);
+    free(resent);
+    free(client_sent);
+    client_sent = NULL;
+    ot_free_client(client);
+    ot_free_server(server);
+    return true;
+}
+
+// Has client delete the second of three characters, and returns the message
+// it sent, which the caller must free.
+static char* delete_middle(ot_client* client) {
+    ot_op* op = ot_new_op();
+    ot_skip(op, 1);
+    ot_delete(op, 1);
+    ot_skip(op, 1);
+    ot_client_apply(client, &op);
+
+    size_t size = strlen(client_sent) + 1;
+    char* sent = malloc(size);
+    memcpy(sent, client_sent, size);
+    return sent;
+}
+
+static bool server_acknowledges_an_op_that_became_a_no_op(char** msg) {
+    ot_server* server = ot_new_server(send, event);
+    ot_server_set_send_to(server, send_to_inboxes);
+    ot_client* one = ot_new_client(client_send, client_event);
+    one->client_id = 1;
+    ot_client* two = ot_new_client(client_send, client_event);
+    two->client_id = 2;
+
+    apply_insert(server, one, 0, "abc", 0, false);
+    deliver_inbox(one);
+    deliver_inbox(two);
+
+    // Both clients delete the same character, so the second delete is
+    // appended as a no-op, and its acknowledgement carries the hash of the op
+    // that client 2 is sent first.
+    char* first = delete_middle(one);
+    char* second = delete_middle(two);
+    ot_server_receive(server, first);
+    ot_server_receive(server, second);
+    deliver_inbox(one);
+    deliver_inbox(two);
+    ASSERT_CONDITION(!two->ack_required, "acknowledged", "waiting for an ack",
+                     "The no-op's acknowledgement was ignored.", msg);
+
+    // Client 2 can still send its next op.
+    free(client_sent);
+    client_sent = NULL;
+    apply_insert(server, two, 0, "x", 2, false);
+    ASSERT_CONDITION(client_sent != NULL, "sent", "not sent",
+                     "The next op wasn't sent.", msg);
+    deliver_inbox(one);
+    deliver_inbox(two);
+
+    char* expected = ot_snapshot(server->doc->composed);
+    char* actual_one = ot_snapshot(one->doc->composed);
+    char* actual_two = ot_snapshot(two->doc->composed);
+    ASSERT_STR_EQUAL("xac", expected, "The next op wasn't appended.", msg);
+    ASSERT_STR_EQUAL(expected, actual_one, "Client 1 didn't converge.", msg);
+    ASSERT_STR_EQUAL(expected, actual_two, "Client 2 didn't converge.", msg);
+
+    free(expected);
+    free(actual_one);
+    free(actual_two);
+    free(first);
+    free(second);
+    free(client_sent);
+    client_sent = NULL;
+    ot_free_client(one);
+    ot_free_client(two);
+    ot_free_server(server);
+    return true;
+}
+
+static bool server_catches_up_a_client_over_its_outbox_limit(char** msg) {
+    const int OPS = 6;
+
+    ot_server* server = ot_new_server(send, event);
+    ot_server_set_send_to(server, send_to_inboxes);
+    ot_server_set_outbox_limit(server, 256);
+    ot_client* fast = ot_new_client(client_send, client_event);
+    fast->client_id = 1;
+    ot_client* slow = ot_new_client(client_send, client_event);
+    slow->client_id = 2;
+    ot_server_connect(server, 1);
+    ot_server_connect(server, 2);
+    for (uint32_t id = 1; id <= WINDOW_CLIENTS; ++id) {
+        drop_inbox(id);
+    }
+
+    // Only the fast client's connection keeps up.
+    for (int i = 0; i < OPS; ++i) {
+        apply_insert(server, fast, (uint32_t)i, "x", 0, false);
+        deliver_inbox(fast);
+        ot_server_sent(server, 1, SIZE_MAX);
+    }
+    size_t held = inbox_lens[2];
+    ASSERT_CONDITION(held < (size_t)OPS, "fewer messages", "every op",
+                     "The slow client's queue wasn't bounded.", msg);
+    ASSERT_INT_EQUAL(1, server->outboxes.overflows,
+                     "The slow client didn't overflow once.", msg);
+
+    ot_server_sent(server, 2, SIZE_MAX);
+    ASSERT_INT_EQUAL(held + 1, inbox_lens[2],
+                     "The slow client wasn't sent one catch-up.", msg);
+    deliver_inbox(slow);
+
+    char* expected = ot_snapshot(server->doc->composed);
+    char* actual = ot_snapshot(slow->doc->composed);
+    ASSERT_STR_EQUAL(expected, actual, "The slow client didn't converge.",
+                     msg);
+
+    drop_inbox(3);
+    free(expected);
+    free(actual);
+    free(client_sent);
+    client_sent = NULL;
+    ot_free_client(fast);
+    ot_free_client(slow);
+    ot_free_server(server);
+    return true;
+}
+
+static int send_to_nobody(ot_recipients to, const uint32_t* client_ids,
+                          size_t len, ot_msg* m) {
+    (void)to;
+    (void)client_ids;
+    (void)len;
+    (void)m;
+    return 0;
+}
+
+static bool server_finds_outboxes_after_clients_come_and_go(char** msg) {
+    const uint32_t CLIENTS = 40;
+
+    ot_server* server = ot_new_server(send, event);
+    ot_server_set_send_to(server, send_to_nobody);
+    ot_server_set_outbox_limit(server, 1024);
+    for (uint32_t id = 1; id <= CLIENTS; ++id) {
+        ot_server_connect(server, id);
+    }
+    for (uint32_t id = 1; id <= CLIENTS; id += 2) {
+        ot_server_disconnect(server, id);
+    }
+    ASSERT_INT_EQUAL(CLIENTS / 2, server->outboxes.boxes.len,
+                     "The wrong number of clients are tracked.", msg);
+
+    // Every remaining client is sent a message and then has part of it
+    // written, which has to find its outbox.
+    ot_server_send(server, "{}");
+    for (uint32_t id = 2; id <= CLIENTS; id += 2) {
+        ot_server_sent(server, id, 1);
+    }
+
+    const ot_outbox* boxes = server->outboxes.boxes.data;
+    for (size_t i = 0; i < server->outboxes.boxes.len; ++i) {
+        ASSERT_CONDITION(boxes[i].client_id % 2 == 0, "even", "odd",
+                         "A disconnected client is still tracked.", msg);
+        ASSERT_INT_EQUAL(1, boxes[i].queued,
+                         "A client's queue wasn't counted.", msg);
+    }
+
+    ot_free_server(server);
+    return true;
+}
+
+static bool server_rejects_unknown_parent_before_decoding_components(
+    char** msg) {
+    ot_server* server = ot_new_server(send, event);
+    ot_server_open(server, new_abc_def_doc());
+
+    // The components are invalid, but the unknown parent is found first.
+    const char* const JSON =
+        "{\"clientId\":1,\"parent\":\"ffffffffffffffffffffffffffffffffffffffff\","
+        "\"hash\":\"\",\"components\":[{\"type\":\"bogus\"}]}";
+    ot_server_receive(server, JSON);
+
+    ot_op* dec = ot_new_op();
+    ot_err err = ot_decode(dec, sent_msg);
+    ASSERT_INT_EQUAL(OT_ERR_XFORM_FAILED, err, "Sent error was incorrect.",
+                     msg);
+
+    ot_free_op(dec);
+    ot_free_server(server);
+    return true;
+}
+
 results server_tests() {
     RUN_TEST(server_receive_fires_event_when_parent_cannot_be_found);
-    RUN_TEST(server_receive_fires_event_when_append_error_occurs);
+    RUN_TEST(server_receive_rejects_op_that_does_not_span_document);
     RUN_TEST(server_receive_fires_event_when_xform_error_occurs);
     RUN_TEST(server_receive_fires_event_when_a_decode_error_occurs);
     RUN_TEST(server_receive_when_op_has_parent_and_doc_is_empty);
     RUN_TEST(server_receive_when_empty_doc_is_opened);
+    RUN_TEST(server_receive_batch_matches_sequential_receive);
+    RUN_TEST(server_receive_batch_creates_document);
+    RUN_TEST(server_reuses_bridges_for_ops_with_the_same_parent);
+    RUN_TEST(server_fans_out_one_shared_message);
+    RUN_TEST(server_acknowledges_origin_and_sends_op_to_others);
+    RUN_TEST(server_window_composes_ops_per_recipient);
+    RUN_TEST(server_snapshot_is_cached_until_append);
+    RUN_TEST(server_catches_up_a_resumed_client);
+    RUN_TEST(server_receive_batch_answers_resume_requests);
+    RUN_TEST(server_sends_snapshot_when_hash_is_unknown);
+    RUN_TEST(server_acknowledges_a_resent_op_without_appending_it);
+    RUN_TEST(server_acknowledges_an_op_that_became_a_no_op);
+    RUN_TEST(server_catches_up_a_client_over_its_outbox_limit);
+    RUN_TEST(server_finds_outboxes_after_clients_come_and_go);
+    RUN_TEST(server_rejects_unknown_parent_before_decoding_components);
 
     return (results) { passed, failed };
 }
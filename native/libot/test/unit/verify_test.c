@@ -0,0 +1,80 @@
+#include "../../verify.h"
+#include "../../encode.h"
+#include "unit.h"
+
+// Builds a document with a history of len ops.
+static ot_doc* new_history(size_t len) {
+    ot_doc* doc = ot_new_doc();
+
+    ot_op* op = ot_new_op();
+    ot_insert(op, "abc");
+    ot_doc_append(doc, &op);
+
+    for (size_t i = 1; i < len; ++i) {
+        op = ot_new_op();
+        ot_skip(op, 1);
+        ot_insert(op, (i % 2 == 0) ? "x" : "y");
+        ot_skip(op, (uint32_t)(doc->size - 1));
+        ot_doc_append(doc, &op);
+    }
+
+    return doc;
+}
+
+static bool verify_ops_accepts_valid_history(char** msg) {
+    const size_t LEN = 10;
+    ot_doc* doc = new_history(LEN);
+
+    ot_verify_opts opts = { .threads = 3, .interval = 3 };
+    ot_verify_result result;
+    ot_err err = ot_verify_ops(doc->history.data, LEN, &opts, &result);
+    ASSERT_INT_EQUAL(OT_ERR_NONE, err, "Verifying the history failed.", msg);
+    ASSERT_INT_EQUAL(LEN, result.diverged, "The diverged index was incorrect.",
+                     msg);
+
+    ot_free_doc(doc);
+    return true;
+}
+
+static bool verify_ops_reports_first_diverging_op(char** msg) {
+    const size_t LEN = 10;
+    const size_t DIVERGED = 6;
+    ot_doc* doc = new_history(LEN);
+
+    ot_op* history = doc->history.data;
+    history[DIVERGED].hash[0] ^= 1;
+
+    ot_verify_opts opts = { .threads = 4, .interval = 2 };
+    ot_verify_result result;
+    ot_err err = ot_verify_ops(history, LEN, &opts, &result);
+    ASSERT_INT_EQUAL(OT_ERR_HASH_MISMATCH, err,
+                     "Verifying the history returned the wrong error.", msg);
+    ASSERT_INT_EQUAL(DIVERGED, result.diverged,
+                     "The diverged index was incorrect.", msg);
+
+    ot_free_doc(doc);
+    return true;
+}
+
+static bool verify_doc_decodes_and_verifies_history(char** msg) {
+    const size_t LEN = 5;
+    ot_doc* doc = new_history(LEN);
+    char* enc = ot_encode_doc(doc);
+
+    ot_verify_result result;
+    ot_err err = ot_verify_doc(enc, NULL, &result);
+    ASSERT_INT_EQUAL(OT_ERR_NONE, err, "Verifying the document failed.", msg);
+    ASSERT_INT_EQUAL(LEN, result.ops, "The number of ops was incorrect.", msg);
+
+    free(enc);
+    ot_free_doc(doc);
+    return true;
+}
+
+results verify_tests() {
+    RUN_TEST(verify_ops_accepts_valid_history);
+    RUN_TEST(verify_ops_reports_first_diverging_op);
+    RUN_TEST(verify_doc_decodes_and_verifies_history);
+
+    return (results) { passed, failed };
+}
@@ -0,0 +1,258 @@
+#include "../../server.h"
+#include "../../wal.h"
+#include "unit.h"
+
+static int sent = 0;
+
+static int send(const char* msg) {
+    (void)msg;
+    ++sent;
+
+    return 0;
+}
+
+static int event(ot_event_type t, ot_op* op) {
+    (void)t;
+    (void)op;
+
+    return 0;
+}
+
+static int replayed = 0;
+static char replayed_id[64];
+
+static ot_err count_record(void* arg, const char* doc_id, ot_op* op) {
+    (void)arg;
+    ++replayed;
+    snprintf(replayed_id, sizeof(replayed_id), "%s", doc_id);
+    ot_free_op(op);
+
+    return OT_ERR_NONE;
+}
+
+static bool wal_holds_ops_until_they_are_durable(char** msg) {
+    const char* PATH = "/tmp/libot_wal_test_hold.log";
+    remove(PATH);
+
+    // The group isn't due for a long time, so nothing is synced until the
+    // server asks for it.
+    ot_wal_opts opts = { .group_secs = 60 };
+    ot_wal* wal = ot_open_wal(PATH, &opts);
+    ot_server* server = ot_new_server(send, event);
+    ot_server_set_wal(server, wal);
+    sent = 0;
+
+    ot_op* op = ot_new_op();
+    ot_insert(op, "abc");
+    char* enc = ot_encode(op);
+    ot_server_receive(server, enc);
+    free(enc);
+    ot_free_op(op);
+
+    ASSERT_INT_EQUAL(1, ot_doc_len(server->doc), "The op wasn't appended.",
+                     msg);
+    ASSERT_INT_EQUAL(0, sent, "The op was sent before it was durable.", msg);
+
+    ot_server_sync(server);
+    ASSERT_INT_EQUAL(1, ot_wal_durable(wal), "The op wasn't synced.", msg);
+    ASSERT_INT_EQUAL(1, sent, "The op wasn't sent once it was durable.", msg);
+
+    ot_wal_stats stats;
+    ot_wal_get_stats(wal, &stats);
+    ASSERT_INT_EQUAL(1, stats.records, "The wrong number of records were "
+                     "counted.", msg);
+    ASSERT_INT_EQUAL(1, stats.sync.count, "Sync latency wasn't recorded.",
+                     msg);
+
+    ot_free_server(server);
+    ot_close_wal(wal);
+    remove(PATH);
+    return true;
+}
+
+static bool wal_sends_held_ops_before_opening_another_document(char** msg) {
+    const char* PATH = "/tmp/libot_wal_test_open.log";
+    remove(PATH);
+
+    ot_wal_opts opts = { .group_secs = 60 };
+    ot_wal* wal = ot_open_wal(PATH, &opts);
+    ot_server* server = ot_new_server(send, event);
+    ot_server_set_wal(server, wal);
+    sent = 0;
+
+    ot_op* op = ot_new_op();
+    ot_insert(op, "abc");
+    char* enc = ot_encode(op);
+    ot_server_receive(server, enc);
+    free(enc);
+    ot_free_op(op);
+    ASSERT_INT_EQUAL(0, sent, "The op was sent before it was durable.", msg);
+
+    ot_doc* old = server->doc;
+    ot_server_open(server, ot_new_doc());
+    ASSERT_INT_EQUAL(1, sent, "The held op wasn't sent before switching.",
+                     msg);
+    ASSERT_INT_EQUAL(0, server->unsynced.len,
+                     "The old document's op is still held.", msg);
+
+    ot_free_doc(old);
+    ot_free_server(server);
+    ot_close_wal(wal);
+    remove(PATH);
+    return true;
+}
+
+static bool wal_keeps_held_ops_out_of_snapshots(char** msg) {
+    const char* PATH = "/tmp/libot_wal_test_snapshot.log";
+    remove(PATH);
+
+    ot_wal_opts opts = { .group_secs = 60 };
+    ot_wal* wal = ot_open_wal(PATH, &opts);
+    ot_server* server = ot_new_server(send, event);
+    ot_server_set_wal(server, wal);
+
+    ot_op* op = ot_new_op();
+    ot_insert(op, "abc");
+    char* enc = ot_encode(op);
+    ot_server_receive(server, enc);
+    free(enc);
+    ot_free_op(op);
+    ot_server_sync(server);
+
+    // A hash that isn't in the history gets a snapshot in the catch-up.
+    char unknown[20];
+    memset(unknown, 0xff, 20);
+    char* request = ot_encode_resume(unknown, 9);
+    char* durable_catch_up = ot_server_catch_up(server, request);
+    size_t len;
+    const char* snapshot = ot_server_snapshot(server, &len);
+    char* durable_snapshot = malloc(len + 1);
+    memcpy(durable_snapshot, snapshot, len + 1);
+
+    op = ot_new_op();
+    memcpy(op->parent, ot_doc_op(server->doc, 0)->hash, 20);
+    ot_skip(op, 3);
+    ot_insert(op, "d");
+    enc = ot_encode(op);
+    ot_server_receive(server, enc);
+    free(enc);
+    ot_free_op(op);
+
+    // The second op isn't durable, so clients can't be shown it yet.
+    ASSERT_INT_EQUAL(2, ot_doc_len(server->doc), "The op wasn't appended.",
+                     msg);
+    ASSERT_STR_EQUAL(durable_snapshot, ot_server_snapshot(server, NULL),
+                     "The snapshot included an op that wasn't durable.", msg);
+    char* held_catch_up = ot_server_catch_up(server, request);
+    ASSERT_STR_EQUAL(durable_catch_up, held_catch_up,
+                     "The catch-up included an op that wasn't durable.", msg);
+    free(held_catch_up);
+
+    ot_server_sync(server);
+    ASSERT_CONDITION(strcmp(durable_snapshot,
+                            ot_server_snapshot(server, NULL)) != 0,
+                     "new snapshot", "old snapshot",
+                     "The snapshot didn't include the durable op.", msg);
+
+    free(durable_snapshot);
+    free(durable_catch_up);
+    free(request);
+    ot_free_server(server);
+    ot_close_wal(wal);
+    remove(PATH);
+    return true;
+}
+
+static bool wal_stops_writing_after_a_failed_group(char** msg) {
+    const char* PATH = "/tmp/libot_wal_test_failed.log";
+    remove(PATH);
+
+    // Every write to /dev/full fails.
+    ot_wal* wal = ot_open_wal("/dev/full", NULL);
+    ASSERT_CONDITION(wal != NULL, "opened", "NULL", "The log wasn't opened.",
+                     msg);
+    ot_op* op = ot_new_op();
+    ot_insert(op, "abc");
+    bool durable = ot_wal_wait(wal, ot_wal_append(wal, "a", op));
+    ASSERT_CONDITION(!durable, "failed", "durable",
+                     "A failed record was durable.", msg);
+
+    // Even once the file can be written again, the later records would make
+    // the failed one look durable.
+    ot_mutex_lock(&wal->lock);
+    fclose(wal->file);
+    wal->file = fopen(PATH, "ab");
+    ot_mutex_unlock(&wal->lock);
+    ot_wal_append(wal, "b", op);
+    ot_free_op(op);
+    ot_close_wal(wal);
+
+    FILE* file = fopen(PATH, "rb");
+    ASSERT_INT_EQUAL(EOF, getc(file), "A record was written after the failure.",
+                     msg);
+    fclose(file);
+
+    remove(PATH);
+    return true;
+}
+
+static bool wal_replay_ignores_a_torn_last_record(char** msg) {
+    const char* PATH = "/tmp/libot_wal_test_torn.log";
+    remove(PATH);
+
+    ot_wal* wal = ot_open_wal(PATH, NULL);
+    ot_op* op = ot_new_op();
+    ot_insert(op, "abc");
+    ot_wal_wait(wal, ot_wal_append(wal, "a", op));
+    ot_wal_wait(wal, ot_wal_append(wal, "b", op));
+    ot_free_op(op);
+    ot_close_wal(wal);
+
+    // The process stopped partway through writing a third record.
+    FILE* file = fopen(PATH, "ab");
+    fputs("{\"docId\":\"c\",\"clientId\":", file);
+    fclose(file);
+
+    replayed = 0;
+    ot_err err = ot_wal_replay(PATH, count_record, NULL);
+    ASSERT_INT_EQUAL(OT_ERR_NONE, err, "The replay failed.", msg);
+    ASSERT_INT_EQUAL(2, replayed, "The wrong number of records were replayed.",
+                     msg);
+    ASSERT_STR_EQUAL("b", replayed_id, "The last record had the wrong ID.",
+                     msg);
+
+    // Reopening the log removes the torn record before appending.
+    wal = ot_open_wal(PATH, NULL);
+    op = ot_new_op();
+    ot_insert(op, "abc");
+    ot_wal_wait(wal, ot_wal_append(wal, "d", op));
+    ot_free_op(op);
+    ot_close_wal(wal);
+
+    replayed = 0;
+    err = ot_wal_replay(PATH, count_record, NULL);
+    ASSERT_INT_EQUAL(OT_ERR_NONE, err, "The reopened log couldn't be replayed.",
+                     msg);
+    ASSERT_INT_EQUAL(3, replayed, "The wrong number of records were replayed "
+                     "after reopening.", msg);
+    ASSERT_STR_EQUAL("d", replayed_id, "The appended record had the wrong ID.",
+                     msg);
+
+    remove(PATH);
+    replayed = 0;
+    err = ot_wal_replay(PATH, count_record, NULL);
+    ASSERT_INT_EQUAL(OT_ERR_NONE, err, "A missing log wasn't empty.", msg);
+    ASSERT_INT_EQUAL(0, replayed, "A missing log had records.", msg);
+
+    return true;
+}
+
+results wal_tests() {
+    RUN_TEST(wal_holds_ops_until_they_are_durable);
+    RUN_TEST(wal_sends_held_ops_before_opening_another_document);
+    RUN_TEST(wal_keeps_held_ops_out_of_snapshots);
+    RUN_TEST(wal_stops_writing_after_a_failed_group);
+    RUN_TEST(wal_replay_ignores_a_torn_last_record);
+
+    return (results) { passed, failed };
+}
@@ -0,0 +1,169 @@
+// clock_gettime and sysconf aren't part of C99, so the POSIX feature macro must
+// be defined before any system headers are included.
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "thread.h"
+
+#ifndef LIBOT_NO_THREADS
+
+bool ot_thread_start(ot_thread* thread, void* (*func)(void*), void* arg) {
+    return pthread_create(thread, NULL, func, arg) == 0;
+}
+
+void ot_thread_join(ot_thread thread) { pthread_join(thread, NULL); }
+
+void ot_mutex_init(ot_mutex* mutex) { pthread_mutex_init(mutex, NULL); }
+
+void ot_mutex_destroy(ot_mutex* mutex) { pthread_mutex_destroy(mutex); }
+
+void ot_mutex_lock(ot_mutex* mutex) { pthread_mutex_lock(mutex); }
+
+void ot_mutex_unlock(ot_mutex* mutex) { pthread_mutex_unlock(mutex); }
+
+void ot_cond_init(ot_cond* cond) { pthread_cond_init(cond, NULL); }
+
+void ot_cond_destroy(ot_cond* cond) { pthread_cond_destroy(cond); }
+
+void ot_cond_wait(ot_cond* cond, ot_mutex* mutex) {
+    pthread_cond_wait(cond, mutex);
+}
+
+void ot_cond_timed_wait(ot_cond* cond, ot_mutex* mutex, double secs) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    double whole = (double)(long)secs;
+    ts.tv_sec += (time_t)whole;
+    ts.tv_nsec += (long)((secs - whole) * 1000000000.0);
+    if (ts.tv_nsec >= 1000000000L) {
+        ++ts.tv_sec;
+        ts.tv_nsec -= 1000000000L;
+    }
+
+    pthread_cond_timedwait(cond, mutex, &ts);
+}
+
+void ot_cond_signal(ot_cond* cond) { pthread_cond_signal(cond); }
+
+void ot_cond_broadcast(ot_cond* cond) { pthread_cond_broadcast(cond); }
+
+#else
+
+bool ot_thread_start(ot_thread* thread, void* (*func)(void*), void* arg) {
+    (void)thread;
+    (void)func;
+    (void)arg;
+    return false;
+}
+
+void ot_thread_join(ot_thread thread) { (void)thread; }
+
+void ot_mutex_init(ot_mutex* mutex) { *mutex = 0; }
+
+void ot_mutex_destroy(ot_mutex* mutex) { (void)mutex; }
+
+void ot_mutex_lock(ot_mutex* mutex) { (void)mutex; }
+
+void ot_mutex_unlock(ot_mutex* mutex) { (void)mutex; }
+
+void ot_cond_init(ot_cond* cond) { *cond = 0; }
+
+void ot_cond_destroy(ot_cond* cond) { (void)cond; }
+
+void ot_cond_wait(ot_cond* cond, ot_mutex* mutex) {
+    (void)cond;
+    (void)mutex;
+}
+
+void ot_cond_timed_wait(ot_cond* cond, ot_mutex* mutex, double secs) {
+    (void)cond;
+    (void)mutex;
+    (void)secs;
+}
+
+void ot_cond_signal(ot_cond* cond) { (void)cond; }
+
+void ot_cond_broadcast(ot_cond* cond) { (void)cond; }
+
+#endif
+
+typedef struct parallel_for {
+    size_t count;
+    size_t next;
+    void (*func)(size_t, void*);
+    void* arg;
+    ot_mutex lock;
+} parallel_for;
+
+static void* parallel_for_worker(void* arg) {
+    parallel_for* p = arg;
+    while (true) {
+        ot_mutex_lock(&p->lock);
+        size_t i = p->next++;
+        ot_mutex_unlock(&p->lock);
+
+        if (i >= p->count) {
+            return NULL;
+        }
+        p->func(i, p->arg);
+    }
+}
+
+void ot_parallel_for(size_t count, size_t threads,
+                     void (*func)(size_t i, void* arg), void* arg) {
+    if (threads == 0) {
+        threads = ot_cpu_count();
+    }
+    if (threads > count) {
+        threads = count;
+    }
+
+    parallel_for p;
+    p.count = count;
+    p.next = 0;
+    p.func = func;
+    p.arg = arg;
+    ot_mutex_init(&p.lock);
+
+    // The calling thread acts as one of the workers, so only threads - 1 extra
+    // threads need to be started.
+    ot_thread* workers = NULL;
+    size_t started = 0;
+    if (threads > 1) {
+        workers = malloc(sizeof(ot_thread) * (threads - 1));
+        while (started < threads - 1 &&
+               ot_thread_start(workers + started, parallel_for_worker, &p)) {
+            ++started;
+        }
+    }
+
+    parallel_for_worker(&p);
+    for (size_t i = 0; i < started; ++i) {
+        ot_thread_join(workers[i]);
+    }
+
+    free(workers);
+    ot_mutex_destroy(&p.lock);
+}
+
+size_t ot_cpu_count(void) {
+#ifdef _SC_NPROCESSORS_ONLN
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > 0) {
+        return (size_t)n;
+    }
+#endif
+
+    return 1;
+}
+
+double ot_now(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+        return 0;
+    }
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
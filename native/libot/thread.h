@@ -0,0 +1,62 @@
+#ifndef LIBOT_THREAD_H
+#define LIBOT_THREAD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Provides a thin portability layer over pthreads along with a few timing
+// helpers.
+//
+// If LIBOT_NO_THREADS is defined (e.g., for Emscripten builds), the types below
+// still exist and the locking functions become no-ops, but ot_thread_start will
+// always fail. Callers must therefore be prepared to do their work inline on
+// the calling thread.
+
+#ifndef LIBOT_NO_THREADS
+#include <pthread.h>
+
+typedef pthread_t ot_thread;
+typedef pthread_mutex_t ot_mutex;
+typedef pthread_cond_t ot_cond;
+#else
+typedef int ot_thread;
+typedef int ot_mutex;
+typedef int ot_cond;
+#endif
+
+// Starts a new thread running func(arg). Returns false if the thread couldn't
+// be started, in which case func will not be called.
+bool ot_thread_start(ot_thread* thread, void* (*func)(void*), void* arg);
+
+// Waits for a thread started with ot_thread_start to finish.
+void ot_thread_join(ot_thread thread);
+
+void ot_mutex_init(ot_mutex* mutex);
+void ot_mutex_destroy(ot_mutex* mutex);
+void ot_mutex_lock(ot_mutex* mutex);
+void ot_mutex_unlock(ot_mutex* mutex);
+
+void ot_cond_init(ot_cond* cond);
+void ot_cond_destroy(ot_cond* cond);
+void ot_cond_wait(ot_cond* cond, ot_mutex* mutex);
+
+// Like ot_cond_wait, but gives up after about secs seconds.
+void ot_cond_timed_wait(ot_cond* cond, ot_mutex* mutex, double secs);
+void ot_cond_signal(ot_cond* cond);
+void ot_cond_broadcast(ot_cond* cond);
+
+// Calls func(i, arg) for every i in [0, count) using up to "threads" threads,
+// including the calling thread. Indexes are handed out in increasing order, but
+// may complete in any order. If threads is 0, then one thread per CPU is used.
+// Returns once every call has finished.
+void ot_parallel_for(size_t count, size_t threads,
+                     void (*func)(size_t i, void* arg), void* arg);
+
+// Returns the number of online CPUs, or 1 if it can't be determined.
+size_t ot_cpu_count(void);
+
+// Returns the current time of a monotonic clock in seconds. It's only useful
+// for measuring elapsed time between two calls.
+double ot_now(void);
+
+#endif
@@ -19,7 +19,8 @@ uint32_t utf8_cps(const char byte) {
 uint32_t utf8_length(const char* str) {
     uint32_t length = 0;
     uint32_t i = 0;
-    while (i < strlen(str)) {
+    uint32_t bytes = (uint32_t)strlen(str);
+    while (i < bytes) {
         uint32_t cps = utf8_cps(str[i]);
         i += cps;
         length++;
@@ -0,0 +1,220 @@
+#include "verify.h"
+
+// Segment j covers the ops in [start, end).
+typedef struct segment {
+    size_t start;
+    size_t end;
+
+    // Every op in the segment composed together, or NULL if they couldn't be
+    // composed.
+    ot_op* delta;
+
+    // Document state before the first op in the segment. It's NULL for the
+    // first segment, since there's no state before the first op.
+    ot_op* checkpoint;
+
+    // First failure within the segment. fail_index is equal to end if the
+    // segment was valid.
+    size_t fail_index;
+    ot_err fail_err;
+} segment;
+
+typedef struct verification {
+    const ot_op* ops;
+    segment* segments;
+} verification;
+
+static void compose_segment(size_t i, void* arg) {
+    verification* v = arg;
+    segment* seg = v->segments + i;
+    const ot_op* ops = v->ops;
+
+    ot_op* delta = ot_dup_op(ops + seg->start);
+    for (size_t j = seg->start + 1; j < seg->end && delta != NULL; ++j) {
+        ot_op* temp = ot_compose(delta, (ot_op*)(ops + j));
+        ot_free_op(delta);
+        delta = temp;
+    }
+
+    seg->delta = delta;
+}
+
+static void replay_segment(size_t i, void* arg) {
+    verification* v = arg;
+    segment* seg = v->segments + i;
+    const ot_op* ops = v->ops;
+    const char zero[20] = { 0 };
+
+    ot_op* state = NULL;
+    if (seg->checkpoint != NULL) {
+        state = ot_dup_op(seg->checkpoint);
+    }
+
+    for (size_t j = seg->start; j < seg->end; ++j) {
+        const char* parent = (j == 0) ? zero : ops[j - 1].hash;
+        if (memcmp(ops[j].parent, parent, 20) != 0) {
+            seg->fail_index = j;
+            seg->fail_err = OT_ERR_HASH_MISMATCH;
+            break;
+        }
+
+        ot_op* next;
+        if (state == NULL) {
+            next = ot_dup_op(ops + j);
+        } else {
+            next = ot_compose(state, (ot_op*)(ops + j));
+            ot_free_op(state);
+        }
+
+        state = next;
+        if (state == NULL) {
+            seg->fail_index = j;
+            seg->fail_err = OT_ERR_COMPOSE_FAILED;
+            break;
+        }
+
+        hash_op(state);
+        if (memcmp(state->hash, ops[j].hash, 20) != 0) {
+            seg->fail_index = j;
+            seg->fail_err = OT_ERR_HASH_MISMATCH;
+            break;
+        }
+    }
+
+    if (state != NULL) {
+        ot_free_op(state);
+    }
+}
+
+ot_err ot_verify_ops(const ot_op* ops, size_t len, const ot_verify_opts* opts,
+                     ot_verify_result* result) {
+    result->err = OT_ERR_NONE;
+    result->diverged = len;
+    result->ops = len;
+    if (len == 0) {
+        return OT_ERR_NONE;
+    }
+
+    size_t threads = (opts != NULL) ? opts->threads : 0;
+    if (threads == 0) {
+        threads = ot_cpu_count();
+    }
+    size_t interval = (opts != NULL) ? opts->interval : 0;
+    if (interval == 0) {
+        interval = len / (threads * 2);
+        if (interval == 0) {
+            interval = 1;
+        }
+    }
+
+    size_t count = (len + interval - 1) / interval;
+    segment* segments = malloc(sizeof(segment) * count);
+    for (size_t i = 0; i < count; ++i) {
+        segment* seg = segments + i;
+        seg->start = i * interval;
+        seg->end = (seg->start + interval < len) ? seg->start + interval : len;
+        seg->delta = NULL;
+        seg->checkpoint = NULL;
+        seg->fail_index = seg->end;
+        seg->fail_err = OT_ERR_NONE;
+    }
+
+    verification v = { ops, segments };
+    ot_parallel_for(count, threads, compose_segment, &v);
+
+    // Chain the segments together to get a checkpoint at the start of each
+    // one. If a segment can't be composed, then its divergence will be found
+    // when it's replayed, so there's no point in checkpointing past it.
+    size_t replayable = 1;
+    ot_op* state = NULL;
+    while (replayable < count) {
+        segment* prev = segments + replayable - 1;
+        if (prev->delta == NULL) {
+            break;
+        }
+
+        ot_op* next;
+        if (state == NULL) {
+            next = ot_dup_op(prev->delta);
+        } else {
+            next = ot_compose(state, prev->delta);
+        }
+
+        if (next == NULL) {
+            break;
+        }
+
+        state = next;
+        segments[replayable].checkpoint = state;
+        ++replayable;
+    }
+
+    ot_parallel_for(replayable, threads, replay_segment, &v);
+
+    for (size_t i = 0; i < replayable; ++i) {
+        if (segments[i].fail_err != OT_ERR_NONE) {
+            result->err = segments[i].fail_err;
+            result->diverged = segments[i].fail_index;
+            break;
+        }
+    }
+
+    // Every replayed segment was valid, yet a checkpoint couldn't be built
+    // after them. This can only happen if the composition of the segments
+    // disagrees with replaying them, so blame the first op that couldn't be
+    // checkpointed.
+    if (result->err == OT_ERR_NONE && replayable < count) {
+        result->err = OT_ERR_COMPOSE_FAILED;
+        result->diverged = segments[replayable].start;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        if (segments[i].delta != NULL) {
+            ot_free_op(segments[i].delta);
+        }
+        if (segments[i].checkpoint != NULL) {
+            ot_free_op(segments[i].checkpoint);
+        }
+    }
+    free(segments);
+
+    return result->err;
+}
+
+static ot_err collect_sink(ot_op* op, void* arg) {
+    array* ops = arg;
+    ot_op* dst = array_append(ops);
+    memcpy(dst, op, sizeof(ot_op));
+
+    // The components now belong to the array, so only the struct is freed.
+    free(op);
+    return OT_ERR_NONE;
+}
+
+ot_err ot_verify_doc(const char* const json, const ot_verify_opts* opts,
+                     ot_verify_result* result) {
+    array ops;
+    array_init(&ops, sizeof(ot_op));
+
+    const ot_decode_opts* decode_opts = (opts != NULL) ? &opts->decode : NULL;
+    ot_err err = ot_decode_each(json, decode_opts, NULL, collect_sink, &ops);
+    if (err != OT_ERR_NONE) {
+        result->err = err;
+        result->diverged = ops.len;
+        result->ops = ops.len;
+    } else {
+        err = ot_verify_ops(ops.data, ops.len, opts, result);
+    }
+
+    ot_op* data = ops.data;
+    for (size_t i = 0; i < ops.len; ++i) {
+        ot_comp* comps = data[i].comps.data;
+        for (size_t j = 0; j < data[i].comps.len; ++j) {
+            ot_free_comp(comps + j);
+        }
+        array_free(&data[i].comps);
+    }
+    array_free(&ops);
+
+    return err;
+}
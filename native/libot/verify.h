@@ -0,0 +1,61 @@
+#ifndef LIBOT_VERIFY_H
+#define LIBOT_VERIFY_H
+
+#include <stdlib.h>
+#include <string.h>
+#include "ot.h"
+#include "compose.h"
+#include "decode.h"
+#include "sha1.h"
+#include "thread.h"
+
+// Provides integrity checks for untrusted document histories. Every op's parent
+// must be the hash of the op before it, and every op's hash must be the hash of
+// the document after the op has been applied.
+//
+// Verification is split into segments of "interval" ops. The ops in each
+// segment are first composed in parallel, and then the segments are chained
+// together to materialize the document state at the start of every segment.
+// Finally, each segment is replayed and hashed in parallel starting from its
+// checkpoint. Each checkpoint is a full copy of the document state, so a
+// smaller interval trades memory for parallelism.
+
+// Options for the verifiers. A zeroed struct selects the defaults.
+typedef struct ot_verify_opts {
+    // Number of threads used for verification. 0 uses one per CPU.
+    size_t threads;
+
+    // Number of ops between checkpoints. 0 picks an interval that gives every
+    // thread a couple of segments.
+    size_t interval;
+
+    // Options used when decoding the history in ot_verify_doc.
+    ot_decode_opts decode;
+} ot_verify_opts;
+
+typedef struct ot_verify_result {
+    // OT_ERR_NONE if the history is valid. Otherwise, it's the reason that the
+    // op at index "diverged" failed verification.
+    ot_err err;
+
+    // Index of the first op that failed verification. If the whole history is
+    // valid, then this is equal to the number of ops.
+    size_t diverged;
+
+    // Total number of ops in the history.
+    size_t ops;
+} ot_verify_result;
+
+// Verifies a history of len ops. The ops must have their stored parents and
+// hashes, which means they can't have been appended to an ot_doc (appending
+// recomputes them). Returns result->err.
+ot_err ot_verify_ops(const ot_op* ops, size_t len, const ot_verify_opts* opts,
+                     ot_verify_result* result);
+
+// Decodes a document encoded with ot_encode_doc and verifies its history.
+// If the document can't be decoded, then the decode error is returned and
+// result->diverged is the number of ops that were decoded successfully.
+ot_err ot_verify_doc(const char* const json, const ot_verify_opts* opts,
+                     ot_verify_result* result);
+
+#endif
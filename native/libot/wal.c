@@ -0,0 +1,326 @@
+// fileno and fsync aren't part of C99, so the POSIX feature macro must be
+// defined before any system headers are included.
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "wal.h"
+#include "decode.h"
+#include "encode.h"
+#include "log.h"
+
+#define DEFAULT_GROUP_BYTES (256 * 1024)
+#define DEFAULT_GROUP_SECS 0.002
+
+// Writes the buffered records and syncs them. The lock must be held. When the
+// syncer does this, the lock is released while the group is being written so
+// that more records can be appended in the meantime. Otherwise it's kept, so
+// that appenders write their groups one at a time.
+static void sync_group(ot_wal* wal) {
+    char* buf = wal->buf;
+    size_t len = wal->buf_len;
+    uint64_t end = wal->appended;
+    wal->buf = NULL;
+    wal->buf_len = 0;
+    wal->buf_cap = 0;
+
+    // Records after a failed group can't be durable without the ones that
+    // were lost, so they're dropped instead of written.
+    if (wal->failed) {
+        free(buf);
+        return;
+    }
+    if (wal->threaded) {
+        ot_mutex_unlock(&wal->lock);
+    }
+
+    double start = ot_now();
+    bool ok = fwrite(buf, 1, len, wal->file) == len &&
+              fflush(wal->file) == 0 && fsync(fileno(wal->file)) == 0;
+    double secs = ot_now() - start;
+    free(buf);
+
+    if (wal->threaded) {
+        ot_mutex_lock(&wal->lock);
+    }
+    ok = ok && !wal->failed;
+    if (ok) {
+        wal->durable = end;
+        ++wal->stats.syncs;
+        ot_latency_record(&wal->stats.sync, secs);
+    } else {
+        OT_LOG(OT_LOG_ERROR, OT_ERR_NONE,
+               "Couldn't write to the write-ahead log. No more operations will "
+               "be acknowledged.");
+        wal->failed = true;
+    }
+    ot_cond_broadcast(&wal->durable_cond);
+
+    // The callback may check what's durable, so it's called without the lock.
+    if (ok && wal->synced != NULL && wal->threaded) {
+        ot_mutex_unlock(&wal->lock);
+        wal->synced(wal->arg);
+        ot_mutex_lock(&wal->lock);
+    }
+}
+
+// Returns whether the buffered records should be synced now.
+static bool group_due(const ot_wal* wal, double now) {
+    return wal->buf_len > 0 &&
+           (wal->closing || wal->waiters > 0 ||
+            wal->buf_len >= wal->group_bytes ||
+            now - wal->first >= wal->group_secs);
+}
+
+static void* syncer_main(void* arg) {
+    ot_wal* wal = arg;
+
+    ot_mutex_lock(&wal->lock);
+    while (true) {
+        double now = ot_now();
+        if (group_due(wal, now)) {
+            sync_group(wal);
+        } else if (wal->closing) {
+            break;
+        } else if (wal->buf_len == 0) {
+            ot_cond_wait(&wal->wake, &wal->lock);
+        } else {
+            ot_cond_timed_wait(&wal->wake, &wal->lock,
+                               wal->first + wal->group_secs - now);
+        }
+    }
+    ot_mutex_unlock(&wal->lock);
+
+    return NULL;
+}
+
+// Cuts a record that was only partly written when the process stopped off the
+// end of the log at path, so that the next record starts on its own line.
+// Returns false if the log exists but can't be trimmed.
+static bool trim_torn_record(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return true;
+    }
+    if (fseeko(file, 0, SEEK_END) != 0) {
+        fclose(file);
+        return false;
+    }
+
+    // Everything after the last newline is torn, so the file is scanned
+    // backwards from its end.
+    off_t end = ftello(file);
+    off_t pos = end;
+    off_t keep = -1;
+    char chunk[4096];
+    while (pos > 0 && keep < 0) {
+        size_t n = (pos < (off_t)sizeof(chunk)) ? (size_t)pos : sizeof(chunk);
+        pos -= (off_t)n;
+        if (fseeko(file, pos, SEEK_SET) != 0 ||
+            fread(chunk, 1, n, file) != n) {
+            fclose(file);
+            return false;
+        }
+        for (size_t i = n; i > 0 && keep < 0; --i) {
+            if (chunk[i - 1] == '\n') {
+                keep = pos + (off_t)i;
+            }
+        }
+    }
+    fclose(file);
+
+    if (keep < 0) {
+        keep = 0;
+    }
+    if (keep == end) {
+        return true;
+    }
+
+    OT_LOG(OT_LOG_INFO, OT_ERR_NONE,
+           "Removed a partly written record from the end of the write-ahead "
+           "log.");
+    return truncate(path, keep) == 0;
+}
+
+ot_wal* ot_open_wal(const char* path, const ot_wal_opts* opts) {
+    if (!trim_torn_record(path)) {
+        return NULL;
+    }
+
+    FILE* file = fopen(path, "ab");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    ot_wal_opts o = { 0 };
+    if (opts != NULL) {
+        o = *opts;
+    }
+
+    ot_wal* wal = malloc(sizeof(ot_wal));
+    wal->file = file;
+    wal->group_bytes =
+        (o.group_bytes > 0) ? o.group_bytes : DEFAULT_GROUP_BYTES;
+    wal->group_secs = (o.group_secs > 0) ? o.group_secs : DEFAULT_GROUP_SECS;
+    wal->synced = o.synced;
+    wal->arg = o.arg;
+    ot_mutex_init(&wal->lock);
+    ot_cond_init(&wal->wake);
+    ot_cond_init(&wal->durable_cond);
+    wal->buf = NULL;
+    wal->buf_len = 0;
+    wal->buf_cap = 0;
+    wal->first = 0;
+    wal->waiters = 0;
+    wal->appended = 0;
+    wal->durable = 0;
+    wal->failed = false;
+    wal->closing = false;
+    wal->stats.records = 0;
+    wal->stats.syncs = 0;
+    ot_latency_init(&wal->stats.sync);
+
+    wal->threaded = ot_thread_start(&wal->syncer, syncer_main, wal);
+    return wal;
+}
+
+void ot_close_wal(ot_wal* wal) {
+    ot_mutex_lock(&wal->lock);
+    wal->closing = true;
+    ot_cond_signal(&wal->wake);
+    ot_mutex_unlock(&wal->lock);
+
+    if (wal->threaded) {
+        ot_thread_join(wal->syncer);
+    }
+
+    fclose(wal->file);
+    free(wal->buf);
+    ot_cond_destroy(&wal->durable_cond);
+    ot_cond_destroy(&wal->wake);
+    ot_mutex_destroy(&wal->lock);
+    free(wal);
+}
+
+uint64_t ot_wal_append(ot_wal* wal, const char* doc_id, const ot_op* op) {
+    char* enc = ot_encode_tagged(op, (doc_id != NULL) ? doc_id : "");
+    size_t len = strlen(enc);
+
+    ot_mutex_lock(&wal->lock);
+    if (wal->buf_len + len + 1 > wal->buf_cap) {
+        size_t cap = (wal->buf_cap > 0) ? wal->buf_cap * 2 : 4096;
+        while (cap < wal->buf_len + len + 1) {
+            cap *= 2;
+        }
+        wal->buf = realloc(wal->buf, cap);
+        wal->buf_cap = cap;
+    }
+
+    // JSON strings can't contain raw newlines, so a newline always ends a
+    // record.
+    if (wal->buf_len == 0) {
+        wal->first = ot_now();
+    }
+    memcpy(wal->buf + wal->buf_len, enc, len);
+    wal->buf[wal->buf_len + len] = '\n';
+    wal->buf_len += len + 1;
+    uint64_t seq = ++wal->appended;
+    ++wal->stats.records;
+
+    if (!wal->threaded) {
+        sync_group(wal);
+    } else if (wal->buf_len == len + 1 || wal->buf_len >= wal->group_bytes) {
+        // The syncer needs to start timing a new group, or sync a full one.
+        ot_cond_signal(&wal->wake);
+    }
+    ot_mutex_unlock(&wal->lock);
+
+    free(enc);
+    return seq;
+}
+
+uint64_t ot_wal_durable(ot_wal* wal) {
+    ot_mutex_lock(&wal->lock);
+    uint64_t durable = wal->durable;
+    ot_mutex_unlock(&wal->lock);
+
+    return durable;
+}
+
+bool ot_wal_wait(ot_wal* wal, uint64_t seq) {
+    ot_mutex_lock(&wal->lock);
+    while (wal->durable < seq && !wal->failed) {
+        ++wal->waiters;
+        ot_cond_signal(&wal->wake);
+        ot_cond_wait(&wal->durable_cond, &wal->lock);
+        --wal->waiters;
+    }
+    bool durable = wal->durable >= seq;
+    ot_mutex_unlock(&wal->lock);
+
+    return durable;
+}
+
+void ot_wal_get_stats(ot_wal* wal, ot_wal_stats* stats) {
+    ot_mutex_lock(&wal->lock);
+    memcpy(stats, &wal->stats, sizeof(ot_wal_stats));
+    ot_mutex_unlock(&wal->lock);
+}
+
+// Decodes a complete record and passes it to apply.
+static ot_err replay_record(const char* record, ot_wal_apply_func apply,
+                            void* arg) {
+    ot_op* op = ot_new_op();
+    char* doc_id = NULL;
+    ot_err err = ot_decode_tagged(op, &doc_id, record);
+    if (err != OT_ERR_NONE) {
+        OT_LOG(OT_LOG_ERROR, err,
+               "Couldn't decode a write-ahead log record.\n\tJSON: %s", record);
+        ot_free_op(op);
+        free(doc_id);
+        return OT_ERR_INVALID_JSON;
+    }
+
+    err = apply(arg, doc_id, op);
+    free(doc_id);
+    return err;
+}
+
+ot_err ot_wal_replay(const char* path, ot_wal_apply_func apply, void* arg) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return OT_ERR_NONE;
+    }
+
+    size_t cap = 4096;
+    size_t len = 0;
+    char* line = malloc(cap);
+    ot_err err = OT_ERR_NONE;
+    int c;
+    while (err == OT_ERR_NONE && (c = getc(file)) != EOF) {
+        if (c != '\n') {
+            if (len + 1 == cap) {
+                cap *= 2;
+                line = realloc(line, cap);
+            }
+            line[len++] = (char)c;
+            continue;
+        }
+
+        line[len] = '\0';
+        err = replay_record(line, apply, arg);
+        len = 0;
+    }
+
+    // Whatever is left without a newline is a torn record.
+    if (err == OT_ERR_NONE && len > 0) {
+        OT_LOG(OT_LOG_INFO, OT_ERR_NONE,
+               "Ignored a partly written record at the end of the "
+               "write-ahead log.");
+    }
+
+    free(line);
+    fclose(file);
+    return err;
+}
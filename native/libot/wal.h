@@ -0,0 +1,131 @@
+#ifndef LIBOT_WAL_H
+#define LIBOT_WAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "latency.h"
+#include "ot.h"
+#include "thread.h"
+
+// A write-ahead log of appended ops that makes them durable before they're
+// acknowledged. Ops from any number of documents are written to one shared
+// file, one JSON record per line (the op tagged with its document's ID).
+//
+// Syncing a file to disk takes milliseconds, so records aren't synced one at a
+// time. Appending a record only buffers it, and a syncer thread writes and
+// fsyncs every buffered record as one group once the group reaches group_bytes,
+// or group_secs after its first record was appended, whichever is sooner. Each
+// record gets a sequence number, and ot_wal_durable returns how many records
+// are on disk, so callers hold back whatever depends on a record (such as the
+// op's acknowledgement) until then. A caller blocked in ot_wal_wait has no
+// reason to let the group fill, so it's synced right away, and records
+// appended in the meantime join the next group.
+//
+// If LIBOT_NO_THREADS is defined or the syncer can't be started, every record
+// is synced as soon as it's appended.
+//
+// The log only grows. Recovering from it with ot_wal_replay rebuilds
+// documents from their first op, so it must be started along with the
+// documents it logs.
+
+typedef struct ot_wal_opts {
+    // Number of buffered bytes that starts a sync. 0 uses a default.
+    size_t group_bytes;
+
+    // Longest time a record is buffered before it's synced. 0 uses a default.
+    double group_secs;
+
+    // Called on the syncer thread after each group is synced (e.g., to wake
+    // an event loop so that it releases the group's messages), or NULL. It
+    // isn't called when records are synced as they're appended, since
+    // they're durable by the time ot_wal_append returns.
+    void (*synced)(void* arg);
+    void* arg;
+} ot_wal_opts;
+
+typedef struct ot_wal_stats {
+    uint64_t records;
+    uint64_t syncs;
+
+    // Time taken to write and fsync each group.
+    ot_latency sync;
+} ot_wal_stats;
+
+typedef struct ot_wal {
+    FILE* file;
+    size_t group_bytes;
+    double group_secs;
+    void (*synced)(void* arg);
+    void* arg;
+
+    ot_mutex lock;
+
+    // Signaled when the syncer has something to do, and when a group has been
+    // synced.
+    ot_cond wake;
+    ot_cond durable_cond;
+
+    // Records that haven't been handed to the syncer yet, and when the first
+    // of them was appended.
+    char* buf;
+    size_t buf_len;
+    size_t buf_cap;
+    double first;
+
+    // Number of callers blocked in ot_wal_wait.
+    size_t waiters;
+
+    // Number of records appended, and number of them that are on disk.
+    uint64_t appended;
+    uint64_t durable;
+
+    // Set if a group couldn't be written, after which nothing else is written
+    // or becomes durable.
+    bool failed;
+
+    bool closing;
+    bool threaded;
+    ot_thread syncer;
+
+    ot_wal_stats stats;
+} ot_wal;
+
+// Opens a log at path, appending to it if it already exists. A record that was
+// only partly written when the process stopped is removed first, so that it
+// doesn't run into the next one. Returns NULL if the log can't be opened or
+// trimmed.
+ot_wal* ot_open_wal(const char* path, const ot_wal_opts* opts);
+
+// Syncs any buffered records and closes the log.
+void ot_close_wal(ot_wal* wal);
+
+// Buffers a record of op being appended to the document with the given ID,
+// which may be NULL for a server that only has one document. Returns the
+// record's sequence number, which is durable once ot_wal_durable returns at
+// least that number.
+uint64_t ot_wal_append(ot_wal* wal, const char* doc_id, const ot_op* op);
+
+// Returns the number of records that are on disk.
+uint64_t ot_wal_durable(ot_wal* wal);
+
+// Blocks until the record with the given sequence number is on disk. Returns
+// false if it never will be because writing the log failed.
+bool ot_wal_wait(ot_wal* wal, uint64_t seq);
+
+// Copies the log's statistics.
+void ot_wal_get_stats(ot_wal* wal, ot_wal_stats* stats);
+
+// Called for every record while replaying a log. doc_id is "" for records
+// without a document ID. The callback takes ownership of op. Returning an
+// error stops the replay.
+typedef ot_err (*ot_wal_apply_func)(void* arg, const char* doc_id, ot_op* op);
+
+// Reads the log at path and passes every record to apply, in order. A record
+// that was only partly written when the process stopped is ignored, since it
+// can only be the last one and was never acknowledged. Returns the first error
+// returned by apply, or OT_ERR_INVALID_JSON if a complete record can't be
+// decoded. A missing log is an empty one.
+ot_err ot_wal_replay(const char* path, ot_wal_apply_func apply, void* arg);
+
+#endif